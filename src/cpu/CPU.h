@@ -3,10 +3,33 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
+#include <atomic>
 
 #include <types.h>
 
 class XexLoader;
+class CPUThread;
+struct Block_t;
+
+#define RETURN_STACK_SIZE 32
+
+struct DecodedInstr_t;
+
+/// @brief Every instruction handler in ops.cpp has this signature, the decoder tables are built out of these
+typedef void (CPUThread::*OpHandler)(const DecodedInstr_t& instr);
+
+/// @brief An instruction that has already been fetched, byte-swapped and decoded. Handlers take the register
+/// fields and immediate from here rather than pulling them out of `instr` again
+typedef struct DecodedInstr_t
+{
+	OpHandler handler;
+	uint32_t instr;
+	uint8_t rd; // Bits 21-25, also rS/frT/vD depending on the form
+	uint8_t ra;
+	uint8_t rb;
+	int32_t imm; // Sign-extended low 16 bits
+} DecodedInstr_t;
 
 /// @brief Contains most of the CPU state, including registers, SPRs, etc. 
 /// We declare this in a struct so the scheduler can access it to save/restore CPU state on a context switch
@@ -91,123 +114,161 @@ typedef struct
 	{
 		bool ca;
 	} xer;
+
+	// Set by lwarx, consumed by stwcx. (see cpu/reservation.h)
+	bool reserved;
+	uint32_t reserve_addr;
+	uint32_t reserve_value;
+	uint32_t reserve_version;
 } cpuState_t;
 
-/// @brief This will represent one of 6 hardware threads running at a time. 
-/// Ideally, we'll move these to their own threads and then have the scheduler dispatch guest threads
-/// as needed to these CPU threads, 
-/// in order to increase performance
+/// @brief The interpreter and the registers of whatever guest thread is switched in. There's one per hardware thread
+/// (see cpu/hwthread.h), and the scheduler swaps guest threads in and out of it (see kernel/scheduler.h)
 class CPUThread
 {
 public:
-	CPUThread(uint32_t entryPoint, uint32_t stackSize, XexLoader& ref);
+	CPUThread(XexLoader& ref);
 
+	/// @brief Builds the opcode dispatch tables. Must be called once at startup, before any thread runs
+	static void InitDecoder();
+	/// @brief Looks up the handler for `instruction` in the dispatch tables
+	static OpHandler Decode(uint32_t instruction);
+
+	/// @brief Executes a batch of chained blocks starting at the current PC, after parking if the
+	/// hardware threads are being paused. Returns early once the PC reaches the DoneRunningEntry sentinel
 	void Run();
 	void Dump();
 
-	void SetArg(int num, uint64_t value);
-
 	cpuState_t& GetState() {return state;}
+	/// @brief Exchanges the live registers with `context`, which is how guest threads are switched in and out
+	void SwapContext(cpuState_t& context);
+	/// @brief This processor's PCR, r13 points here while a guest thread runs on it
+	uint32_t GetPCR() {return pcrAddress;}
+
+	/// @brief Makes Run return at the end of the current block, so the scheduler gets a look in.
+	/// Can be called from any host thread
+	void RequestYield() {yieldRequested = true;}
+	/// @brief Clears a pending yield request and returns whether there was one
+	bool TakeYieldRequest() {return yieldRequested.exchange(false);}
 
 	bool DoneRunningEntry() {return state.pc == 0xBCBCBCBC;}
 public:
 	XexLoader& xexRef;
 private:
-	void twi(uint32_t instruction); // 3
-	void lvx128(uint32_t instruction); // 4 12
-	void stvx128(uint32_t instruction); // 4 30
-	void vslb(uint32_t instruction); // 4 260
-	void vspltb(uint32_t instruction); // 4 524
-	void vspltisb(uint32_t instruction); // 4 780
-	void vspltish(uint32_t instruction); // 4 844
-	void vspltisw128(uint32_t instruction); // 4 119
-	void vor(uint32_t instruction); // 4 1156
-	void mulli(uint32_t instruction); // 7
-	void subfic(uint32_t instruction); // 8
-	void cmpli(uint32_t instruction); // 10
-	void cmpi(uint32_t instruction); // 11
-	void addic(uint32_t instruction); // 12
-	void addicx(uint32_t instruction); // 13
-	void addi(uint32_t instruction); // 14
-	void addis(uint32_t instruction); // 15
-	void bc(uint32_t instruction); // 16
-	void sc(uint32_t instruction); // 17
-	void branch(uint32_t instruction); // 18
-	void bclr(uint32_t instruction); // 19 16
-	void bctr(uint32_t instruction); // 19 528
-	void rlwimi(uint32_t instruction); // 20
-	void rlwinm(uint32_t instruction); // 21
-	void ori(uint32_t instruction); // 24
-	void oris(uint32_t instruction); // 25
-	void andi(uint32_t instruction); // 28
-	void andis(uint32_t instruction); // 29
-	void rldicl(uint32_t instruction); // 30 0
-	void rldicr(uint32_t instruction); // 30 1
-	void cmp(uint32_t instruction); // 31 0
-	void lvsl(uint32_t instruction); // 31 6
-	void subfc(uint32_t instruction); // 31 8
-	void lwarx(uint32_t instruction); // 31 20
-	void lwzx(uint32_t instruction); // 31 23
-	void slw(uint32_t instruction); // 31 24
-	void cntlzw(uint32_t instruction); // 31 26
-	void sld(uint32_t instruction); // 31 27
-	void and_(uint32_t instruction); // 31 28
-	void cmpl(uint32_t instruction); // 31 32
-	void subf(uint32_t instruction); // 31 40
-	void andc(uint32_t instruction); // 31 60
-	void mfmsr(uint32_t instruction); // 31 83
-	void lbzx(uint32_t instruction); // 31 87
-	void neg(uint32_t instruction); // 31 104
-	void nor(uint32_t instruction); // 31 124
-	void subfe(uint32_t instruction); // 31 136
-	void stdx(uint32_t instruction); // 31 149
-	void stwcx(uint32_t instruction); // 31 150
-	void stwx(uint32_t instruction); // 31 151
-	void mtmsrd(uint32_t instruction); // 31 178
-	void subfze(uint32_t instruction); // 31 200
-	void addze(uint32_t instruction); // 31 202
-	void mullw(uint32_t instruction); // 31 235
-	void add(uint32_t instruction); // 31 266
-	void dcbt(uint32_t instruction); // 31 278
-	void xor_(uint32_t instruction); // 31 316
-	void mfspr(uint32_t instruction); // 31 339
-	void mftb(uint32_t instruction); // 31 371
-	void sthx(uint32_t instruction); // 31 407
-	void or_(uint32_t instruction); // 31 444
-	void divwu(uint32_t instruction); // 31 459
-	void mtspr(uint32_t instruction); // 31 467
-	void divd(uint32_t instruction); // 31 489
-	void stvlx(uint32_t instruction); // 31 647
-	void stwbrx(uint32_t instruction); // 31 662
-	void stvrx(uint32_t instruction); // 31 679
-	void srawi(uint32_t instruction); // 31 824
-	void dcbz(uint32_t instruction); // 31 1014
-	void lwz(uint32_t instruction); // 32
-	void lwzu(uint32_t instruction); // 33
-	void lbz(uint32_t instruction); // 34
-	void lbzu(uint32_t instruction); // 35
-	void stw(uint32_t instruction); // 36
-	void stwu(uint32_t instruction); // 37
-	void stb(uint32_t instruction); // 38
-	void stbu(uint32_t instruction); // 39
-	void lhz(uint32_t instruction); // 40
-	void sth(uint32_t instruction); // 44
-	void lfs(uint32_t instruction); // 48
-	void lfd(uint32_t instruction); // 50
-	void stfs(uint32_t instruction); // 52
-	void stfd(uint32_t instruction); // 54
-	void ld(uint32_t instruction); // 58
-	void fmuls(uint32_t instruction); // 59 25
-	void std(uint32_t instruction); // 62
-	void fcmpu(uint32_t instruction); // 63 0
-	void frsp(uint32_t instruction); // 63 12
-	void fdiv(uint32_t instruction); // 63 18
-	void fsqrt(uint32_t instruction); // 63 22
-	void fmul(uint32_t instruction); // 63 25
-	void fctid(uint32_t instruction); // 63 814
-	void fcfid(uint32_t instruction); // 63 846
+	void twi(const DecodedInstr_t& instr); // 3
+	void lvx128(const DecodedInstr_t& instr); // 4 12
+	void stvx128(const DecodedInstr_t& instr); // 4 30
+	void vslb(const DecodedInstr_t& instr); // 4 260
+	void vspltb(const DecodedInstr_t& instr); // 4 524
+	void vspltisb(const DecodedInstr_t& instr); // 4 780
+	void vspltish(const DecodedInstr_t& instr); // 4 844
+	void vspltisw128(const DecodedInstr_t& instr); // 4 119
+	void vor(const DecodedInstr_t& instr); // 4 1156
+	void mulli(const DecodedInstr_t& instr); // 7
+	void subfic(const DecodedInstr_t& instr); // 8
+	void cmpli(const DecodedInstr_t& instr); // 10
+	void cmpi(const DecodedInstr_t& instr); // 11
+	void addic(const DecodedInstr_t& instr); // 12
+	void addicx(const DecodedInstr_t& instr); // 13
+	void addi(const DecodedInstr_t& instr); // 14
+	void addis(const DecodedInstr_t& instr); // 15
+	void bc(const DecodedInstr_t& instr); // 16
+	void sc(const DecodedInstr_t& instr); // 17
+	void branch(const DecodedInstr_t& instr); // 18
+	void bclr(const DecodedInstr_t& instr); // 19 16
+	void bctr(const DecodedInstr_t& instr); // 19 528
+	void rlwimi(const DecodedInstr_t& instr); // 20
+	void rlwinm(const DecodedInstr_t& instr); // 21
+	void ori(const DecodedInstr_t& instr); // 24
+	void oris(const DecodedInstr_t& instr); // 25
+	void andi(const DecodedInstr_t& instr); // 28
+	void andis(const DecodedInstr_t& instr); // 29
+	void rldicl(const DecodedInstr_t& instr); // 30 0
+	void rldicr(const DecodedInstr_t& instr); // 30 1
+	void cmp(const DecodedInstr_t& instr); // 31 0
+	void lvsl(const DecodedInstr_t& instr); // 31 6
+	void subfc(const DecodedInstr_t& instr); // 31 8
+	void lwarx(const DecodedInstr_t& instr); // 31 20
+	void lwzx(const DecodedInstr_t& instr); // 31 23
+	void slw(const DecodedInstr_t& instr); // 31 24
+	void cntlzw(const DecodedInstr_t& instr); // 31 26
+	void sld(const DecodedInstr_t& instr); // 31 27
+	void and_(const DecodedInstr_t& instr); // 31 28
+	void cmpl(const DecodedInstr_t& instr); // 31 32
+	void subf(const DecodedInstr_t& instr); // 31 40
+	void andc(const DecodedInstr_t& instr); // 31 60
+	void mfmsr(const DecodedInstr_t& instr); // 31 83
+	void lbzx(const DecodedInstr_t& instr); // 31 87
+	void neg(const DecodedInstr_t& instr); // 31 104
+	void nor(const DecodedInstr_t& instr); // 31 124
+	void subfe(const DecodedInstr_t& instr); // 31 136
+	void stdx(const DecodedInstr_t& instr); // 31 149
+	void stwcx(const DecodedInstr_t& instr); // 31 150
+	void stwx(const DecodedInstr_t& instr); // 31 151
+	void mtmsrd(const DecodedInstr_t& instr); // 31 178
+	void subfze(const DecodedInstr_t& instr); // 31 200
+	void addze(const DecodedInstr_t& instr); // 31 202
+	void mullw(const DecodedInstr_t& instr); // 31 235
+	void add(const DecodedInstr_t& instr); // 31 266
+	void dcbt(const DecodedInstr_t& instr); // 31 278
+	void xor_(const DecodedInstr_t& instr); // 31 316
+	void mfspr(const DecodedInstr_t& instr); // 31 339
+	void mftb(const DecodedInstr_t& instr); // 31 371
+	void sthx(const DecodedInstr_t& instr); // 31 407
+	void or_(const DecodedInstr_t& instr); // 31 444
+	void divwu(const DecodedInstr_t& instr); // 31 459
+	void mtspr(const DecodedInstr_t& instr); // 31 467
+	void divd(const DecodedInstr_t& instr); // 31 489
+	void sync(const DecodedInstr_t& instr); // 31 598
+	void stvlx(const DecodedInstr_t& instr); // 31 647
+	void stwbrx(const DecodedInstr_t& instr); // 31 662
+	void stvrx(const DecodedInstr_t& instr); // 31 679
+	void srawi(const DecodedInstr_t& instr); // 31 824
+	void dcbz(const DecodedInstr_t& instr); // 31 1014
+	void lwz(const DecodedInstr_t& instr); // 32
+	void lwzu(const DecodedInstr_t& instr); // 33
+	void lbz(const DecodedInstr_t& instr); // 34
+	void lbzu(const DecodedInstr_t& instr); // 35
+	void stw(const DecodedInstr_t& instr); // 36
+	void stwu(const DecodedInstr_t& instr); // 37
+	void stb(const DecodedInstr_t& instr); // 38
+	void stbu(const DecodedInstr_t& instr); // 39
+	void lhz(const DecodedInstr_t& instr); // 40
+	void sth(const DecodedInstr_t& instr); // 44
+	void lfs(const DecodedInstr_t& instr); // 48
+	void lfd(const DecodedInstr_t& instr); // 50
+	void stfs(const DecodedInstr_t& instr); // 52
+	void stfd(const DecodedInstr_t& instr); // 54
+	void ld(const DecodedInstr_t& instr); // 58
+	void fmuls(const DecodedInstr_t& instr); // 59 25
+	void std(const DecodedInstr_t& instr); // 62
+	void fcmpu(const DecodedInstr_t& instr); // 63 0
+	void frsp(const DecodedInstr_t& instr); // 63 12
+	void fdiv(const DecodedInstr_t& instr); // 63 18
+	void fsqrt(const DecodedInstr_t& instr); // 63 22
+	void fmul(const DecodedInstr_t& instr); // 63 25
+	void fctid(const DecodedInstr_t& instr); // 63 814
+	void fcfid(const DecodedInstr_t& instr); // 63 846
+	void invalid(const DecodedInstr_t& instr);
 private:
 	bool CondPassed(uint8_t bo, uint8_t bi);
+	void ExecuteBlock(Block_t& block);
+	/// @brief Finds the block to run after `block` through its links and the return stack,
+	/// only going to the block cache when none of them predicted the new PC
+	std::shared_ptr<Block_t> NextBlock(const std::shared_ptr<Block_t>& block);
 private:
 	cpuState_t state;
+	uint32_t pcrAddress;
+	std::atomic<bool> yieldRequested = false;
+
+	/// @brief Return address predicted for a blr, pushed by the block that made the call
+	typedef struct
+	{
+		uint32_t returnAddr;
+		std::weak_ptr<Block_t> caller;
+	} ReturnPrediction_t;
+
+	// Circular, so deep recursion just overwrites the oldest predictions
+	ReturnPrediction_t returnStack[RETURN_STACK_SIZE];
+	int returnStackTop = 0;
 };
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include <cpu/blockcache.h>
+#include <memory/memory.h>
+#include <unordered_map>
+
+#define PAGE_SIZE (4*1024)
+#define MAX_BLOCK_INSTRS 256
+
+namespace BlockCache
+{
+
+std::unordered_map<uint32_t, std::shared_ptr<Block_t>> blocks;
+std::unordered_map<uint32_t, std::vector<uint32_t>> blocksInPage;
+// Guards both maps. Compiling a block happens under it too, so two hardware threads never decode the same block
+static std::mutex lock;
+
+static bool EndsBlock(uint32_t instr)
+{
+	switch (instr >> 26)
+	{
+	case 16: // bc
+	case 17: // sc
+	case 18: // b
+	case 19: // bclr, bctr
+		return true;
+	default:
+		return false;
+	}
+}
+
+static std::shared_ptr<Block_t> Compile(uint32_t pc)
+{
+	auto block = std::make_shared<Block_t>();
+	block->start = pc;
+	block->valid = true;
+	block->hostCode = nullptr;
+	block->isCall = false;
+	block->isReturn = false;
+
+	uint32_t pageEnd = (pc & ~(PAGE_SIZE - 1)) + PAGE_SIZE;
+	while (pc < pageEnd && block->instrs.size() < MAX_BLOCK_INSTRS)
+	{
+		uint32_t instr = Memory::Read32(pc);
+		pc += 4;
+
+		DecodedInstr_t decoded;
+		decoded.handler = CPUThread::Decode(instr);
+		decoded.instr = instr;
+		decoded.rd = (instr >> 21) & 0x1F;
+		decoded.ra = (instr >> 16) & 0x1F;
+		decoded.rb = (instr >> 11) & 0x1F;
+		decoded.imm = (int16_t)(instr & 0xFFFF);
+		block->instrs.push_back(decoded);
+
+		if (EndsBlock(instr))
+			break;
+	}
+
+	block->end = pc;
+	block->target = pc;
+
+	// Only the closing instruction can branch, work out where it can go
+	uint32_t last = block->instrs.back().instr;
+	uint32_t lastPc = pc - 4;
+	bool aa = (last >> 1) & 1;
+	bool lk = last & 1;
+	switch (last >> 26)
+	{
+	case 16:
+	{
+		// Matches the way bc computes its target in ops.cpp, which also ignores LK
+		int16_t bd = last & 0xFFFC;
+		block->target = aa ? (uint16_t)bd : lastPc + bd;
+		break;
+	}
+	case 18:
+	{
+		int32_t li = (int32_t)(last << 6) >> 6 & ~3;
+		block->target = aa ? li : lastPc + li;
+		block->isCall = lk;
+		break;
+	}
+	case 19:
+		block->isCall = lk;
+		block->isReturn = ((last >> 1) & 0x3FF) == 16 && !lk;
+		break;
+	}
+
+	return block;
+}
+
+std::shared_ptr<Block_t> Lookup(uint32_t pc)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto it = blocks.find(pc);
+	if (it != blocks.end())
+		return it->second;
+
+	// Before decoding, so stores from other hardware threads start invalidating the page before we read it
+	Memory::SetCodePage(pc, true);
+
+	auto block = Compile(pc);
+	blocks[pc] = block;
+	blocksInPage[pc / PAGE_SIZE].push_back(pc);
+
+	return block;
+}
+
+std::shared_ptr<Block_t> Follow(BlockLink_t& link, uint32_t pc)
+{
+	std::shared_ptr<Block_t> block = link.load(std::memory_order_acquire).lock();
+	if (!block || !block->valid || block->start != pc)
+	{
+		block = Lookup(pc);
+		link.store(block, std::memory_order_release);
+	}
+	return block;
+}
+
+void InvalidatePage(uint32_t addr)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto page = blocksInPage.find(addr / PAGE_SIZE);
+	if (page != blocksInPage.end())
+	{
+		for (uint32_t start : page->second)
+		{
+			auto it = blocks.find(start);
+			if (it == blocks.end())
+				continue;
+			it->second->valid = false;
+			blocks.erase(it);
+		}
+		blocksInPage.erase(page);
+	}
+
+	Memory::SetCodePage(addr, false);
+}
+
+void DropHostCode()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	for (auto& it : blocks)
+		it.second->hostCode = nullptr;
+}
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <cpu/CPU.h>
+#include <cpu/ir/ir.h>
+
+/// @brief Entry point of a block compiled by the JIT (see cpu/jit/jit.h)
+typedef void (*HostCode)(cpuState_t* state, CPUThread* thread);
+
+struct Block_t;
+
+/// @brief A cached edge to another block, filled in the first time the edge is taken.
+/// Hardware threads share blocks, so it's swapped atomically and checked against the PC before use
+typedef std::atomic<std::weak_ptr<Block_t>> BlockLink_t;
+
+/// @brief A run of straight-line guest code, ending at the first branch, `sc`, or page boundary
+typedef struct Block_t
+{
+	uint32_t start;
+	uint32_t end; // Address of the first instruction after the block
+	std::atomic<bool> valid; // Cleared when the code underneath is written to. Blocks are never re-validated
+	std::vector<DecodedInstr_t> instrs;
+	std::unique_ptr<IRBlock_t> ir; // Built on demand by the IR interpreter and the JIT
+	std::once_flag irBuilt;
+	std::atomic<HostCode> hostCode; // nullptr until the JIT compiles the block
+
+	// Successors, so the dispatcher can chain blocks without going through Lookup
+	uint32_t target; // Where a closing b/bc goes, known at decode time
+	BlockLink_t taken;
+	BlockLink_t fallthrough; // `end`, also where a call returns to
+	BlockLink_t indirect; // Last target seen for any other exit (bclr, bcctr, `sc` changing the PC)
+	bool isCall; // Closing branch sets LR
+	bool isReturn; // Closing branch is bclr without LK
+} Block_t;
+
+namespace BlockCache
+{
+
+/// @brief Returns the block starting at `pc`, decoding it first if it isn't cached
+/// The returned pointer keeps the block alive even if it gets invalidated while running
+std::shared_ptr<Block_t> Lookup(uint32_t pc);
+
+/// @brief Returns the block at `pc` through `link`, looking it up and caching it in the link on a miss
+std::shared_ptr<Block_t> Follow(BlockLink_t& link, uint32_t pc);
+
+/// @brief Throws away every block with code in the page containing `addr`. Called by Memory when a code page is written
+void InvalidatePage(uint32_t addr);
+
+/// @brief Forgets the host code of every cached block, for when the JIT flushes its code cache.
+/// No hardware thread may be running host code at the time
+void DropHostCode();
+
+}
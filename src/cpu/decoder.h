@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cpu/opcodes.h>
+
+/// @brief Two-level opcode lookup table: primary opcode first, then an extended opcode sub-table for the groups in `PPC_OPCODE_GROUPS`
+/// The interpreter stores handlers in it, the disassembler stores formatters
+template<typename T>
+class DecoderTable
+{
+public:
+	/// @brief Points every slot at `invalid` and allocates the sub-tables
+	void Init(T invalid)
+	{
+		for (int i = 0; i < 64; i++)
+		{
+			primary[i].value = invalid;
+			primary[i].sub = nullptr;
+			primary[i].shift = 0;
+			primary[i].mask = 0;
+		}
+
+#define INIT_SUBTABLE(op, shift_, size) \
+		primary[op].sub = new T[size]; \
+		primary[op].shift = shift_; \
+		primary[op].mask = size - 1; \
+		for (int i = 0; i < size; i++) \
+			primary[op].sub[i] = invalid;
+		PPC_OPCODE_GROUPS(INIT_SUBTABLE)
+#undef INIT_SUBTABLE
+	}
+
+	/// @brief Routes an opcode to `value`. See `PPC_INSTRUCTIONS` for the meaning of `ext` and `extMask`
+	void Register(uint32_t op, uint32_t ext, uint32_t extMask, T value)
+	{
+		if (!primary[op].sub)
+		{
+			primary[op].value = value;
+			return;
+		}
+
+		for (uint32_t i = 0; i <= primary[op].mask; i++)
+		{
+			if ((i & extMask) == ext)
+				primary[op].sub[i] = value;
+		}
+	}
+
+	const T& Lookup(uint32_t instruction) const
+	{
+		const Group& group = primary[instruction >> 26];
+		if (group.sub)
+			return group.sub[(instruction >> group.shift) & group.mask];
+		return group.value;
+	}
+private:
+	struct Group
+	{
+		T value;
+		T* sub; // Non-null if this primary opcode is split by an extended opcode
+		uint32_t shift;
+		uint32_t mask;
+	};
+
+	Group primary[64];
+};
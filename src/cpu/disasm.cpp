@@ -0,0 +1,602 @@
+#include <cpu/disasm.h>
+#include <cpu/decoder.h>
+#include <cstdio>
+
+enum GprField : int8_t
+{
+	GPR_NONE,
+	GPR_RT, // Bits 21-25
+	GPR_RA, // Bits 16-20
+};
+
+typedef void (*DisasmFunc)(uint32_t instruction, uint32_t pc, char* buf, size_t size);
+
+struct DisasmEntry
+{
+	DisasmFunc func;
+	GprField dest;
+};
+
+static DecoderTable<DisasmEntry> disasmTable;
+
+// Declares the formatter for `name`, along with the register field it writes to
+#define DISASM(name, dest) \
+	static constexpr GprField dest_##name = dest; \
+	static void dis_##name([[maybe_unused]] uint32_t instruction, [[maybe_unused]] uint32_t pc, char* buf, size_t size)
+
+#define RT ((instruction >> 21) & 0x1F)
+#define RA ((instruction >> 16) & 0x1F)
+#define RB ((instruction >> 11) & 0x1F)
+#define VMX128_VD (((instruction >> 21) & 0x1F) | (((instruction >> 2) & 0x3) << 5))
+#define SIMM ((int16_t)(instruction & 0xFFFF))
+#define UIMM (instruction & 0xFFFF)
+#define RC ((instruction & 1) ? "." : "")
+
+static uint32_t GenShiftMask64(uint8_t me, uint8_t mb)
+{
+	uint32_t maskmb = ~0u >> mb;
+	uint32_t maskme = ~0u << (31 - me);
+	return (mb <= me) ? maskmb & maskme : maskmb | maskme;
+}
+
+DISASM(invalid, GPR_NONE)
+{
+	snprintf(buf, size, ".long 0x%08x", instruction);
+}
+
+DISASM(twi, GPR_NONE)
+{
+	snprintf(buf, size, "twi %d,r%d,%d", RT, RA, SIMM);
+}
+
+DISASM(lvx128, GPR_NONE)
+{
+	snprintf(buf, size, "lvx128 v%d, r%d, r%d", VMX128_VD, RA, RB);
+}
+
+DISASM(stvx128, GPR_NONE)
+{
+	snprintf(buf, size, "stvx128 v%d, r%d, r%d", VMX128_VD, RA, RB);
+}
+
+DISASM(vslb, GPR_NONE)
+{
+	snprintf(buf, size, "vslb v%d,v%d,v%d", RT, RA, RB);
+}
+
+DISASM(vspltb, GPR_NONE)
+{
+	snprintf(buf, size, "vspltb v%d,v%d,%d", RT, RB, RA);
+}
+
+DISASM(vspltisb, GPR_NONE)
+{
+	uint8_t imm = RA;
+	imm = (imm & 0x10) ? (uint8_t)(imm | 0xF0) : imm;
+	snprintf(buf, size, "vspltisb v%d,%d", RT, imm);
+}
+
+DISASM(vspltish, GPR_NONE)
+{
+	uint16_t imm = RA;
+	imm = (imm & 0x10) ? (uint16_t)(imm | 0xFFF0) : imm;
+	snprintf(buf, size, "vspltish v%d,%d", RT, imm);
+}
+
+DISASM(vspltisw128, GPR_NONE)
+{
+	uint32_t imm = RB;
+	imm = (imm & 0x10) ? (uint32_t)-1 : imm;
+	snprintf(buf, size, "vspltisw128 v%d, 0x%08x", VMX128_VD, imm);
+}
+
+DISASM(vor, GPR_NONE)
+{
+	snprintf(buf, size, "vor v%d,v%d,v%d", RT, RA, RB);
+}
+
+DISASM(mulli, GPR_RT)
+{
+	snprintf(buf, size, "mulli r%d,r%d,%d", RT, RA, SIMM);
+}
+
+DISASM(subfic, GPR_RT)
+{
+	snprintf(buf, size, "subfic r%d,r%d,0x%08lx", RT, RA, (uint64_t)(int64_t)SIMM);
+}
+
+DISASM(cmpli, GPR_NONE)
+{
+	bool l = (instruction >> 21) & 1;
+	snprintf(buf, size, "%s cr%d,r%d,0x%08x", l ? "cmpldi" : "cmplwi", (instruction >> 23) & 0x7, RA, UIMM);
+}
+
+DISASM(cmpi, GPR_NONE)
+{
+	bool l = (instruction >> 21) & 1;
+	snprintf(buf, size, "%s cr%d,r%d,0x%08lx", l ? "cmpdi" : "cmpwi", (instruction >> 23) & 0x7, RA, (int64_t)SIMM);
+}
+
+DISASM(addic, GPR_RT)
+{
+	if (SIMM < 0)
+		snprintf(buf, size, "subic r%d,r%d,%d", RT, RA, -SIMM);
+	else
+		snprintf(buf, size, "addic r%d,r%d,%d", RT, RA, SIMM);
+}
+
+DISASM(addicx, GPR_RT)
+{
+	if (SIMM < 0)
+		snprintf(buf, size, "subic. r%d,r%d,%d", RT, RA, -SIMM);
+	else
+		snprintf(buf, size, "addic. r%d,r%d,%d", RT, RA, SIMM);
+}
+
+DISASM(addi, GPR_RT)
+{
+	if (RA == 0)
+		snprintf(buf, size, "li r%d, 0x%08lx", RT, (int64_t)SIMM);
+	else if (SIMM < 0)
+		snprintf(buf, size, "subi r%d,r%d,%d", RT, RA, -SIMM);
+	else
+		snprintf(buf, size, "addi r%d,r%d,%d", RT, RA, SIMM);
+}
+
+DISASM(addis, GPR_RT)
+{
+	int32_t si = (instruction & 0xFFFF) << 16;
+	if (RA == 0)
+		snprintf(buf, size, "lis r%d, 0x%08lx", RT, (int64_t)si);
+	else if (si < 0)
+		snprintf(buf, size, "subis r%d,r%d,%d", RT, RA, -si);
+	else
+		snprintf(buf, size, "addis r%d,r%d,%d", RT, RA, si);
+}
+
+DISASM(bc, GPR_NONE)
+{
+	int16_t bd = (int16_t)(instruction & 0xFFFC);
+	bool aa = (instruction >> 1) & 1;
+	bool lk = instruction & 1;
+
+	uint32_t target = aa ? (uint16_t)bd : pc + bd;
+	snprintf(buf, size, "bc%s 0x%08x", lk ? "l" : "", target);
+}
+
+DISASM(sc, GPR_NONE)
+{
+	snprintf(buf, size, "sc %d", (instruction >> 5) & 0x7F);
+}
+
+DISASM(branch, GPR_NONE)
+{
+	bool lk = (instruction & 1);
+	bool aa = (instruction >> 1) & 1;
+	int32_t li = instruction & 0x3FFFFFC;
+	li = (li ^ 0x2000000) - 0x2000000;
+
+	uint32_t target = aa ? li : pc + li;
+	snprintf(buf, size, "b%s 0x%08x", lk ? "l" : "", target);
+}
+
+DISASM(bclr, GPR_NONE)
+{
+	snprintf(buf, size, "bclr");
+}
+
+DISASM(bctr, GPR_NONE)
+{
+	snprintf(buf, size, "bctr");
+}
+
+DISASM(rlwimi, GPR_RA)
+{
+	uint8_t sh = (instruction >> 11) & 0x1F;
+	uint8_t mb = (instruction >> 6) & 0x1F;
+	uint8_t me = (instruction >> 1) & 0x1F;
+	snprintf(buf, size, "rlwimi r%d,r%d,%d,0x%02x,0x%02x", RA, RT, sh, mb, me);
+}
+
+DISASM(rlwinm, GPR_RA)
+{
+	uint8_t sh = (instruction >> 11) & 0x1F;
+	uint8_t mb = (instruction >> 6) & 0x1F;
+	uint8_t me = (instruction >> 1) & 0x1F;
+	snprintf(buf, size, "rlwinm r%d,r%d,%d,0x%02x,0x%02x (0x%08x)", RA, RT, sh, mb, me, GenShiftMask64(me, mb));
+}
+
+DISASM(ori, GPR_RA)
+{
+	snprintf(buf, size, "ori r%d,r%d,0x%04x", RA, RT, UIMM);
+}
+
+DISASM(oris, GPR_RA)
+{
+	snprintf(buf, size, "oris r%d,r%d,0x%04x", RA, RT, UIMM);
+}
+
+DISASM(andi, GPR_RA)
+{
+	snprintf(buf, size, "andi. r%d,r%d,0x%04x", RA, RT, UIMM);
+}
+
+DISASM(andis, GPR_RA)
+{
+	snprintf(buf, size, "andis. r%d,r%d,0x%04x", RA, RT, UIMM << 16);
+}
+
+DISASM(rldicl, GPR_RA)
+{
+	uint16_t sh = ((instruction >> 11) & 0x1F) | (((instruction >> 1) & 1) << 5);
+	uint16_t mb = ((instruction >> 6) & 0x1F) | (((instruction >> 5) & 0x1) << 5);
+	snprintf(buf, size, "rldicl r%d,r%d,%d,%d", RT, RA, sh, mb);
+}
+
+DISASM(rldicr, GPR_RA)
+{
+	uint16_t sh = ((instruction >> 11) & 0x1F) | (((instruction >> 1) & 1) << 5);
+	uint16_t mb = ((instruction >> 6) & 0x1F) | (((instruction >> 5) & 0x1) << 5);
+	snprintf(buf, size, "rldicr r%d,r%d,%d,%d", RT, RA, sh, mb);
+}
+
+DISASM(cmp, GPR_NONE)
+{
+	bool l = (instruction >> 21) & 1;
+	snprintf(buf, size, "%s cr%d,r%d,r%d", l ? "cmpd" : "cmpw", (instruction >> 23) & 0x7, RA, RB);
+}
+
+DISASM(lvsl, GPR_NONE)
+{
+	snprintf(buf, size, "lvsl v%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(subfc, GPR_RT)
+{
+	snprintf(buf, size, "subfc r%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(lwarx, GPR_RT)
+{
+	snprintf(buf, size, "lwarx r%d, r%d(r%d)", RT, RA, RB);
+}
+
+DISASM(lwzx, GPR_RT)
+{
+	snprintf(buf, size, "lwzx r%d, r%d(r%d)", RT, RA, RB);
+}
+
+DISASM(slw, GPR_RA)
+{
+	snprintf(buf, size, "slw r%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(cntlzw, GPR_RA)
+{
+	snprintf(buf, size, "cntlzw r%d,r%d", RT, RA);
+}
+
+DISASM(sld, GPR_RA)
+{
+	snprintf(buf, size, "sld r%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(and_, GPR_RA)
+{
+	snprintf(buf, size, "and%s r%d,r%d,r%d", RC, RA, RT, RB);
+}
+
+DISASM(cmpl, GPR_NONE)
+{
+	bool l = (instruction >> 21) & 1;
+	snprintf(buf, size, "%s cr%d,r%d,r%d", l ? "cmpld" : "cmplw", (instruction >> 23) & 0x7, RA, RB);
+}
+
+DISASM(subf, GPR_RT)
+{
+	snprintf(buf, size, "subf r%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(andc, GPR_RA)
+{
+	snprintf(buf, size, "andc r%d,r%d,r%d", RA, RT, RB);
+}
+
+DISASM(mfmsr, GPR_RT)
+{
+	snprintf(buf, size, "mfmsr r%d", RT);
+}
+
+DISASM(lbzx, GPR_RT)
+{
+	snprintf(buf, size, "lbzx r%d, r%d, r%d", RT, RA, RB);
+}
+
+DISASM(neg, GPR_RT)
+{
+	snprintf(buf, size, "neg r%d,r%d", RT, RA);
+}
+
+DISASM(nor, GPR_RA)
+{
+	snprintf(buf, size, "nor%s r%d,r%d,r%d", RC, RA, RT, RB);
+}
+
+DISASM(subfe, GPR_RT)
+{
+	snprintf(buf, size, "subfe r%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(stdx, GPR_NONE)
+{
+	snprintf(buf, size, "stdx r%d, r%d(r%d)", RT, RA, RB);
+}
+
+DISASM(stwcx, GPR_NONE)
+{
+	snprintf(buf, size, "stwcx. r%d, r%d(r%d)", RT, RA, RB);
+}
+
+DISASM(stwx, GPR_NONE)
+{
+	snprintf(buf, size, "stwx r%d, r%d(r%d)", RT, RA, RB);
+}
+
+DISASM(mtmsrd, GPR_NONE)
+{
+	snprintf(buf, size, "mtmsrd r%d,%d", RT, RA);
+}
+
+DISASM(subfze, GPR_RT)
+{
+	snprintf(buf, size, "subfze r%d,r%d", RT, RA);
+}
+
+DISASM(addze, GPR_RT)
+{
+	snprintf(buf, size, "addze r%d,r%d", RT, RA);
+}
+
+DISASM(mullw, GPR_RT)
+{
+	snprintf(buf, size, "mullw r%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(add, GPR_RT)
+{
+	snprintf(buf, size, "add%s r%d,r%d,r%d", RC, RT, RA, RB);
+}
+
+DISASM(dcbt, GPR_NONE)
+{
+	snprintf(buf, size, "dcbt");
+}
+
+DISASM(xor_, GPR_RA)
+{
+	snprintf(buf, size, "xor%s r%d,r%d,r%d", RC, RA, RT, RB);
+}
+
+DISASM(mfspr, GPR_RT)
+{
+	uint16_t spr = (instruction >> 11) & 0x3FF;
+	if (spr == 0x100)
+		snprintf(buf, size, "mflr r%d", RT);
+	else
+		snprintf(buf, size, "mfspr r%d,0x%03x", RT, spr);
+}
+
+DISASM(mftb, GPR_RT)
+{
+	snprintf(buf, size, "mftb r%d", RT);
+}
+
+DISASM(sthx, GPR_NONE)
+{
+	snprintf(buf, size, "sthx r%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(or_, GPR_RA)
+{
+	if (RT == RB)
+		snprintf(buf, size, "mr r%d,r%d", RA, RT);
+	else
+		snprintf(buf, size, "or%s r%d,r%d,r%d", RC, RA, RT, RB);
+}
+
+DISASM(divwu, GPR_RT)
+{
+	snprintf(buf, size, "divwu r%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(mtspr, GPR_NONE)
+{
+	uint16_t spr = (instruction >> 11) & 0x3FF;
+	if (spr == 0x100)
+		snprintf(buf, size, "mtlr r%d", RT);
+	else if (spr == 0x120)
+		snprintf(buf, size, "mtctr r%d", RT);
+	else
+		snprintf(buf, size, "mtspr 0x%03x,r%d", spr, RT);
+}
+
+DISASM(divd, GPR_RT)
+{
+	snprintf(buf, size, "divd r%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(sync, GPR_NONE)
+{
+	snprintf(buf, size, "sync");
+}
+
+DISASM(stvlx, GPR_NONE)
+{
+	snprintf(buf, size, "stvlx v%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(stwbrx, GPR_NONE)
+{
+	snprintf(buf, size, "stwbrx r%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(stvrx, GPR_NONE)
+{
+	snprintf(buf, size, "stvrx v%d,r%d,r%d", RT, RA, RB);
+}
+
+DISASM(srawi, GPR_RA)
+{
+	snprintf(buf, size, "srawi r%d,r%d,%d", RA, RT, RB);
+}
+
+DISASM(dcbz, GPR_NONE)
+{
+	snprintf(buf, size, "dcbz r%d,r%d", RA, RB);
+}
+
+DISASM(lwz, GPR_RT)
+{
+	snprintf(buf, size, "lwz r%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(lwzu, GPR_RT)
+{
+	snprintf(buf, size, "lwzu r%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(lbz, GPR_RT)
+{
+	snprintf(buf, size, "lbz r%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(lbzu, GPR_RT)
+{
+	snprintf(buf, size, "lbzu r%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(stw, GPR_NONE)
+{
+	snprintf(buf, size, "stw r%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(stwu, GPR_RA)
+{
+	snprintf(buf, size, "stwu r%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(stb, GPR_NONE)
+{
+	snprintf(buf, size, "stb r%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(stbu, GPR_RA)
+{
+	snprintf(buf, size, "stbu r%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(lhz, GPR_RT)
+{
+	snprintf(buf, size, "lhz r%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(sth, GPR_NONE)
+{
+	snprintf(buf, size, "sth r%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(lfs, GPR_NONE)
+{
+	snprintf(buf, size, "lfs fr%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(lfd, GPR_NONE)
+{
+	snprintf(buf, size, "lfd fr%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(stfs, GPR_NONE)
+{
+	snprintf(buf, size, "stfs fr%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(stfd, GPR_NONE)
+{
+	snprintf(buf, size, "stfd fr%d, %d(r%d)", RT, SIMM, RA);
+}
+
+DISASM(ld, GPR_RT)
+{
+	int16_t ds = instruction & 0xFFFC;
+	snprintf(buf, size, "ld%s r%d, %d(r%d)", (instruction & 1) ? "u" : "", RT, ds, RA);
+}
+
+DISASM(fmuls, GPR_NONE)
+{
+	snprintf(buf, size, "fmuls f%d,f%d,f%d", RT, RA, (instruction >> 6) & 0x1F);
+}
+
+DISASM(std, GPR_NONE)
+{
+	int16_t ds = instruction & 0xFFFC;
+	snprintf(buf, size, "std%s r%d, %d(r%d)", (instruction & 1) ? "u" : "", RT, ds, RA);
+}
+
+DISASM(fcmpu, GPR_NONE)
+{
+	snprintf(buf, size, "fcmpu cr%d,f%d,f%d", (instruction >> 23) & 0x7, RA, RB);
+}
+
+DISASM(frsp, GPR_NONE)
+{
+	snprintf(buf, size, "frsp f%d,f%d", RT, RB);
+}
+
+DISASM(fdiv, GPR_NONE)
+{
+	snprintf(buf, size, "fdiv f%d,f%d,f%d", RT, RA, RB);
+}
+
+DISASM(fsqrt, GPR_NONE)
+{
+	snprintf(buf, size, "fsqrt f%d,f%d", RT, RB);
+}
+
+DISASM(fmul, GPR_NONE)
+{
+	snprintf(buf, size, "fmul f%d,f%d,f%d", RT, RA, (instruction >> 6) & 0x1F);
+}
+
+DISASM(fctid, GPR_NONE)
+{
+	snprintf(buf, size, "fctid f%d,f%d", RT, RB);
+}
+
+DISASM(fcfid, GPR_NONE)
+{
+	snprintf(buf, size, "fcfid f%d,f%d", RT, RB);
+}
+
+void Disasm::Initialize()
+{
+	disasmTable.Init({dis_invalid, dest_invalid});
+
+#define REGISTER_DISASM(name, op, ext, extMask) disasmTable.Register(op, ext, extMask, {dis_##name, dest_##name});
+	PPC_INSTRUCTIONS(REGISTER_DISASM)
+#undef REGISTER_DISASM
+}
+
+void Disasm::Disassemble(uint32_t instruction, uint32_t pc, char *buf, size_t size)
+{
+	disasmTable.Lookup(instruction).func(instruction, pc, buf, size);
+}
+
+int Disasm::GetDestGPR(uint32_t instruction)
+{
+	switch (disasmTable.Lookup(instruction).dest)
+	{
+	case GPR_RT: return RT;
+	case GPR_RA: return RA;
+	default: return -1;
+	}
+}
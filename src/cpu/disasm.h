@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/// @brief Turns guest instructions back into text. Shared between the tracer and the offline trace dumper,
+/// so it must not depend on any emulator state
+namespace Disasm
+{
+
+void Initialize();
+
+/// @brief Formats `instruction` (fetched from `pc`) into `buf`, in the same syntax the interpreter has always logged
+void Disassemble(uint32_t instruction, uint32_t pc, char* buf, size_t size);
+
+/// @brief Returns the GPR that `instruction` writes its result to, or -1 if it doesn't write one
+int GetDestGPR(uint32_t instruction);
+
+}
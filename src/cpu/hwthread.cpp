@@ -0,0 +1,142 @@
+#include <cpu/hwthread.h>
+#include <kernel/scheduler.h>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cassert>
+
+// One lock for all of it: threads only take it to change state, never while running guest code
+static std::mutex lock;
+static std::condition_variable cond;
+
+static HardwareThread* threads[HW_THREAD_COUNT];
+static thread_local HardwareThread* current = nullptr;
+
+static int running = 0; // Hardware threads that aren't idle, parked or not
+static int parked = 0;
+static std::atomic<int> pauseCount = 0; // Outstanding PauseAll calls, all from `pauseOwner`
+static std::thread::id pauseOwner;
+
+HardwareThread::HardwareThread(int id, XexLoader& xex)
+: id(id)
+{
+	cpu = new CPUThread(xex);
+	host = std::thread(&HardwareThread::ThreadMain, this);
+}
+
+void HardwareThread::Join()
+{
+	host.join();
+}
+
+void HardwareThread::ThreadMain()
+{
+	current = this;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		running++;
+	}
+
+	Scheduler::RunWorker(id, *cpu);
+
+	std::lock_guard<std::mutex> guard(lock);
+	running--;
+	cond.notify_all();
+}
+
+namespace HardwareThreads
+{
+
+void Initialize(XexLoader& xex)
+{
+	for (int i = 0; i < HW_THREAD_COUNT; i++)
+		threads[i] = new HardwareThread(i, xex);
+}
+
+void Shutdown()
+{
+	for (int i = 0; i < HW_THREAD_COUNT; i++)
+		threads[i]->Join();
+}
+
+HardwareThread* Get(int id)
+{
+	assert(id >= 0 && id < HW_THREAD_COUNT);
+	return threads[id];
+}
+
+HardwareThread* GetCurrent()
+{
+	return current;
+}
+
+void PauseAll()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	std::thread::id self = std::this_thread::get_id();
+
+	if (pauseCount > 0 && pauseOwner == self)
+	{
+		pauseCount++;
+		return;
+	}
+
+	// Someone else is already pausing everything. Wait for them as if parked, or they'd wait on us forever
+	if (current)
+		parked++;
+	cond.notify_all();
+	cond.wait(guard, []() {return pauseCount == 0;});
+	if (current)
+		parked--;
+
+	pauseOwner = self;
+	pauseCount = 1;
+
+	// A thread that picks up work meanwhile parks before its first batch
+	int selfRunning = current ? 1 : 0;
+	cond.wait(guard, [selfRunning]() {return parked >= running - selfRunning;});
+}
+
+void ResumeAll()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	assert(pauseCount > 0 && pauseOwner == std::this_thread::get_id());
+
+	if (--pauseCount == 0)
+	{
+		pauseOwner = std::thread::id();
+		cond.notify_all();
+	}
+}
+
+void CheckPause()
+{
+	if (pauseCount.load(std::memory_order_relaxed) == 0)
+		return;
+
+	std::unique_lock<std::mutex> guard(lock);
+	if (!current || pauseOwner == std::this_thread::get_id())
+		return;
+
+	parked++;
+	cond.notify_all();
+	cond.wait(guard, []() {return pauseCount == 0;});
+	parked--;
+}
+
+void EnterIdle()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	running--;
+	cond.notify_all();
+}
+
+void LeaveIdle()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	cond.wait(guard, []() {return pauseCount == 0 || pauseOwner == std::this_thread::get_id();});
+	running++;
+}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cpu/CPU.h>
+#include <thread>
+
+// Three cores, two hardware threads each
+#define HW_THREAD_COUNT 6
+
+/// @brief One Xenon hardware thread, backed by its own host thread. It owns the CPUThread that guest threads
+/// are switched into, and runs whatever the scheduler gives it (see kernel/scheduler.h).
+/// Between batches it parks if anyone asked to pause all hardware threads
+class HardwareThread
+{
+public:
+	HardwareThread(int id, XexLoader& xex);
+
+	/// @brief Waits for the scheduler to let go of this hardware thread, see Scheduler::Shutdown
+	void Join();
+
+	int GetId() {return id;}
+	CPUThread* GetCPU() {return cpu;}
+private:
+	void ThreadMain();
+private:
+	int id;
+	CPUThread* cpu;
+	std::thread host;
+};
+
+namespace HardwareThreads
+{
+
+/// @brief Creates the hardware threads, which start asking the scheduler for work right away
+void Initialize(XexLoader& xex);
+/// @brief Joins every hardware thread. Call Scheduler::Shutdown first
+void Shutdown();
+
+HardwareThread* Get(int id);
+/// @brief The hardware thread the caller is running on, nullptr on any other host thread
+HardwareThread* GetCurrent();
+
+/// @brief Waits until every other hardware thread is parked between two batches or idle, and keeps them there
+/// until the matching ResumeAll. Nests, and can be called from any host thread including a hardware thread.
+/// A parked thread may still be in the middle of a kernel call that runs guest code (XexLoadImage)
+void PauseAll();
+void ResumeAll();
+
+/// @brief Parks the calling hardware thread while a pause is in effect. Called by CPUThread::Run before every batch
+void CheckPause();
+
+/// @brief Brackets a stretch where the calling hardware thread blocks without running guest code, like waiting
+/// for the scheduler to find it work, so PauseAll doesn't wait for it. LeaveIdle parks if a pause is in effect
+void EnterIdle();
+void LeaveIdle();
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cpu/blockcache.h>
+
+namespace IR
+{
+
+/// @brief Translates the decoded instructions of `block` into (unoptimized) IR
+void Lower(const Block_t& block, IRBlock_t& ir);
+/// @brief Returns the optimized IR for `block`, lowering it on first use
+const IRBlock_t& GetBlock(Block_t& block);
+
+/// @brief Runs blocks through the IR interpreter instead of the op-by-op one. Set from main for `--ir`
+void Enable();
+bool IsEnabled();
+/// @brief Executes one block through the IR interpreter
+void Run(Block_t& block, cpuState_t& state, CPUThread* thread);
+
+}
@@ -0,0 +1,79 @@
+#include <cpu/ir/frontend.h>
+#include <memory/memory.h>
+#include <cstring>
+
+namespace IR
+{
+
+static bool enabled = false;
+
+void Enable()
+{
+	enabled = true;
+}
+
+bool IsEnabled()
+{
+	return enabled;
+}
+
+void Run(Block_t& block, cpuState_t& state, CPUThread* thread)
+{
+	const IRBlock_t& ir = GetBlock(block);
+
+	static thread_local std::vector<uint64_t> values;
+	if (values.size() < ir.instrs.size())
+		values.resize(ir.instrs.size());
+
+	uint8_t* regs = (uint8_t*)&state;
+	for (size_t i = 0; i < ir.instrs.size(); i++)
+	{
+		const IRInstr_t& in = ir.instrs[i];
+		uint64_t a = values[in.args[0]];
+		uint64_t b = values[in.args[1]];
+
+		switch (in.op)
+		{
+		case IR_NOP:
+			break;
+		case IR_LOAD_REG:
+			if (IsReg32(in.imm))
+				values[i] = *(uint32_t*)(regs + RegOffset(in.imm));
+			else
+				values[i] = *(uint64_t*)(regs + RegOffset(in.imm));
+			break;
+		case IR_STORE_REG:
+			if (IsReg32(in.imm))
+				*(uint32_t*)(regs + RegOffset(in.imm)) = a;
+			else
+				*(uint64_t*)(regs + RegOffset(in.imm)) = a;
+			break;
+		case IR_READ8: values[i] = Memory::Read8(a); break;
+		case IR_READ16: values[i] = Memory::Read16(a); break;
+		case IR_READ32: values[i] = Memory::Read32(a); break;
+		case IR_READ64: values[i] = Memory::Read64(a); break;
+		case IR_WRITE8: Memory::Write8(a, b); break;
+		case IR_WRITE16: Memory::Write16(a, b); break;
+		case IR_WRITE32: Memory::Write32(a, b); break;
+		case IR_WRITE64: Memory::Write64(a, b); break;
+		case IR_INTERPRET:
+		{
+			const DecodedInstr_t* instr = (const DecodedInstr_t*)in.imm;
+			(thread->*instr->handler)(*instr);
+			break;
+		}
+		case IR_EXIT_IF_INVALID:
+			if (!block.valid)
+			{
+				state.pc = in.imm;
+				return;
+			}
+			break;
+		default:
+			values[i] = Evaluate(in, a, b, values[in.args[2]]);
+			break;
+		}
+	}
+}
+
+}
@@ -0,0 +1,274 @@
+#include <cpu/ir/ir.h>
+#include <cpu/CPU.h>
+#include <bit>
+
+namespace IR
+{
+
+size_t RegOffset(int reg)
+{
+	if (reg < IR_REG_LR)
+		return offsetof(cpuState_t, regs) + reg * 8;
+	if (reg == IR_REG_LR)
+		return offsetof(cpuState_t, lr);
+	if (reg == IR_REG_CTR)
+		return offsetof(cpuState_t, ctr);
+	if (reg == IR_REG_PC)
+		return offsetof(cpuState_t, pc);
+	return offsetof(cpuState_t, CR) + (reg - IR_REG_CR0) * 4;
+}
+
+bool IsReg32(int reg)
+{
+	return reg >= IR_REG_CR0 && reg < IR_REG_PC;
+}
+
+bool IsPure(IROp op)
+{
+	switch (op)
+	{
+	case IR_NOP:
+	case IR_STORE_REG:
+	case IR_READ8:
+	case IR_READ16:
+	case IR_READ32:
+	case IR_READ64:
+	case IR_WRITE8:
+	case IR_WRITE16:
+	case IR_WRITE32:
+	case IR_WRITE64:
+	case IR_INTERPRET:
+	case IR_EXIT_IF_INVALID:
+		return false;
+	default:
+		return true;
+	}
+}
+
+template<typename T>
+static uint64_t Compare(T x, T y)
+{
+	if (x < y) return 0x8;
+	else if (x > y) return 0x4;
+	else return 0x2;
+}
+
+uint64_t Evaluate(const IRInstr_t& instr, uint64_t a, uint64_t b, uint64_t c)
+{
+	switch (instr.op)
+	{
+	case IR_CONST: return instr.imm;
+	case IR_ADD: return a + b;
+	case IR_SUB: return a - b;
+	case IR_AND: return a & b;
+	case IR_OR: return a | b;
+	case IR_XOR: return a ^ b;
+	case IR_MUL: return a * b;
+	case IR_NOT: return ~a;
+	case IR_NEG: return ~a + 1;
+	case IR_ROTL32: return std::rotl<uint32_t>(a, instr.imm);
+	case IR_ZEXT32: return (uint32_t)a;
+	case IR_CMP_S32: return Compare<int32_t>(a, b);
+	case IR_CMP_U32: return Compare<uint32_t>(a, b);
+	case IR_CMP_S64: return Compare<int64_t>(a, b);
+	case IR_CMP_U64: return Compare<uint64_t>(a, b);
+	case IR_SELECT: return a ? b : c;
+	default:
+		printf("Can't evaluate IR op %d\n", instr.op);
+		exit(1);
+	}
+}
+
+static int NumArgs(IROp op)
+{
+	switch (op)
+	{
+	case IR_NOP:
+	case IR_CONST:
+	case IR_LOAD_REG:
+	case IR_INTERPRET:
+	case IR_EXIT_IF_INVALID:
+		return 0;
+	case IR_STORE_REG:
+	case IR_NOT:
+	case IR_NEG:
+	case IR_ROTL32:
+	case IR_ZEXT32:
+	case IR_READ8:
+	case IR_READ16:
+	case IR_READ32:
+	case IR_READ64:
+		return 1;
+	case IR_SELECT:
+		return 3;
+	default:
+		return 2;
+	}
+}
+
+/// @brief true if the upper word of the value is known to be zero
+static bool IsZeroExtended(const IRInstr_t& instr)
+{
+	switch (instr.op)
+	{
+	case IR_CONST: return instr.imm <= UINT32_MAX;
+	case IR_ROTL32:
+	case IR_ZEXT32:
+	case IR_CMP_S32:
+	case IR_CMP_U32:
+	case IR_CMP_S64:
+	case IR_CMP_U64:
+	case IR_READ8:
+	case IR_READ16:
+	case IR_READ32:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/// @brief Forward pass: loads of a register the block already knows the value of are replaced by that value,
+/// and ops whose arguments are all constant (or that are identities) are folded
+static void ForwardAndFold(IRBlock_t& ir)
+{
+	std::vector<IRInstr_t>& instrs = ir.instrs;
+	std::vector<uint32_t> alias(instrs.size());
+	uint32_t known[IR_REG_COUNT];
+	bool isKnown[IR_REG_COUNT] = {};
+
+	auto isConst = [&](uint32_t v) {return instrs[v].op == IR_CONST;};
+	auto constOf = [&](uint32_t v) {return instrs[v].imm;};
+
+	for (uint32_t i = 0; i < instrs.size(); i++)
+	{
+		IRInstr_t& in = instrs[i];
+		alias[i] = i;
+
+		int numArgs = NumArgs(in.op);
+		for (int arg = 0; arg < numArgs; arg++)
+			in.args[arg] = alias[in.args[arg]];
+
+		uint32_t a = in.args[0], b = in.args[1], c = in.args[2];
+		int replaceWith = -1;
+
+		switch (in.op)
+		{
+		case IR_LOAD_REG:
+			if (isKnown[in.imm])
+				replaceWith = known[in.imm];
+			else
+			{
+				known[in.imm] = i;
+				isKnown[in.imm] = true;
+			}
+			break;
+		case IR_STORE_REG:
+			known[in.imm] = a;
+			isKnown[in.imm] = true;
+			break;
+		case IR_INTERPRET:
+			for (int reg = 0; reg < IR_REG_COUNT; reg++)
+				isKnown[reg] = false;
+			break;
+		case IR_ADD:
+		case IR_SUB:
+		case IR_OR:
+		case IR_XOR:
+			if (isConst(b) && constOf(b) == 0)
+				replaceWith = a;
+			else if (in.op != IR_SUB && isConst(a) && constOf(a) == 0)
+				replaceWith = b;
+			break;
+		case IR_ZEXT32:
+			if (IsZeroExtended(instrs[a]))
+				replaceWith = a;
+			break;
+		case IR_SELECT:
+			if (isConst(a))
+				replaceWith = constOf(a) ? b : c;
+			break;
+		default:
+			break;
+		}
+
+		if (replaceWith >= 0)
+		{
+			alias[i] = replaceWith;
+			in.op = IR_NOP;
+			continue;
+		}
+
+		if (IsPure(in.op) && in.op != IR_CONST && in.op != IR_LOAD_REG)
+		{
+			bool allConst = true;
+			for (int arg = 0; arg < numArgs; arg++)
+				allConst &= isConst(in.args[arg]);
+			if (allConst)
+			{
+				in.imm = Evaluate(in, constOf(a), numArgs > 1 ? constOf(b) : 0, numArgs > 2 ? constOf(c) : 0);
+				in.op = IR_CONST;
+			}
+		}
+	}
+}
+
+/// @brief Backward pass: a store is dead if the register is stored again before anything can read it.
+/// Everything is live at the end of the block and around calls into the interpreter or early exits
+static void EliminateDeadStores(IRBlock_t& ir)
+{
+	bool live[IR_REG_COUNT];
+	for (int reg = 0; reg < IR_REG_COUNT; reg++)
+		live[reg] = true;
+
+	for (size_t i = ir.instrs.size(); i-- > 0;)
+	{
+		IRInstr_t& in = ir.instrs[i];
+		switch (in.op)
+		{
+		case IR_STORE_REG:
+			if (!live[in.imm])
+				in.op = IR_NOP;
+			live[in.imm] = false;
+			break;
+		case IR_LOAD_REG:
+			live[in.imm] = true;
+			break;
+		case IR_INTERPRET:
+		case IR_EXIT_IF_INVALID:
+			for (int reg = 0; reg < IR_REG_COUNT; reg++)
+				live[reg] = true;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/// @brief Backward pass: drops pure values nothing uses
+static void EliminateDeadCode(IRBlock_t& ir)
+{
+	std::vector<bool> used(ir.instrs.size());
+
+	for (size_t i = ir.instrs.size(); i-- > 0;)
+	{
+		IRInstr_t& in = ir.instrs[i];
+		if (IsPure(in.op) && !used[i])
+		{
+			in.op = IR_NOP;
+			continue;
+		}
+
+		int numArgs = NumArgs(in.op);
+		for (int arg = 0; arg < numArgs; arg++)
+			used[in.args[arg]] = true;
+	}
+}
+
+void Optimize(IRBlock_t& ir)
+{
+	ForwardAndFold(ir);
+	EliminateDeadStores(ir);
+	EliminateDeadCode(ir);
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <cstddef>
+
+/// @brief Operations of the block IR. Every instruction defines one value (its index in the block),
+/// values are only ever assigned once and arguments always refer to earlier instructions
+enum IROp : uint8_t
+{
+	IR_NOP,         // Removed by a pass
+	IR_CONST,       // imm
+	IR_LOAD_REG,    // imm = IRReg
+	IR_STORE_REG,   // imm = IRReg, a = value
+	IR_ADD,
+	IR_SUB,
+	IR_AND,
+	IR_OR,
+	IR_XOR,
+	IR_MUL,         // Low 64 bits of the product
+	IR_NOT,
+	IR_NEG,
+	IR_ROTL32,      // Low word of a rotated left by imm, zero-extended
+	IR_ZEXT32,      // Truncates a to 32 bits
+	IR_CMP_S32,     // CR field value (8, 4 or 2) from comparing a with b, same as UpdateCRn
+	IR_CMP_U32,
+	IR_CMP_S64,
+	IR_CMP_U64,
+	IR_SELECT,      // a != 0 ? b : c
+	IR_READ8,       // a = guest address. Result is zero-extended
+	IR_READ16,
+	IR_READ32,
+	IR_READ64,
+	IR_WRITE8,      // a = guest address, b = value
+	IR_WRITE16,
+	IR_WRITE32,
+	IR_WRITE64,
+	IR_INTERPRET,   // imm = const DecodedInstr_t*. Runs the interpreter handler, may touch any register
+	IR_EXIT_IF_INVALID, // imm = pc. Leaves the block there if the block's code has been written to
+};
+
+/// @brief The parts of cpuState_t that IR code reads and writes directly
+enum IRReg
+{
+	IR_REG_GPR0 = 0,
+	IR_REG_LR = 32,
+	IR_REG_CTR,
+	IR_REG_CR0,
+	IR_REG_PC = IR_REG_CR0 + 8,
+	IR_REG_COUNT
+};
+
+typedef struct
+{
+	IROp op;
+	uint32_t args[3];
+	uint64_t imm;
+} IRInstr_t;
+
+typedef struct
+{
+	std::vector<IRInstr_t> instrs;
+} IRBlock_t;
+
+namespace IR
+{
+
+/// @brief Forwards register loads, folds constants, then drops dead stores (mostly CR fields nobody reads) and dead values
+void Optimize(IRBlock_t& ir);
+
+/// @brief The result of a side-effect free op, shared by the interpreter and the constant folder
+uint64_t Evaluate(const IRInstr_t& instr, uint64_t a, uint64_t b, uint64_t c);
+/// @brief true for the ops that can be removed when their value is unused
+bool IsPure(IROp op);
+
+/// @brief Where an IRReg lives in cpuState_t. CR fields are 32 bits wide, everything else is 64
+size_t RegOffset(int reg);
+bool IsReg32(int reg);
+
+}
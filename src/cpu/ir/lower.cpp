@@ -0,0 +1,392 @@
+#include <cpu/ir/frontend.h>
+
+namespace IR
+{
+
+/// @brief Turns guest instructions into IR. Each case mirrors the handler of the same name in ops.cpp,
+/// anything not listed here becomes an IR_INTERPRET call to that handler
+class Lowering
+{
+public:
+	Lowering(const Block_t& block, IRBlock_t& ir)
+	: block(block), ir(ir) {}
+
+	void Run()
+	{
+		pc = block.start;
+		for (size_t i = 0; i < block.instrs.size(); i++, pc += 4)
+		{
+			const DecodedInstr_t& instr = block.instrs[i];
+			last = (i == block.instrs.size() - 1);
+
+			if (!LowerInstr(instr))
+				LowerFallback(instr);
+		}
+
+		// Native non-branch code doesn't keep PC up to date, fallbacks and branches do
+		if (!pcWritten)
+			Store(IR_REG_PC, Const(block.end));
+	}
+private:
+	uint32_t Emit(IROp op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint64_t imm = 0)
+	{
+		ir.instrs.push_back({op, {a, b, c}, imm});
+		return ir.instrs.size() - 1;
+	}
+
+	uint32_t Const(uint64_t value) {return Emit(IR_CONST, 0, 0, 0, value);}
+	uint32_t Load(int reg) {return Emit(IR_LOAD_REG, 0, 0, 0, reg);}
+	void Store(int reg, uint32_t value) {Emit(IR_STORE_REG, value, 0, 0, reg);}
+
+	void LowerFallback(const DecodedInstr_t& instr)
+	{
+		Store(IR_REG_PC, Const(pc + 4));
+		Emit(IR_INTERPRET, 0, 0, 0, (uint64_t)&instr);
+		pcWritten = true;
+
+		// The handler may have written to this block's code
+		if (!last)
+		{
+			Emit(IR_EXIT_IF_INVALID, 0, 0, 0, pc + 4);
+			pcWritten = false;
+		}
+	}
+
+	void UpdateCR0(uint32_t value)
+	{
+		Store(IR_REG_CR0, Emit(IR_CMP_S32, value, Const(0)));
+	}
+
+	/// @brief D-form effective address. `ra == 0` means 0 unless `useR0` is set
+	uint32_t EA(uint8_t ra, int32_t disp, bool useR0 = false)
+	{
+		if (ra == 0 && !useR0)
+			return Const((uint32_t)disp);
+		return Emit(IR_ZEXT32, Emit(IR_ADD, Load(ra), Const((int64_t)disp)));
+	}
+
+	uint32_t EAIndexed(uint8_t ra, uint8_t rb)
+	{
+		if (ra == 0)
+			return Emit(IR_ZEXT32, Load(rb));
+		return Emit(IR_ZEXT32, Emit(IR_ADD, Load(ra), Load(rb)));
+	}
+
+	void LoadMem(IROp op, uint32_t ea, uint8_t rt, int updateRa = -1)
+	{
+		Store(rt, Emit(op, ea));
+		if (updateRa >= 0)
+			Store(updateRa, ea);
+	}
+
+	void StoreMem(IROp op, uint32_t ea, uint8_t rs, int updateRa = -1)
+	{
+		Emit(op, ea, Load(rs));
+		if (updateRa >= 0)
+			Store(updateRa, ea);
+		Emit(IR_EXIT_IF_INVALID, 0, 0, 0, pc + 4);
+	}
+
+	/// @brief The ctr half of CondPassed. Returns the decremented ctr, or -1 if BO doesn't touch it
+	int DecrementCTR(uint8_t bo)
+	{
+		if (bo & 0x04)
+			return -1;
+		uint32_t ctr = Emit(IR_SUB, Load(IR_REG_CTR), Const(1));
+		Store(IR_REG_CTR, ctr);
+		return ctr;
+	}
+
+	/// @brief Stores `taken` or the fall-through address to PC, depending on CondPassed
+	void Branch(uint8_t bo, uint8_t bi, int ctr, uint32_t taken)
+	{
+		uint32_t fallthrough = Const(pc + 4);
+		uint32_t target = taken;
+
+		if (!(bo & 0x10))
+		{
+			uint32_t bit = Emit(IR_AND, Load(IR_REG_CR0 + (bi >> 2)), Const(1 << (3 - (bi % 4))));
+			target = (bo & 0x08) ? Emit(IR_SELECT, bit, target, fallthrough) : Emit(IR_SELECT, bit, fallthrough, target);
+		}
+
+		if (ctr >= 0)
+			target = (bo & 0x02) ? Emit(IR_SELECT, ctr, fallthrough, target) : Emit(IR_SELECT, ctr, target, fallthrough);
+
+		Store(IR_REG_PC, target);
+		pcWritten = true;
+	}
+
+	void Logical(IROp op, uint8_t rs, uint8_t ra, uint8_t rb, bool rc, bool complementB = false, bool complementResult = false)
+	{
+		uint32_t b = Load(rb);
+		if (complementB)
+			b = Emit(IR_NOT, b);
+		uint32_t result = Emit(op, Load(rs), b);
+		if (complementResult)
+			result = Emit(IR_NOT, result);
+		Store(ra, result);
+		if (rc)
+			UpdateCR0(result);
+	}
+
+	bool LowerInstr(const DecodedInstr_t& instr)
+	{
+		uint32_t op = instr.instr;
+		uint8_t rd = instr.rd;
+		uint8_t ra = instr.ra;
+		uint8_t rb = instr.rb;
+		int32_t simm = instr.imm;
+		uint32_t uimm = op & 0xFFFF;
+		bool rc = op & 1;
+
+		switch (op >> 26)
+		{
+		case 7: // mulli
+			Store(rd, Emit(IR_MUL, Load(ra), Const((int64_t)simm)));
+			return true;
+		case 10: // cmpli
+			Store(IR_REG_CR0 + ((op >> 23) & 7), Emit(((op >> 21) & 1) ? IR_CMP_U64 : IR_CMP_U32, Load(ra), Const(uimm)));
+			return true;
+		case 11: // cmpi
+			Store(IR_REG_CR0 + ((op >> 23) & 7), Emit(((op >> 21) & 1) ? IR_CMP_S64 : IR_CMP_S32, Load(ra), Const((int64_t)simm)));
+			return true;
+		case 14: // addi
+		case 15: // addis
+		{
+			int64_t imm = (op >> 26) == 15 ? (int32_t)(uimm << 16) : simm;
+			Store(rd, ra == 0 ? Const(imm) : Emit(IR_ADD, Load(ra), Const(imm)));
+			return true;
+		}
+		case 16: // bc
+		{
+			// The interpreter ignores LK here. Leave bcl to it so the two can't disagree
+			if (rc)
+				return false;
+			int16_t bd = (int16_t)(op & 0xFFFC);
+			uint32_t target = ((op >> 1) & 1) ? (uint16_t)bd : pc + bd;
+			int ctr = DecrementCTR(rd);
+			Branch(rd, ra, ctr, Const(target));
+			return true;
+		}
+		case 18: // b, bl
+		{
+			int32_t li = op & 0x3FFFFFC;
+			li = (li ^ 0x2000000) - 0x2000000;
+			if (rc)
+				Store(IR_REG_LR, Const((uint64_t)pc + 4));
+			Store(IR_REG_PC, Const(((op >> 1) & 1) ? (uint64_t)(int64_t)li : (uint64_t)pc + li));
+			pcWritten = true;
+			return true;
+		}
+		case 19:
+			switch ((op >> 1) & 0x3FF)
+			{
+			case 16: // bclr
+			{
+				if (rc)
+					return false;
+				int ctr = DecrementCTR(rd);
+				Branch(rd, ra, ctr, Load(IR_REG_LR));
+				return true;
+			}
+			case 528: // bcctr
+			{
+				if (rc)
+					Store(IR_REG_LR, Const((uint64_t)pc + 4));
+				int ctr = DecrementCTR(rd);
+				Branch(rd, ra, ctr, Load(IR_REG_CTR));
+				return true;
+			}
+			}
+			return false;
+		case 21: // rlwinm
+		{
+			uint8_t mb = (op >> 6) & 0x1F;
+			uint8_t me = (op >> 1) & 0x1F;
+			uint32_t maskmb = ~0u >> mb;
+			uint32_t maskme = ~0u << (31 - me);
+			uint32_t mask = (mb <= me) ? maskmb & maskme : maskmb | maskme;
+
+			uint32_t result = Emit(IR_AND, Emit(IR_ROTL32, Load(rd), 0, 0, rb), Const(mask));
+			Store(ra, result);
+			if (rc)
+				UpdateCR0(result);
+			return true;
+		}
+		case 24: // ori
+		case 25: // oris
+		case 28: // andi.
+		case 29: // andis.
+		{
+			bool shifted = (op >> 26) & 1;
+			IROp alu = (op >> 26) >= 28 ? IR_AND : IR_OR;
+			uint32_t result = Emit(alu, Load(rd), Const(shifted ? uimm << 16 : uimm));
+			Store(ra, result);
+			if (alu == IR_AND)
+				UpdateCR0(result);
+			return true;
+		}
+		case 31:
+			return LowerGroup31(instr);
+		case 32: // lwz
+			LoadMem(IR_READ32, EA(ra, simm), rd);
+			return true;
+		case 33: // lwzu
+			LoadMem(IR_READ32, EA(ra, simm), rd, ra);
+			return true;
+		case 34: // lbz
+			LoadMem(IR_READ8, EA(ra, simm), rd);
+			return true;
+		case 35: // lbzu
+			LoadMem(IR_READ8, EA(ra, simm, true), rd, ra);
+			return true;
+		case 36: // stw
+			StoreMem(IR_WRITE32, EA(ra, simm), rd);
+			return true;
+		case 37: // stwu
+		{
+			if (ra == 0)
+				return false;
+			// Unlike the other update forms, rA is written before rS is read
+			uint32_t ea = EA(ra, simm);
+			Store(ra, ea);
+			StoreMem(IR_WRITE32, ea, rd);
+			return true;
+		}
+		case 38: // stb
+			StoreMem(IR_WRITE8, EA(ra, (int16_t)(op & 0xFFFC)), rd);
+			return true;
+		case 39: // stbu
+			StoreMem(IR_WRITE8, EA(ra, (int16_t)(op & 0xFFFC), true), rd, ra);
+			return true;
+		case 40: // lhz
+			LoadMem(IR_READ16, EA(ra, simm), rd);
+			return true;
+		case 44: // sth
+			StoreMem(IR_WRITE16, EA(ra, simm), rd);
+			return true;
+		case 58: // ld, ldu
+			LoadMem(IR_READ64, EA(ra, (int16_t)(op & 0xFFFC)), rd, rc ? ra : -1);
+			return true;
+		case 62: // std, stdu
+			StoreMem(IR_WRITE64, EA(ra, (int16_t)(op & 0xFFFC)), rd, rc ? ra : -1);
+			return true;
+		}
+
+		return false;
+	}
+
+	bool LowerGroup31(const DecodedInstr_t& instr)
+	{
+		uint32_t op = instr.instr;
+		uint8_t rd = instr.rd;
+		uint8_t ra = instr.ra;
+		uint8_t rb = instr.rb;
+		bool rc = op & 1;
+
+		switch ((op >> 1) & 0x3FF)
+		{
+		case 0: // cmp
+			Store(IR_REG_CR0 + ((op >> 23) & 7), Emit(((op >> 21) & 1) ? IR_CMP_S64 : IR_CMP_S32, Load(ra), Load(rb)));
+			return true;
+		case 32: // cmpl
+			Store(IR_REG_CR0 + ((op >> 23) & 7), Emit(((op >> 21) & 1) ? IR_CMP_U64 : IR_CMP_U32, Load(ra), Load(rb)));
+			return true;
+		case 23: // lwzx
+			LoadMem(IR_READ32, EAIndexed(ra, rb), rd);
+			return true;
+		case 87: // lbzx
+			LoadMem(IR_READ8, EAIndexed(ra, rb), rd);
+			return true;
+		case 149: // stdx
+			StoreMem(IR_WRITE64, EAIndexed(ra, rb), rd);
+			return true;
+		case 151: // stwx
+			StoreMem(IR_WRITE32, EAIndexed(ra, rb), rd);
+			return true;
+		case 28: // and
+			Logical(IR_AND, rd, ra, rb, rc);
+			return true;
+		case 60: // andc
+			Logical(IR_AND, rd, ra, rb, rc, true);
+			return true;
+		case 124: // nor
+			Logical(IR_OR, rd, ra, rb, rc, false, true);
+			return true;
+		case 316: // xor
+			Logical(IR_XOR, rd, ra, rb, rc);
+			return true;
+		case 444: // or
+			Logical(IR_OR, rd, ra, rb, rc);
+			return true;
+		case 40: // subf
+		{
+			uint32_t result = Emit(IR_SUB, Load(rb), Load(ra));
+			Store(rd, result);
+			if (rc)
+				UpdateCR0(result);
+			return true;
+		}
+		case 266: // add
+		{
+			uint32_t result = Emit(IR_ADD, Load(ra), Load(rb));
+			Store(rd, result);
+			if (rc)
+				UpdateCR0(result);
+			return true;
+		}
+		case 104: // neg
+		{
+			uint32_t result = Emit(IR_NEG, Load(ra));
+			Store(rd, result);
+			if (rc)
+				UpdateCR0(result);
+			return true;
+		}
+		case 339: // mfspr
+			if (((op >> 11) & 0x3FF) != 0x100)
+				return false;
+			Store(rd, Load(IR_REG_LR));
+			return true;
+		case 467: // mtspr
+		{
+			uint16_t spr = (op >> 11) & 0x3FF;
+			if (spr != 0x100 && spr != 0x120)
+				return false;
+			Store(spr == 0x100 ? IR_REG_LR : IR_REG_CTR, Load(rd));
+			return true;
+		}
+		case 246: // dcbt
+		case 278:
+		case 598: // sync
+			return true;
+		}
+
+		return false;
+	}
+
+	const Block_t& block;
+	IRBlock_t& ir;
+	uint32_t pc;
+	bool last = false;
+	bool pcWritten = false;
+};
+
+void Lower(const Block_t& block, IRBlock_t& ir)
+{
+	Lowering(block, ir).Run();
+}
+
+const IRBlock_t& GetBlock(Block_t& block)
+{
+	std::call_once(block.irBuilt, [&block]()
+	{
+		block.ir = std::make_unique<IRBlock_t>();
+		Lower(block, *block.ir);
+		Optimize(*block.ir);
+	});
+
+	return *block.ir;
+}
+
+}
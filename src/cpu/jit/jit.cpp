@@ -0,0 +1,417 @@
+#include <cpu/jit/jit.h>
+#include <cpu/jit/x64emitter.h>
+#include <cpu/ir/frontend.h>
+#include <cpu/hwthread.h>
+#include <memory/memory.h>
+#include <memory/fastmem.h>
+#include <cpu/reservation.h>
+#include <util.h>
+#include <sys/mman.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+#define CODE_CACHE_SIZE (64*1024*1024)
+
+// Register usage inside a block:
+//	rbx	cpuState_t* (fixed for the whole block)
+//	r12	CPUThread*, for falling back to the interpreter
+//	r13	Fastmem window base, if fastmem is on
+//	rsp	Every IR value gets an 8-byte stack slot, there is no register allocation yet
+//	everything else is scratch
+#define STATE RBX
+#define THREAD R12
+#define MEMBASE R13
+
+namespace JIT
+{
+
+static bool enabled = false;
+static uint8_t* codeCache;
+static size_t codeUsed;
+static bool flushPending = false;
+// Guards the code cache. Compiled blocks are only ever run outside of it
+static std::mutex lock;
+// How many JIT blocks are on this thread's stack. The cache can't be flushed under a running block,
+// which happens when `sc` re-enters CPUThread::Run (e.g. XexLoadImage running an entry point).
+// Only its own thread writes it, other threads read it while that thread is paused
+static thread_local std::atomic<int> depth = 0;
+static thread_local bool depthRegistered = false;
+static std::vector<std::atomic<int>*> depths; // Of every thread that has run host code, under `lock`
+
+/// @brief Called from host code for every instruction the IR leaves to the interpreter
+static void Interpret(CPUThread* thread, const DecodedInstr_t* instr)
+{
+	(thread->*instr->handler)(*instr);
+}
+
+static uint8_t Read8(uint32_t addr) {return Memory::Read8(addr);}
+static uint16_t Read16(uint32_t addr) {return Memory::Read16(addr);}
+static uint32_t Read32(uint32_t addr) {return Memory::Read32(addr);}
+
+/// @brief Emits x86-64 for the optimized IR of a block
+class Translator
+{
+public:
+	Translator(X64Emitter& e, Block_t& block, const IRBlock_t& ir)
+	: e(e), block(block), ir(ir) {}
+
+	void Translate()
+	{
+		// The return address and three pushes keep rsp 16-byte aligned
+		int32_t frame = (ir.instrs.size() * 8 + 15) & ~15;
+
+		e.Push(RBX);
+		e.Push(THREAD);
+		e.Push(MEMBASE);
+		e.Alu64Imm(ALU_SUB, RSP, frame);
+		e.Mov64(STATE, RDI);
+		e.Mov64(THREAD, RSI);
+		if (Fastmem::IsEnabled())
+			e.MovImm64(MEMBASE, (uint64_t)Fastmem::GetBase());
+
+		for (size_t i = 0; i < ir.instrs.size(); i++)
+			EmitInstr(i, ir.instrs[i]);
+
+		for (uint8_t* jump : exits)
+			e.Bind(jump);
+		e.Alu64Imm(ALU_ADD, RSP, frame);
+		e.Pop(MEMBASE);
+		e.Pop(THREAD);
+		e.Pop(RBX);
+		e.Ret();
+	}
+private:
+	int32_t Slot(uint32_t value) {return value * 8;}
+
+	/// @brief Constants are never given a slot, they're materialized at every use
+	void LoadValue(X64Reg reg, uint32_t value)
+	{
+		const IRInstr_t& def = ir.instrs[value];
+		if (def.op == IR_CONST)
+			e.MovImm64(reg, def.imm);
+		else
+			e.Load64(reg, RSP, Slot(value));
+	}
+
+	void SetValue(uint32_t value, X64Reg reg)
+	{
+		e.Store64(RSP, Slot(value), reg);
+	}
+
+	void EmitCompare(uint32_t i, const IRInstr_t& in, bool is64, X64Cond lt, X64Cond gt)
+	{
+		LoadValue(RAX, in.args[0]);
+		LoadValue(RCX, in.args[1]);
+		if (is64)
+			e.Alu64(ALU_CMP, RAX, RCX);
+		else
+			e.Alu32(ALU_CMP, RAX, RCX);
+		e.MovImm32(RCX, 0x2);
+		e.MovImm32(RDX, 0x8);
+		e.Cmov32(lt, RCX, RDX);
+		e.MovImm32(RDX, 0x4);
+		e.Cmov32(gt, RCX, RDX);
+		SetValue(i, RCX);
+	}
+
+	void EmitBinary(uint32_t i, const IRInstr_t& in, X64Alu op)
+	{
+		LoadValue(RAX, in.args[0]);
+		LoadValue(RCX, in.args[1]);
+		e.Alu64(op, RAX, RCX);
+		SetValue(i, RAX);
+	}
+
+	/// @brief Guest memory is big-endian, swaps the low `size` bytes of `reg` and clears the rest
+	void ByteSwap(X64Reg reg, int size)
+	{
+		switch (size)
+		{
+		case 2:
+			e.Bswap32(reg);
+			e.Shr32(reg, 16);
+			break;
+		case 4: e.Bswap32(reg); break;
+		case 8: e.Bswap64(reg); break;
+		}
+	}
+
+	/// @brief Only the low `size` bytes of a return value are defined, the rest are cleared here
+	void EmitRead(uint32_t i, const IRInstr_t& in, const void* func, int size)
+	{
+		LoadValue(RDI, in.args[0]);
+		if (Fastmem::IsEnabled())
+		{
+			// Faults (MMIO-like addresses, unmapped memory) are replayed by the handler in memory/fastmem.cpp
+			e.LoadIndexed(size, RAX, MEMBASE, RDI);
+			ByteSwap(RAX, size);
+			SetValue(i, RAX);
+			return;
+		}
+
+		e.Call(func);
+		switch (size)
+		{
+		case 1: e.Movzx8(RAX, RAX); break;
+		case 2: e.Movzx16(RAX, RAX); break;
+		case 4: e.Mov32(RAX, RAX); break;
+		}
+		SetValue(i, RAX);
+	}
+
+	void EmitWrite(const IRInstr_t& in, const void* func, int size)
+	{
+		LoadValue(RDI, in.args[0]);
+		if (Fastmem::IsEnabled())
+		{
+			EmitReservationCheck(in);
+
+			// Code pages are read-only in the window, so stores to them fault into Memory::Write* and invalidate the block cache
+			LoadValue(RSI, in.args[1]);
+			ByteSwap(RSI, size);
+			e.StoreIndexed(size, MEMBASE, RDI, RSI);
+			return;
+		}
+
+		LoadValue(RSI, in.args[1]);
+		e.Call(func);
+	}
+
+	/// @brief Inline Reservation::OnStore for fastmem stores, which don't go through Memory::Write*.
+	/// Expects the address in RDI and leaves it there
+	void EmitReservationCheck(const IRInstr_t& in)
+	{
+		// Byte offset of the slot, straight from the address: (addr >> line shift) * 4
+		e.Mov32(RAX, RDI);
+		e.Shr32(RAX, RESERVATION_LINE_SHIFT - 2);
+		e.Alu32Imm(ALU_AND, RAX, (RESERVATION_SLOTS - 1) << 2);
+		e.MovImm64(RCX, (uint64_t)&Reservation::slots[0]);
+		e.Alu64(ALU_ADD, RAX, RCX);
+		e.TestMem8Imm(RAX, 0, 1);
+		uint8_t* notReserved = e.Jcc(CC_E);
+		e.Call((void*)&Reservation::Invalidate);
+		LoadValue(RDI, in.args[0]);
+		e.Bind(notReserved);
+	}
+
+	void EmitInstr(uint32_t i, const IRInstr_t& in)
+	{
+		switch (in.op)
+		{
+		case IR_NOP:
+		case IR_CONST:
+			break;
+		case IR_LOAD_REG:
+			if (IR::IsReg32(in.imm))
+				e.Load32(RAX, STATE, IR::RegOffset(in.imm));
+			else
+				e.Load64(RAX, STATE, IR::RegOffset(in.imm));
+			SetValue(i, RAX);
+			break;
+		case IR_STORE_REG:
+			LoadValue(RAX, in.args[0]);
+			if (IR::IsReg32(in.imm))
+				e.Store32(STATE, IR::RegOffset(in.imm), RAX);
+			else
+				e.Store64(STATE, IR::RegOffset(in.imm), RAX);
+			break;
+		case IR_ADD: EmitBinary(i, in, ALU_ADD); break;
+		case IR_SUB: EmitBinary(i, in, ALU_SUB); break;
+		case IR_AND: EmitBinary(i, in, ALU_AND); break;
+		case IR_OR: EmitBinary(i, in, ALU_OR); break;
+		case IR_XOR: EmitBinary(i, in, ALU_XOR); break;
+		case IR_MUL:
+			LoadValue(RAX, in.args[0]);
+			LoadValue(RCX, in.args[1]);
+			e.Imul64(RAX, RCX);
+			SetValue(i, RAX);
+			break;
+		case IR_NOT:
+			LoadValue(RAX, in.args[0]);
+			e.Not64(RAX);
+			SetValue(i, RAX);
+			break;
+		case IR_NEG:
+			LoadValue(RAX, in.args[0]);
+			e.Neg64(RAX);
+			SetValue(i, RAX);
+			break;
+		case IR_ROTL32:
+			LoadValue(RAX, in.args[0]);
+			if (in.imm & 31)
+				e.Rol32(RAX, in.imm & 31);
+			else
+				e.Mov32(RAX, RAX);
+			SetValue(i, RAX);
+			break;
+		case IR_ZEXT32:
+			LoadValue(RAX, in.args[0]);
+			e.Mov32(RAX, RAX);
+			SetValue(i, RAX);
+			break;
+		case IR_CMP_S32: EmitCompare(i, in, false, CC_L, CC_G); break;
+		case IR_CMP_U32: EmitCompare(i, in, false, CC_B, CC_A); break;
+		case IR_CMP_S64: EmitCompare(i, in, true, CC_L, CC_G); break;
+		case IR_CMP_U64: EmitCompare(i, in, true, CC_B, CC_A); break;
+		case IR_SELECT:
+			LoadValue(RDX, in.args[0]);
+			LoadValue(RAX, in.args[1]);
+			LoadValue(RCX, in.args[2]);
+			e.Test64(RDX, RDX);
+			e.Cmov64(CC_E, RAX, RCX);
+			SetValue(i, RAX);
+			break;
+		case IR_READ8: EmitRead(i, in, (void*)&Read8, 1); break;
+		case IR_READ16: EmitRead(i, in, (void*)&Read16, 2); break;
+		case IR_READ32: EmitRead(i, in, (void*)&Read32, 4); break;
+		case IR_READ64: EmitRead(i, in, (void*)&Memory::Read64, 8); break;
+		case IR_WRITE8: EmitWrite(in, (void*)&Memory::Write8, 1); break;
+		case IR_WRITE16: EmitWrite(in, (void*)&Memory::Write16, 2); break;
+		case IR_WRITE32: EmitWrite(in, (void*)&Memory::Write32, 4); break;
+		case IR_WRITE64: EmitWrite(in, (void*)&Memory::Write64, 8); break;
+		case IR_INTERPRET:
+			e.Mov64(RDI, THREAD);
+			e.MovImm64(RSI, in.imm);
+			e.Call((void*)&Interpret);
+			break;
+		case IR_EXIT_IF_INVALID:
+		{
+			e.MovImm64(RAX, (uint64_t)&block.valid);
+			e.CmpMem8Imm(RAX, 0, 0);
+			uint8_t* stillValid = e.Jcc(CC_NE);
+			e.MovImm64(RAX, in.imm);
+			e.Store64(STATE, IR::RegOffset(IR_REG_PC), RAX);
+			exits.push_back(e.Jmp());
+			e.Bind(stillValid);
+			break;
+		}
+		}
+	}
+
+	X64Emitter& e;
+	Block_t& block;
+	const IRBlock_t& ir;
+	std::vector<uint8_t*> exits;
+};
+
+void Initialize()
+{
+	codeCache = (uint8_t*)mmap(nullptr, CODE_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (codeCache == MAP_FAILED)
+	{
+		printf("Failed to allocate JIT code cache\n");
+		exit(1);
+	}
+
+	codeUsed = 0;
+	enabled = true;
+}
+
+bool IsEnabled()
+{
+	return enabled;
+}
+
+static void Flush()
+{
+	BlockCache::DropHostCode();
+	codeUsed = 0;
+	flushPending = false;
+}
+
+/// @brief Flushes the code cache if no thread has host code on its stack. Called without `lock` held,
+/// since the other hardware threads may be waiting on it and couldn't park
+static void TryFlush()
+{
+	HardwareThreads::PauseAll();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		bool busy = false;
+		for (std::atomic<int>* d : depths)
+			busy |= d->load(std::memory_order_relaxed) > 0;
+
+		if (flushPending && !busy)
+			Flush();
+	}
+	HardwareThreads::ResumeAll();
+}
+
+/// @brief Translates `block` into the code cache. Called with `lock` held
+/// @return nullptr if the cache is full, in which case `flushPending` is set
+static HostCode Compile(Block_t& block)
+{
+	const IRBlock_t& ir = IR::GetBlock(block);
+
+	X64Emitter e(codeCache + codeUsed, CODE_CACHE_SIZE - codeUsed);
+	Translator(e, block, ir).Translate();
+
+	if (e.Overflowed())
+	{
+		if (codeUsed == 0)
+		{
+			printf("Block at 0x%08x doesn't fit in the JIT code cache\n", block.start);
+			exit(1);
+		}
+
+		flushPending = true;
+		return nullptr;
+	}
+
+	codeUsed += e.GetSize();
+	// Keep entry points 16-byte aligned
+	codeUsed = (codeUsed + 15) & ~15;
+	return (HostCode)e.GetStart();
+}
+
+static HostCode GetHostCode(Block_t& block)
+{
+	bool full;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (!depthRegistered)
+		{
+			depths.push_back(&depth);
+			depthRegistered = true;
+		}
+
+		// Another hardware thread may have got here first
+		HostCode code = block.hostCode.load(std::memory_order_acquire);
+		if (!code && !flushPending)
+		{
+			code = Compile(block);
+			block.hostCode.store(code, std::memory_order_release);
+		}
+		if (code)
+			return code;
+
+		full = flushPending;
+	}
+
+	// Flushing frees up the cache for the next blocks, this one is interpreted
+	if (full && depth.load(std::memory_order_relaxed) == 0)
+		TryFlush();
+	return nullptr;
+}
+
+bool Run(Block_t& block, cpuState_t& state, CPUThread* thread)
+{
+	HostCode code = block.hostCode.load(std::memory_order_acquire);
+	if (!code)
+	{
+		code = GetHostCode(block);
+		if (!code)
+			return false;
+	}
+
+	depth.store(depth.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	code(&state, thread);
+	depth.store(depth.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+	return true;
+}
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cpu/blockcache.h>
+
+/// @brief Dynamic recompiler. Translates the optimized IR of guest blocks (see cpu/ir/ir.h) into x86-64 code.
+/// The interpreter stays the reference implementation: anything the IR doesn't model
+/// is compiled as a call to the matching handler in ops.cpp, so the two always agree
+namespace JIT
+{
+
+/// @brief Reserves the code cache and turns the JIT on. Called from main for `--jit`
+void Initialize();
+bool IsEnabled();
+
+/// @brief Runs `block` as host code, compiling it first if needed
+/// @return false if the block couldn't be compiled and has to be interpreted instead
+bool Run(Block_t& block, cpuState_t& state, CPUThread* thread);
+
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/// @brief Just enough of an x86-64 assembler for the JIT. Memory operands are `[base + disp32]`,
+/// or `[base + index]` for the fastmem accesses
+enum X64Reg
+{
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+enum X64Cond
+{
+	CC_O, CC_NO, CC_B, CC_AE, CC_E, CC_NE, CC_BE, CC_A,
+	CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_GE, CC_LE, CC_G
+};
+
+/// @brief The `/digit` and `op r/m, r` encodings of the classic ALU group
+enum X64Alu
+{
+	ALU_ADD = 0,
+	ALU_OR = 1,
+	ALU_AND = 4,
+	ALU_SUB = 5,
+	ALU_XOR = 6,
+	ALU_CMP = 7,
+};
+
+class X64Emitter
+{
+public:
+	X64Emitter(uint8_t* buffer, size_t size)
+	: start(buffer), ptr(buffer), end(buffer + size) {}
+
+	uint8_t* GetStart() const {return start;}
+	uint8_t* GetPtr() const {return ptr;}
+	size_t GetSize() const {return ptr - start;}
+	/// @brief Set once the buffer has run out. Everything emitted after that is dropped
+	bool Overflowed() const {return overflow;}
+
+	void Push(X64Reg r) {Rex(false, 0, r); Byte(0x50 + (r & 7));}
+	void Pop(X64Reg r) {Rex(false, 0, r); Byte(0x58 + (r & 7));}
+	void Ret() {Byte(0xC3);}
+
+	void MovImm64(X64Reg r, uint64_t imm) {Rex(true, 0, r); Byte(0xB8 + (r & 7)); Qword(imm);}
+	/// @brief Zero-extends into the full 64-bit register
+	void MovImm32(X64Reg r, uint32_t imm) {Rex(false, 0, r); Byte(0xB8 + (r & 7)); Dword(imm);}
+	void Mov64(X64Reg dst, X64Reg src) {RegReg(true, 0x89, src, dst);}
+	/// @brief Zero-extends into the full 64-bit register
+	void Mov32(X64Reg dst, X64Reg src) {RegReg(false, 0x89, src, dst);}
+	void Movsxd(X64Reg dst, X64Reg src) {RegReg(true, 0x63, dst, src);}
+	void Movzx16(X64Reg dst, X64Reg src) {RegReg2(false, 0xB7, dst, src);}
+	void Movzx8(X64Reg dst, X64Reg src) {Rex(false, dst, src, true); Byte(0x0F); Byte(0xB6); ModRM(3, dst, src);}
+
+	void Load64(X64Reg dst, X64Reg base, int32_t disp) {Mem(true, 0x8B, dst, base, disp);}
+	void Load32(X64Reg dst, X64Reg base, int32_t disp) {Mem(false, 0x8B, dst, base, disp);}
+	void Load8(X64Reg dst, X64Reg base, int32_t disp) {Rex(false, dst, base); Byte(0x0F); Byte(0xB6); MemOperand(dst, base, disp);}
+	void Store64(X64Reg base, int32_t disp, X64Reg src) {Mem(true, 0x89, src, base, disp);}
+	void Store32(X64Reg base, int32_t disp, X64Reg src) {Mem(false, 0x89, src, base, disp);}
+	void Store8(X64Reg base, int32_t disp, X64Reg src) {Rex(false, src, base, true); Byte(0x88); MemOperand(src, base, disp);}
+	void Store32Imm(X64Reg base, int32_t disp, uint32_t imm) {Mem(false, 0xC7, 0, base, disp); Dword(imm);}
+
+	/// @brief Zero-extending load of `size` bytes from `[base + index]`
+	void LoadIndexed(int size, X64Reg dst, X64Reg base, X64Reg index)
+	{
+		switch (size)
+		{
+		case 1: Rex(false, dst, base, false, index); Byte(0x0F); Byte(0xB6); break;
+		case 2: Rex(false, dst, base, false, index); Byte(0x0F); Byte(0xB7); break;
+		case 4: Rex(false, dst, base, false, index); Byte(0x8B); break;
+		case 8: Rex(true, dst, base, false, index); Byte(0x8B); break;
+		}
+		IndexedOperand(dst, base, index);
+	}
+	/// @brief Stores the low `size` bytes of `src` to `[base + index]`
+	void StoreIndexed(int size, X64Reg base, X64Reg index, X64Reg src)
+	{
+		switch (size)
+		{
+		case 1: Rex(false, src, base, true, index); Byte(0x88); break;
+		case 2: Byte(0x66); Rex(false, src, base, false, index); Byte(0x89); break;
+		case 4: Rex(false, src, base, false, index); Byte(0x89); break;
+		case 8: Rex(true, src, base, false, index); Byte(0x89); break;
+		}
+		IndexedOperand(src, base, index);
+	}
+
+	void Alu64(X64Alu op, X64Reg dst, X64Reg src) {RegReg(true, (op << 3) | 1, src, dst);}
+	void Alu32(X64Alu op, X64Reg dst, X64Reg src) {RegReg(false, (op << 3) | 1, src, dst);}
+	/// @brief `imm` is sign-extended to 64 bits by the CPU
+	void Alu64Imm(X64Alu op, X64Reg dst, int32_t imm) {RegReg(true, 0x81, (X64Reg)op, dst); Dword(imm);}
+	void Alu32Imm(X64Alu op, X64Reg dst, int32_t imm) {RegReg(false, 0x81, (X64Reg)op, dst); Dword(imm);}
+	void Not64(X64Reg r) {RegReg(true, 0xF7, (X64Reg)2, r);}
+	void Neg64(X64Reg r) {RegReg(true, 0xF7, (X64Reg)3, r);}
+	void Imul64(X64Reg dst, X64Reg src) {RegReg2(true, 0xAF, dst, src);}
+	void Imul64Imm(X64Reg dst, X64Reg src, int32_t imm) {RegReg(true, 0x69, dst, src); Dword(imm);}
+	void Rol32(X64Reg r, uint8_t imm) {RegReg(false, 0xC1, (X64Reg)0, r); Byte(imm);}
+	void Shr32(X64Reg r, uint8_t imm) {RegReg(false, 0xC1, (X64Reg)5, r); Byte(imm);}
+	void Rol64(X64Reg r, uint8_t imm) {RegReg(true, 0xC1, (X64Reg)0, r); Byte(imm);}
+	void Bswap32(X64Reg r) {Rex(false, 0, r); Byte(0x0F); Byte(0xC8 + (r & 7));}
+	void Bswap64(X64Reg r) {Rex(true, 0, r); Byte(0x0F); Byte(0xC8 + (r & 7));}
+	void Cmov32(X64Cond cc, X64Reg dst, X64Reg src) {RegReg2(false, 0x40 + cc, dst, src);}
+	void Cmov64(X64Cond cc, X64Reg dst, X64Reg src) {RegReg2(true, 0x40 + cc, dst, src);}
+	void Test64(X64Reg a, X64Reg b) {RegReg(true, 0x85, b, a);}
+
+	void DecMem64(X64Reg base, int32_t disp) {Mem(true, 0xFF, 1, base, disp);}
+	void TestMem32Imm(X64Reg base, int32_t disp, uint32_t imm) {Mem(false, 0xF7, 0, base, disp); Dword(imm);}
+	void CmpMem8Imm(X64Reg base, int32_t disp, uint8_t imm) {Mem(false, 0x80, 7, base, disp); Byte(imm);}
+	void TestMem8Imm(X64Reg base, int32_t disp, uint8_t imm) {Mem(false, 0xF6, 0, base, disp); Byte(imm);}
+
+	/// @brief Calls an absolute address through RAX
+	void Call(const void* func) {MovImm64(RAX, (uint64_t)func); Byte(0xFF); Byte(0xD0);}
+
+	/// @brief Emits a jump with an unresolved target, returns the location to hand to `Bind`
+	uint8_t* Jmp() {Byte(0xE9); Dword(0); return ptr;}
+	uint8_t* Jcc(X64Cond cc) {Byte(0x0F); Byte(0x80 + cc); Dword(0); return ptr;}
+	/// @brief Points a jump from `Jmp` or `Jcc` at the current position
+	void Bind(uint8_t* jump)
+	{
+		if (overflow)
+			return;
+		int32_t rel = (int32_t)(ptr - jump);
+		memcpy(jump - 4, &rel, 4);
+	}
+private:
+	void Byte(uint8_t b)
+	{
+		if (ptr >= end)
+		{
+			overflow = true;
+			return;
+		}
+		*ptr++ = b;
+	}
+	void Dword(uint32_t d) {for (int i = 0; i < 4; i++) Byte(d >> (i * 8));}
+	void Qword(uint64_t q) {for (int i = 0; i < 8; i++) Byte(q >> (i * 8));}
+
+	/// @param byteRegs Forces a REX prefix so registers 4-7 mean SPL..DIL and not AH..BH
+	void Rex(bool w, int reg, int rm, bool byteRegs = false, int index = 0)
+	{
+		uint8_t rex = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | (((index >> 3) & 1) << 1) | ((rm >> 3) & 1);
+		if (rex != 0x40 || (byteRegs && ((reg & 7) >= 4 || (rm & 7) >= 4)))
+			Byte(rex);
+	}
+	void ModRM(int mod, int reg, int rm) {Byte((mod << 6) | ((reg & 7) << 3) | (rm & 7));}
+	void MemOperand(int reg, X64Reg base, int32_t disp)
+	{
+		ModRM(2, reg, base);
+		if ((base & 7) == RSP)
+			Byte(0x24); // SIB with no index
+		Dword(disp);
+	}
+	void IndexedOperand(int reg, X64Reg base, X64Reg index)
+	{
+		// rbp/r13 as a base can't use mod 00, that encoding means "no base"
+		bool needDisp = (base & 7) == RBP;
+		ModRM(needDisp ? 1 : 0, reg, RSP);
+		Byte(((index & 7) << 3) | (base & 7));
+		if (needDisp)
+			Byte(0);
+	}
+	void RegReg(bool w, uint8_t op, X64Reg reg, X64Reg rm) {Rex(w, reg, rm); Byte(op); ModRM(3, reg, rm);}
+	void RegReg2(bool w, uint8_t op, X64Reg reg, X64Reg rm) {Rex(w, reg, rm); Byte(0x0F); Byte(op); ModRM(3, reg, rm);}
+	void Mem(bool w, uint8_t op, int reg, X64Reg base, int32_t disp) {Rex(w, reg, base); Byte(op); MemOperand(reg, base, disp);}
+
+	uint8_t* start;
+	uint8_t* ptr;
+	uint8_t* end;
+	bool overflow = false;
+};
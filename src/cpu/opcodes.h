@@ -0,0 +1,114 @@
+#pragma once
+
+/// @brief List of every instruction the interpreter knows about, used to generate the decoder tables
+/// INSTR(handler, primary opcode, extended opcode, extended opcode mask)
+/// For primary opcodes with a sub-table, every sub-table index `i` where `(i & mask) == ext` is routed to `handler`.
+/// This lets the VMX128 forms (which only define some of the extended opcode bits) share a table with the regular forms
+#define PPC_INSTRUCTIONS(INSTR) \
+	INSTR(twi,         3,  0,     0) \
+	INSTR(lvx128,      4,  0x0C3, 0x7F3) \
+	INSTR(stvx128,     4,  0x1C3, 0x7F3) \
+	INSTR(vslb,        4,  260,   0x7FF) \
+	INSTR(vspltb,      4,  524,   0x7FF) \
+	INSTR(vspltisb,    4,  780,   0x7FF) \
+	INSTR(vspltish,    4,  844,   0x7FF) \
+	INSTR(vor,         4,  1156,  0x7FF) \
+	INSTR(vspltisw128, 6,  0x770, 0x7F0) \
+	INSTR(mulli,       7,  0,     0) \
+	INSTR(subfic,      8,  0,     0) \
+	INSTR(cmpli,       10, 0,     0) \
+	INSTR(cmpi,        11, 0,     0) \
+	INSTR(addic,       12, 0,     0) \
+	INSTR(addicx,      13, 0,     0) \
+	INSTR(addi,        14, 0,     0) \
+	INSTR(addis,       15, 0,     0) \
+	INSTR(bc,          16, 0,     0) \
+	INSTR(sc,          17, 0,     0) \
+	INSTR(branch,      18, 0,     0) \
+	INSTR(bclr,        19, 16,    0x3FF) \
+	INSTR(bctr,        19, 528,   0x3FF) \
+	INSTR(rlwimi,      20, 0,     0) \
+	INSTR(rlwinm,      21, 0,     0) \
+	INSTR(ori,         24, 0,     0) \
+	INSTR(oris,        25, 0,     0) \
+	INSTR(andi,        28, 0,     0) \
+	INSTR(andis,       29, 0,     0) \
+	INSTR(rldicl,      30, 0,     0x7) \
+	INSTR(rldicr,      30, 1,     0x7) \
+	INSTR(cmp,         31, 0,     0x3FF) \
+	INSTR(lvsl,        31, 6,     0x3FF) \
+	INSTR(subfc,       31, 8,     0x3FF) \
+	INSTR(lwarx,       31, 20,    0x3FF) \
+	INSTR(lwzx,        31, 23,    0x3FF) \
+	INSTR(slw,         31, 24,    0x3FF) \
+	INSTR(cntlzw,      31, 26,    0x3FF) \
+	INSTR(sld,         31, 27,    0x3FF) \
+	INSTR(and_,        31, 28,    0x3FF) \
+	INSTR(cmpl,        31, 32,    0x3FF) \
+	INSTR(subf,        31, 40,    0x3FF) \
+	INSTR(andc,        31, 60,    0x3FF) \
+	INSTR(mfmsr,       31, 83,    0x3FF) \
+	INSTR(lbzx,        31, 87,    0x3FF) \
+	INSTR(neg,         31, 104,   0x3FF) \
+	INSTR(nor,         31, 124,   0x3FF) \
+	INSTR(subfe,       31, 136,   0x3FF) \
+	INSTR(stdx,        31, 149,   0x3FF) \
+	INSTR(stwcx,       31, 150,   0x3FF) \
+	INSTR(stwx,        31, 151,   0x3FF) \
+	INSTR(mtmsrd,      31, 178,   0x3FF) \
+	INSTR(subfze,      31, 200,   0x3FF) \
+	INSTR(addze,       31, 202,   0x3FF) \
+	INSTR(mullw,       31, 235,   0x3FF) \
+	INSTR(dcbt,        31, 246,   0x3FF) \
+	INSTR(add,         31, 266,   0x3FF) \
+	INSTR(dcbt,        31, 278,   0x3FF) \
+	INSTR(xor_,        31, 316,   0x3FF) \
+	INSTR(mfspr,       31, 339,   0x3FF) \
+	INSTR(mftb,        31, 371,   0x3FF) \
+	INSTR(sthx,        31, 407,   0x3FF) \
+	INSTR(or_,         31, 444,   0x3FF) \
+	INSTR(divwu,       31, 459,   0x3FF) \
+	INSTR(mtspr,       31, 467,   0x3FF) \
+	INSTR(divd,        31, 489,   0x3FF) \
+	INSTR(sync,        31, 598,   0x3FF) \
+	INSTR(stvlx,       31, 647,   0x3FF) \
+	INSTR(stwbrx,      31, 662,   0x3FF) \
+	INSTR(stvrx,       31, 679,   0x3FF) \
+	INSTR(srawi,       31, 824,   0x3FF) \
+	INSTR(dcbz,        31, 1014,  0x3FF) \
+	INSTR(lwz,         32, 0,     0) \
+	INSTR(lwzu,        33, 0,     0) \
+	INSTR(lbz,         34, 0,     0) \
+	INSTR(lbzu,        35, 0,     0) \
+	INSTR(stw,         36, 0,     0) \
+	INSTR(stwu,        37, 0,     0) \
+	INSTR(stb,         38, 0,     0) \
+	INSTR(stbu,        39, 0,     0) \
+	INSTR(lhz,         40, 0,     0) \
+	INSTR(sth,         44, 0,     0) \
+	INSTR(lfs,         48, 0,     0) \
+	INSTR(lfd,         50, 0,     0) \
+	INSTR(stfs,        52, 0,     0) \
+	INSTR(stfd,        54, 0,     0) \
+	INSTR(ld,          58, 0,     0) \
+	INSTR(fsqrt,       59, 22,    0x1F) \
+	INSTR(fmuls,       59, 25,    0x1F) \
+	INSTR(std,         62, 0,     0) \
+	INSTR(fcmpu,       63, 0,     0x3FF) \
+	INSTR(frsp,        63, 12,    0x3FF) \
+	INSTR(fdiv,        63, 18,    0x3FF) \
+	INSTR(fsqrt,       63, 22,    0x3FF) \
+	INSTR(fmul,        63, 25,    0x3FF) \
+	INSTR(fctid,       63, 814,   0x3FF) \
+	INSTR(fcfid,       63, 846,   0x3FF)
+
+/// @brief Primary opcodes that are split further by an extended opcode field
+/// OPGROUP(primary opcode, shift of the extended opcode field, size of the sub-table)
+#define PPC_OPCODE_GROUPS(OPGROUP) \
+	OPGROUP(4,  0, 2048) \
+	OPGROUP(6,  0, 2048) \
+	OPGROUP(19, 1, 1024) \
+	OPGROUP(30, 2, 8) \
+	OPGROUP(31, 1, 1024) \
+	OPGROUP(59, 1, 32) \
+	OPGROUP(63, 1, 1024)
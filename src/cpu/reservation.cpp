@@ -0,0 +1,28 @@
+#include <cpu/reservation.h>
+
+namespace Reservation
+{
+
+std::atomic<uint32_t> slots[RESERVATION_SLOTS];
+
+uint32_t Acquire(uint32_t addr)
+{
+	return SlotFor(addr).fetch_or(1, std::memory_order_acq_rel) >> 1;
+}
+
+bool StillHeld(uint32_t addr, uint32_t version)
+{
+	return (SlotFor(addr).load(std::memory_order_acquire) >> 1) == version;
+}
+
+void Invalidate(uint32_t addr)
+{
+	std::atomic<uint32_t>& slot = SlotFor(addr);
+
+	// Adding one to an odd value clears the bit and carries into the version
+	uint32_t value = slot.load(std::memory_order_relaxed);
+	while ((value & 1) && !slot.compare_exchange_weak(value, value + 1, std::memory_order_acq_rel))
+		;
+}
+
+}
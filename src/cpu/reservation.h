@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+// Xenon reservations are per 128-byte cache line
+#define RESERVATION_LINE_SHIFT 7
+#define RESERVATION_SLOTS 4096
+
+/// @brief Shared state behind lwarx/stwcx. across hardware threads. Cache lines hash into a table of slots,
+/// each holding a version (upper bits) and a "someone has a reservation here" bit (bit 0).
+/// lwarx sets the bit and remembers the version; any store to a line with the bit set bumps the version
+/// and clears the bit, which makes every stwcx. on that line fail. stwcx. itself is a host compare-exchange
+/// against the value lwarx loaded, so a store that slips in between the version check and the exchange is caught too.
+/// Lines that share a slot make each other's stwcx. fail now and then, which the architecture allows
+namespace Reservation
+{
+
+extern std::atomic<uint32_t> slots[RESERVATION_SLOTS];
+
+inline std::atomic<uint32_t>& SlotFor(uint32_t addr)
+{
+	return slots[(addr >> RESERVATION_LINE_SHIFT) & (RESERVATION_SLOTS - 1)];
+}
+
+/// @brief Marks the line reserved and returns its version, for lwarx
+uint32_t Acquire(uint32_t addr);
+/// @brief Whether the line hasn't been stored to since Acquire returned `version`
+bool StillHeld(uint32_t addr, uint32_t version);
+/// @brief Breaks every reservation on the line containing `addr`
+void Invalidate(uint32_t addr);
+
+/// @brief Called for every plain store. Only costs a load unless the line is reserved
+inline void OnStore(uint32_t addr)
+{
+	if (SlotFor(addr).load(std::memory_order_relaxed) & 1)
+		Invalidate(addr);
+}
+
+}
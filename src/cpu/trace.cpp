@@ -0,0 +1,157 @@
+#include <cpu/trace.h>
+#include <cpu/disasm.h>
+#include <cpu/hwthread.h>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+std::atomic<Trace::Mode> Trace::mode = Trace::TRACE_OFF;
+
+#define RING_SIZE (1 << 16)
+#define RING_MASK (RING_SIZE - 1)
+
+/// @brief Single producer (one hardware thread), single consumer (the writer thread)
+typedef struct
+{
+	TraceRecord_t records[RING_SIZE];
+	std::atomic<uint64_t> head, tail;
+} Ring_t;
+
+// One per hardware thread, so they never contend
+static Ring_t rings[HW_THREAD_COUNT];
+
+static FILE* traceFile;
+static std::thread writerThread;
+static std::mutex writerMutex;
+static std::condition_variable writerCond;
+static bool writerStop;
+
+static void FlushRing(Ring_t& ring)
+{
+	uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+	uint64_t head = ring.head.load(std::memory_order_acquire);
+
+	while (tail != head)
+	{
+		// Write out the contiguous span up to either the head or the end of the ring
+		uint64_t count = head - tail;
+		uint64_t untilWrap = RING_SIZE - (tail & RING_MASK);
+		if (count > untilWrap)
+			count = untilWrap;
+
+		fwrite(&ring.records[tail & RING_MASK], sizeof(TraceRecord_t), count, traceFile);
+		tail += count;
+		ring.tail.store(tail, std::memory_order_release);
+	}
+}
+
+static void FlushRings()
+{
+	for (auto& ring : rings)
+		FlushRing(ring);
+}
+
+static void WriterMain()
+{
+	std::unique_lock<std::mutex> lock(writerMutex);
+	while (!writerStop)
+	{
+		writerCond.wait_for(lock, std::chrono::milliseconds(10));
+		lock.unlock();
+		FlushRings();
+		lock.lock();
+	}
+	FlushRings();
+}
+
+void Trace::EnableText()
+{
+	Disasm::Initialize();
+	mode = TRACE_TEXT;
+}
+
+bool Trace::EnableBinary(const char *path)
+{
+	traceFile = fopen(path, "wb");
+	if (!traceFile)
+	{
+		printf("Failed to open trace file \"%s\"\n", path);
+		return false;
+	}
+
+	TraceFileHeader_t hdr;
+	hdr.magic = TRACE_MAGIC;
+	hdr.version = TRACE_VERSION;
+	hdr.recordSize = sizeof(TraceRecord_t);
+	fwrite(&hdr, sizeof(hdr), 1, traceFile);
+
+	Disasm::Initialize();
+	writerStop = false;
+	writerThread = std::thread(WriterMain);
+	mode = TRACE_BINARY;
+	return true;
+}
+
+void Trace::Shutdown()
+{
+	if (mode == TRACE_BINARY)
+	{
+		mode = TRACE_OFF;
+		{
+			std::lock_guard<std::mutex> lock(writerMutex);
+			writerStop = true;
+		}
+		writerCond.notify_one();
+		writerThread.join();
+		fclose(traceFile);
+	}
+
+	mode = TRACE_OFF;
+}
+
+void Trace::WriteText(uint32_t pc, uint32_t instr)
+{
+	char buf[128];
+	Disasm::Disassemble(instr, pc, buf, sizeof(buf));
+	printf("0x%08x (0x%08x): %s\n", instr, pc, buf);
+}
+
+void Trace::WriteRecord(uint32_t pc, uint32_t instr, const uint64_t* regs)
+{
+	// Guest code only runs on hardware threads
+	static thread_local int thread = HardwareThreads::GetCurrent() ? HardwareThreads::GetCurrent()->GetId() : 0;
+	Ring_t& ring = rings[thread];
+
+	uint64_t head = ring.head.load(std::memory_order_relaxed);
+
+	// Ring is full, wait for the writer to catch up rather than dropping records
+	while (head - ring.tail.load(std::memory_order_acquire) >= RING_SIZE)
+	{
+		writerCond.notify_one();
+		std::this_thread::yield();
+	}
+
+	TraceRecord_t& rec = ring.records[head & RING_MASK];
+	rec.pc = pc;
+	rec.instr = instr;
+	rec.thread = thread;
+
+	int gpr = Disasm::GetDestGPR(instr);
+	if (gpr < 0)
+	{
+		rec.gpr = TRACE_NO_GPR;
+		rec.value = 0;
+	}
+	else
+	{
+		rec.gpr = gpr;
+		rec.value = regs[gpr];
+	}
+
+	ring.head.store(head + 1, std::memory_order_release);
+
+	if (((head + 1) & (RING_SIZE / 2 - 1)) == 0)
+		writerCond.notify_one();
+}
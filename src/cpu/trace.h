@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+#define TRACE_MAGIC 0x52544E57 // "WNTR"
+#define TRACE_VERSION 2
+#define TRACE_NO_GPR 0xFF
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t recordSize;
+} TraceFileHeader_t;
+
+/// @brief One executed instruction. `gpr` is the register the instruction wrote (or `TRACE_NO_GPR`), `value` is its new contents.
+/// `thread` is the hardware thread that ran it. Each thread's records are in order, but they're interleaved with other threads' in chunks
+typedef struct __attribute__((packed))
+{
+	uint32_t pc;
+	uint32_t instr;
+	uint64_t value;
+	uint8_t gpr;
+	uint8_t thread;
+} TraceRecord_t;
+
+/// @brief Instruction tracing. Only compiled in when `WATERNOOSE_TRACE` is defined (see CMakeLists.txt),
+/// otherwise `TRACE_INSTRUCTION` expands to nothing and the interpreter pays nothing for it
+namespace Trace
+{
+
+enum Mode
+{
+	TRACE_OFF,
+	TRACE_TEXT,   // Disassemble every instruction to stdout as it executes
+	TRACE_BINARY, // Append a `TraceRecord_t` per instruction to a file, see tools/tracedump.cpp
+};
+
+/// @brief Hardware threads read this while Shutdown changes it
+extern std::atomic<Mode> mode;
+
+void EnableText();
+/// @brief Starts the background writer thread and switches to binary records
+/// @param path The file to write the trace to
+bool EnableBinary(const char* path);
+/// @brief Flushes everything still in the ring buffer and stops the writer thread
+void Shutdown();
+
+void WriteText(uint32_t pc, uint32_t instr);
+void WriteRecord(uint32_t pc, uint32_t instr, const uint64_t* regs);
+
+}
+
+#ifdef WATERNOOSE_TRACE
+#define TRACE_INSTRUCTION(pc, instr, regs) \
+	do \
+	{ \
+		if (Trace::mode.load(std::memory_order_relaxed) == Trace::TRACE_BINARY) \
+			Trace::WriteRecord(pc, instr, regs); \
+	} while (0)
+#define TRACE_INSTRUCTION_TEXT(pc, instr) \
+	do \
+	{ \
+		if (Trace::mode.load(std::memory_order_relaxed) == Trace::TRACE_TEXT) \
+			Trace::WriteText(pc, instr); \
+	} while (0)
+#else
+#define TRACE_INSTRUCTION(pc, instr, regs) do {} while (0)
+#define TRACE_INSTRUCTION_TEXT(pc, instr) do {} while (0)
+#endif
@@ -0,0 +1,122 @@
+#include <crypto/aes.h>
+#include <crypto/rijndael-alg-fst.h>
+#include <string.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+static void KeySetupPortable(AesKey_t* key, const uint8_t cipherKey[AES_KEY_SIZE])
+{
+	key->rounds = rijndaelKeySetupDec(key->rk, cipherKey, 128);
+}
+
+static void CbcDecryptPortable(const AesKey_t* key, uint8_t iv[AES_BLOCK_SIZE], const uint8_t* in, uint8_t* out, size_t blocks)
+{
+	for (; blocks; blocks--, in += AES_BLOCK_SIZE, out += AES_BLOCK_SIZE)
+	{
+		uint8_t ct[AES_BLOCK_SIZE];
+		memcpy(ct, in, AES_BLOCK_SIZE);
+		rijndaelDecrypt(key->rk, key->rounds, ct, out);
+		for (int i = 0; i < AES_BLOCK_SIZE; i++)
+			out[i] ^= iv[i];
+		memcpy(iv, ct, AES_BLOCK_SIZE);
+	}
+}
+
+const AesBackend_t aesPortable = {"portable", KeySetupPortable, CbcDecryptPortable};
+
+/// @brief One step of the AES-128 key schedule, `assist` being aeskeygenassist of the previous round key
+__attribute__((target("aes,sse2")))
+static inline __m128i ExpandStep(__m128i key, __m128i assist)
+{
+	assist = _mm_shuffle_epi32(assist, 0xFF);
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, assist);
+}
+
+__attribute__((target("aes,sse2")))
+static void KeySetupAesNi(AesKey_t* key, const uint8_t cipherKey[AES_KEY_SIZE])
+{
+	__m128i enc[11];
+	enc[0] = _mm_loadu_si128((const __m128i*)cipherKey);
+	enc[1] = ExpandStep(enc[0], _mm_aeskeygenassist_si128(enc[0], 0x01));
+	enc[2] = ExpandStep(enc[1], _mm_aeskeygenassist_si128(enc[1], 0x02));
+	enc[3] = ExpandStep(enc[2], _mm_aeskeygenassist_si128(enc[2], 0x04));
+	enc[4] = ExpandStep(enc[3], _mm_aeskeygenassist_si128(enc[3], 0x08));
+	enc[5] = ExpandStep(enc[4], _mm_aeskeygenassist_si128(enc[4], 0x10));
+	enc[6] = ExpandStep(enc[5], _mm_aeskeygenassist_si128(enc[5], 0x20));
+	enc[7] = ExpandStep(enc[6], _mm_aeskeygenassist_si128(enc[6], 0x40));
+	enc[8] = ExpandStep(enc[7], _mm_aeskeygenassist_si128(enc[7], 0x80));
+	enc[9] = ExpandStep(enc[8], _mm_aeskeygenassist_si128(enc[8], 0x1B));
+	enc[10] = ExpandStep(enc[9], _mm_aeskeygenassist_si128(enc[9], 0x36));
+
+	// The equivalent inverse cipher runs the schedule backwards, with InvMixColumns applied to the middle keys
+	__m128i* dec = (__m128i*)key->rk;
+	dec[0] = enc[10];
+	for (int i = 1; i < 10; i++)
+		dec[i] = _mm_aesimc_si128(enc[10 - i]);
+	dec[10] = enc[0];
+	key->rounds = 10;
+}
+
+__attribute__((target("aes,sse2")))
+static inline __m128i DecryptBlock(const __m128i* rk, __m128i block)
+{
+	block = _mm_xor_si128(block, rk[0]);
+	for (int r = 1; r < 10; r++)
+		block = _mm_aesdec_si128(block, rk[r]);
+	return _mm_aesdeclast_si128(block, rk[10]);
+}
+
+__attribute__((target("aes,sse2")))
+static void CbcDecryptAesNi(const AesKey_t* key, uint8_t iv[AES_BLOCK_SIZE], const uint8_t* in, uint8_t* out, size_t blocks)
+{
+	const __m128i* rk = (const __m128i*)key->rk;
+	__m128i prev = _mm_loadu_si128((const __m128i*)iv);
+
+	// Every block only depends on its own ciphertext and the one before it, so 8 go through the pipeline together
+	for (; blocks >= 8; blocks -= 8, in += 8 * AES_BLOCK_SIZE, out += 8 * AES_BLOCK_SIZE)
+	{
+		__m128i ct[8], x[8];
+		for (int i = 0; i < 8; i++)
+		{
+			ct[i] = _mm_loadu_si128((const __m128i*)in + i);
+			x[i] = _mm_xor_si128(ct[i], rk[0]);
+		}
+		for (int r = 1; r < 10; r++)
+			for (int i = 0; i < 8; i++)
+				x[i] = _mm_aesdec_si128(x[i], rk[r]);
+		for (int i = 0; i < 8; i++)
+			x[i] = _mm_aesdeclast_si128(x[i], rk[10]);
+
+		_mm_storeu_si128((__m128i*)out, _mm_xor_si128(x[0], prev));
+		for (int i = 1; i < 8; i++)
+			_mm_storeu_si128((__m128i*)out + i, _mm_xor_si128(x[i], ct[i - 1]));
+		prev = ct[7];
+	}
+
+	for (; blocks; blocks--, in += AES_BLOCK_SIZE, out += AES_BLOCK_SIZE)
+	{
+		__m128i ct = _mm_loadu_si128((const __m128i*)in);
+		_mm_storeu_si128((__m128i*)out, _mm_xor_si128(DecryptBlock(rk, ct), prev));
+		prev = ct;
+	}
+
+	_mm_storeu_si128((__m128i*)iv, prev);
+}
+
+const AesBackend_t aesNi = {"aes-ni", KeySetupAesNi, CbcDecryptAesNi};
+
+bool aes_ni_supported()
+{
+	// AES is CPUID leaf 1 ECX bit 25
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 25));
+}
+
+const AesBackend_t* aes_backend()
+{
+	static const AesBackend_t* backend = aes_ni_supported() ? &aesNi : &aesPortable;
+	return backend;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define AES_BLOCK_SIZE 16
+#define AES_KEY_SIZE 16 // Everything the 360 encrypts with is AES-128
+
+/// @brief An expanded decryption key, in whichever layout the backend that set it up uses
+typedef struct AesKey_t
+{
+	alignas(16) uint32_t rk[4 * 15];
+	int rounds;
+} AesKey_t;
+
+/// @brief One implementation of AES-128 CBC decryption. Keys set up by one backend only work with that backend
+typedef struct AesBackend_t
+{
+	const char* name;
+	void (*keySetupDec)(AesKey_t* key, const uint8_t cipherKey[AES_KEY_SIZE]);
+	/// @brief Decrypts `blocks` blocks from `in` to `out`, which may be the same buffer.
+	/// `iv` is updated to the last ciphertext block, so the chain can be continued with another call
+	void (*cbcDecrypt)(const AesKey_t* key, uint8_t iv[AES_BLOCK_SIZE], const uint8_t* in, uint8_t* out, size_t blocks);
+} AesBackend_t;
+
+/// @brief The table based rijndael code, which runs anywhere
+extern const AesBackend_t aesPortable;
+/// @brief AES-NI, with 8 blocks decrypting at once. Only usable if aes_ni_supported()
+extern const AesBackend_t aesNi;
+
+bool aes_ni_supported();
+/// @brief The fastest backend the host can run, picked once on first use
+const AesBackend_t* aes_backend();
@@ -0,0 +1,150 @@
+#include <crypto/sha1.h>
+#include <string.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+typedef void (*Sha1Compress_t)(uint32_t state[5], const uint8_t* data, size_t blocks);
+
+static inline uint32_t rol(uint32_t value, int bits)
+{
+	return (value << bits) | (value >> (32 - bits));
+}
+
+static void CompressPortable(uint32_t state[5], const uint8_t* data, size_t blocks)
+{
+	for (; blocks; blocks--, data += 64)
+	{
+		uint32_t w[80];
+		for (int i = 0; i < 16; i++)
+			w[i] = (data[i*4] << 24) | (data[i*4+1] << 16) | (data[i*4+2] << 8) | data[i*4+3];
+		for (int i = 16; i < 80; i++)
+			w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+		for (int i = 0; i < 80; i++)
+		{
+			uint32_t f, k;
+			if (i < 20)
+			{
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			}
+			else if (i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			}
+			else if (i < 60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+
+			uint32_t temp = rol(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rol(b, 30);
+			b = a;
+			a = temp;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+}
+
+/// @brief sha1rnds4 only takes its round function as an immediate
+__attribute__((target("sha,sse4.1")))
+static inline __m128i Rounds4(__m128i abcd, __m128i e, int group)
+{
+	switch (group / 5)
+	{
+	case 0: return _mm_sha1rnds4_epu32(abcd, e, 0);
+	case 1: return _mm_sha1rnds4_epu32(abcd, e, 1);
+	case 2: return _mm_sha1rnds4_epu32(abcd, e, 2);
+	default: return _mm_sha1rnds4_epu32(abcd, e, 3);
+	}
+}
+
+/// @brief Works on four rounds at a time, each group of four message words feeding the next group's E
+__attribute__((target("sha,sse4.1")))
+static void CompressShaNi(uint32_t state[5], const uint8_t* data, size_t blocks)
+{
+	const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+	__m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+	for (; blocks; blocks--, data += 64)
+	{
+		__m128i abcdSave = abcd, eSave = e0;
+
+		__m128i w[20];
+		for (int i = 0; i < 4; i++)
+			w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 16)), byteSwap);
+		for (int i = 4; i < 20; i++)
+			w[i] = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(w[i-4], w[i-3]), w[i-2]), w[i-1]);
+
+		__m128i e = _mm_add_epi32(e0, w[0]);
+		__m128i prev = abcd;
+		for (int group = 0; group < 20; group++)
+		{
+			prev = abcd;
+			abcd = Rounds4(abcd, e, group);
+			if (group < 19)
+				e = _mm_sha1nexte_epu32(prev, w[group + 1]);
+		}
+
+		e0 = _mm_sha1nexte_epu32(prev, eSave);
+		abcd = _mm_add_epi32(abcd, abcdSave);
+	}
+
+	_mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = _mm_extract_epi32(e0, 3);
+}
+
+static Sha1Compress_t PickCompress()
+{
+	// SHA is CPUID leaf 7 EBX bit 29, and the shuffles need SSSE3/SSE4.1 (leaf 1 ECX bits 9 and 19)
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & (1 << 9)) || !(ecx & (1 << 19)))
+		return CompressPortable;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & (1 << 29)))
+		return CompressPortable;
+	return CompressShaNi;
+}
+
+void sha1(const uint8_t* data, size_t len, uint8_t digest[SHA1_DIGEST_SIZE])
+{
+	static const Sha1Compress_t compress = PickCompress();
+
+	uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+	compress(state, data, len / 64);
+
+	// The tail, the 0x80 terminator and the length in bits fill one or two more blocks
+	uint8_t tail[128] = {0};
+	size_t rest = len % 64;
+	memcpy(tail, data + len - rest, rest);
+	tail[rest] = 0x80;
+	size_t tailLen = rest < 56 ? 64 : 128;
+	uint64_t bits = (uint64_t)len * 8;
+	for (int i = 0; i < 8; i++)
+		tail[tailLen - 1 - i] = bits >> (i * 8);
+	compress(state, tail, tailLen / 64);
+
+	for (int i = 0; i < 5; i++)
+	{
+		digest[i*4+0] = state[i] >> 24;
+		digest[i*4+1] = state[i] >> 16;
+		digest[i*4+2] = state[i] >> 8;
+		digest[i*4+3] = state[i];
+	}
+}
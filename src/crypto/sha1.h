@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA1_DIGEST_SIZE 20
+
+/// @brief SHA-1 of `len` bytes at `data`. Uses the SHA extensions when the host has them, plain C otherwise
+void sha1(const uint8_t* data, size_t len, uint8_t digest[SHA1_DIGEST_SIZE]);
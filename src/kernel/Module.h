@@ -3,14 +3,32 @@
 #include <string>
 #include <cpu/CPU.h>
 
+class IModule;
+
+/// @brief What a bound import thunk calls, with the module it was bound against
+typedef void (*ExportHandler_t)(IModule* module, CPUThread& caller);
+
+#define EXPORT_FUNCTION 0
+#define EXPORT_VARIABLE 1
+
+/// @brief One entry of a module's export table
+typedef struct Export_t
+{
+	uint32_t ordinal;
+	uint8_t kind; // EXPORT_FUNCTION or EXPORT_VARIABLE
+	const char* name;
+	ExportHandler_t handler; // nullptr for a function that's known but not implemented yet
+} Export_t;
+
 class IModule
 {
 public:
 	IModule(const char* name) : name(name) {}
 	const std::string& GetName() const {return name;}
 
-	virtual void CallFunctionByOrdinal(uint32_t ordinal, CPUThread& caller) {};
+	/// @return The export with this ordinal, or nullptr if the module doesn't know it
+	virtual const Export_t* LookupExport([[maybe_unused]] uint32_t ordinal) {return nullptr;}
 	virtual uint32_t GetHandle() const = 0;
 private:
 	std::string name;
-};
\ No newline at end of file
+};
@@ -0,0 +1,496 @@
+#include <kernel/dispatcher.h>
+#include <kernel/scheduler.h>
+#include <kernel/timerwheel.h>
+#include <cpu/hwthread.h>
+#include <kernel/shim.h>
+#include <kernel/xtypes.h>
+#include <memory/memory.h>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cassert>
+
+// Fields that are read and written on their own, some of them atomically
+#define HEADER_TYPE offsetof(X_DISPATCHER_HEADER, type)
+#define HEADER_ABSOLUTE offsetof(X_DISPATCHER_HEADER, absolute)
+#define HEADER_SIGNAL_STATE offsetof(X_DISPATCHER_HEADER, signalState)
+#define MUTANT_OWNER offsetof(X_KMUTANT, owner)
+#define MUTANT_ABANDONED offsetof(X_KMUTANT, abandoned)
+#define SEMAPHORE_LIMIT offsetof(X_KSEMAPHORE, limit)
+#define SECTION_LOCK_COUNT offsetof(X_RTL_CRITICAL_SECTION, lockCount)
+#define SECTION_RECURSION_COUNT offsetof(X_RTL_CRITICAL_SECTION, recursionCount)
+#define SECTION_OWNER offsetof(X_RTL_CRITICAL_SECTION, owner)
+
+namespace Dispatcher
+{
+
+/// @brief One thread's wait, on up to MAXIMUM_WAIT_OBJECTS objects. Queued under each of them until it's done
+typedef struct
+{
+	GuestThread_t* thread;
+	uint32_t kthread;
+	std::vector<uint32_t> objects;
+	bool waitAll;
+	bool criticalSection; // Satisfying the wait also hands over the critical section
+	uint32_t timeoutStatus; // What the wait ends with if the timeout goes off, delays end with success
+
+	bool done;
+	uint32_t status;
+	std::shared_ptr<Timer_t> timeout;
+	std::atomic<uint32_t>* hostWake; // Set if the whole hardware thread is blocked, see WaitFor
+} WaitState_t;
+
+// The dispatcher lock. Guards the signal state of every object and the wait queues, taken before the scheduler's
+static std::mutex lock;
+/// @brief Waits queued on each object, keyed by its guest address, first come first served
+static std::unordered_map<uint32_t, std::deque<std::shared_ptr<WaitState_t>>> waiters;
+
+/// @brief Host side of the KTIMERs that are set
+typedef struct
+{
+	std::shared_ptr<Timer_t> timer;
+	uint32_t period; // In milliseconds
+	uint32_t dpc;
+} KernelTimer_t;
+static std::unordered_map<uint32_t, KernelTimer_t> kernelTimers;
+
+/// @brief Whether a wait by `kthread` would be satisfied right now. With `lock` held
+static bool IsSignalled(uint32_t object, uint32_t kthread)
+{
+	int32_t signalState = Memory::Read32(object+HEADER_SIGNAL_STATE);
+	if (Memory::Read8(object+HEADER_TYPE) == DISPATCHER_MUTANT)
+		return signalState > 0 || Memory::Read32(object+MUTANT_OWNER) == kthread;
+	return signalState > 0;
+}
+
+/// @brief Acquires a signalled object on behalf of a waiter. With `lock` held
+static void Satisfy(uint32_t object, const WaitState_t& wait)
+{
+	switch (Memory::Read8(object+HEADER_TYPE))
+	{
+	case DISPATCHER_SYNCHRONIZATION_EVENT:
+	case DISPATCHER_SYNCHRONIZATION_TIMER:
+		Memory::Write32(object+HEADER_SIGNAL_STATE, 0);
+		break;
+	case DISPATCHER_SEMAPHORE:
+		Memory::Write32(object+HEADER_SIGNAL_STATE, Memory::Read32(object+HEADER_SIGNAL_STATE) - 1);
+		break;
+	case DISPATCHER_MUTANT:
+		Memory::Write32(object+HEADER_SIGNAL_STATE, Memory::Read32(object+HEADER_SIGNAL_STATE) - 1);
+		Memory::Write32(object+MUTANT_OWNER, wait.kthread);
+		break;
+	}
+
+	if (wait.criticalSection)
+	{
+		Memory::Write32(object+SECTION_OWNER, wait.kthread);
+		Memory::Write32(object+SECTION_RECURSION_COUNT, 1);
+	}
+}
+
+/// @brief Checks whether a wait can be satisfied now, and acquires what it waits on if so. With `lock` held
+/// @return The status it's satisfied with, or STATUS_TIMEOUT if it isn't
+static uint32_t TrySatisfy(const WaitState_t& wait)
+{
+	if (wait.waitAll)
+	{
+		if (wait.objects.empty())
+			return STATUS_TIMEOUT;
+		for (uint32_t object : wait.objects)
+			if (!IsSignalled(object, wait.kthread))
+				return STATUS_TIMEOUT;
+		for (uint32_t object : wait.objects)
+			Satisfy(object, wait);
+		return STATUS_SUCCESS;
+	}
+
+	for (size_t i = 0; i < wait.objects.size(); i++)
+	{
+		if (IsSignalled(wait.objects[i], wait.kthread))
+		{
+			Satisfy(wait.objects[i], wait);
+			return STATUS_WAIT_0 + i;
+		}
+	}
+	return STATUS_TIMEOUT;
+}
+
+/// @brief Ends a queued wait and lets the thread go. With `lock` held
+/// @param except Queue the caller is walking and takes the wait out of itself
+static void Complete(const std::shared_ptr<WaitState_t>& wait, uint32_t status, uint32_t except)
+{
+	wait->done = true;
+	wait->status = status;
+
+	for (uint32_t object : wait->objects)
+	{
+		if (object == except)
+			continue;
+
+		auto it = waiters.find(object);
+		if (it == waiters.end())
+			continue;
+
+		auto& queue = it->second;
+		queue.erase(std::remove(queue.begin(), queue.end(), wait), queue.end());
+		if (queue.empty())
+			waiters.erase(it);
+	}
+
+	// The timer's callback holds on to the wait, dropping the timer breaks the cycle
+	if (wait->timeout)
+	{
+		TimerWheel::Cancel(wait->timeout);
+		wait->timeout.reset();
+	}
+
+	if (wait->hostWake)
+	{
+		wait->hostWake->store(1);
+		wait->hostWake->notify_one();
+	}
+	else
+		Scheduler::Wake(wait->thread, status);
+}
+
+/// @brief Satisfies and releases waits on `object` for as long as it stays signalled. With `lock` held
+static void WakeWaiters(uint32_t object)
+{
+	auto it = waiters.find(object);
+	if (it == waiters.end())
+		return;
+
+	// A wait on several objects may be satisfied by this one or not, so every wait in the queue gets a look
+	auto& queue = it->second;
+	for (auto pos = queue.begin(); pos != queue.end() && IsSignalled(object, (*pos)->kthread);)
+	{
+		std::shared_ptr<WaitState_t> wait = *pos;
+		uint32_t status = TrySatisfy(*wait);
+		if (status == STATUS_TIMEOUT)
+		{
+			++pos;
+			continue;
+		}
+
+		pos = queue.erase(pos);
+		Complete(wait, status, object);
+	}
+
+	if (queue.empty())
+		waiters.erase(it);
+}
+
+static void OnTimeout(const std::shared_ptr<WaitState_t>& wait)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	// Satisfied while the timer was going off
+	if (wait->done)
+		return;
+	Complete(wait, wait->timeoutStatus, 0);
+}
+
+static uint32_t WaitFor(std::shared_ptr<WaitState_t> wait, const int64_t* timeout)
+{
+	GuestThread_t* thread = Scheduler::GetCurrentThread();
+	assert(thread);
+	wait->thread = thread;
+	wait->kthread = thread->kthread;
+
+	std::unique_lock<std::mutex> guard(lock);
+	uint32_t status = TrySatisfy(*wait);
+	if (status != STATUS_TIMEOUT)
+		return status;
+
+	if (timeout && *timeout == 0)
+		return wait->timeoutStatus;
+
+	// Queued while holding the lock, so a signal can't get in before the thread is marked as waiting
+	std::atomic<uint32_t> woken = 0;
+	bool switchedOut = Scheduler::BlockCurrent();
+	if (!switchedOut)
+		wait->hostWake = &woken; // Under a nested run the thread can't be switched out, so the whole hardware thread waits
+
+	for (uint32_t object : wait->objects)
+		waiters[object].push_back(wait);
+
+	if (timeout)
+	{
+		wait->timeout = std::make_shared<Timer_t>();
+		wait->timeout->callback = [wait]() {OnTimeout(wait);};
+		TimerWheel::Arm(wait->timeout, TimerWheel::DueTime(*timeout));
+	}
+
+	if (switchedOut)
+		return STATUS_SUCCESS;
+
+	guard.unlock();
+	HardwareThreads::EnterIdle();
+	woken.wait(0);
+	HardwareThreads::LeaveIdle();
+
+	// The waker notifies with the lock held, wait for it to be done with `woken`
+	guard.lock();
+	return wait->status;
+}
+
+static void OnKernelTimer(uint32_t timer, const std::shared_ptr<Timer_t>& fired)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	// Cancelled or set again while it was going off
+	auto it = kernelTimers.find(timer);
+	if (it == kernelTimers.end() || it->second.timer != fired)
+		return;
+
+	Memory::Write32(timer+HEADER_SIGNAL_STATE, 1);
+	WakeWaiters(timer);
+
+	uint32_t dpc = it->second.dpc;
+	// Periods count from when it was due rather than when it went off, so they don't drift
+	if (it->second.period)
+		TimerWheel::Arm(fired, fired->due * TIMER_TICK + (uint64_t)it->second.period * 10000);
+	else
+		kernelTimers.erase(it);
+
+	if (dpc)
+	{
+		uint64_t now = TimerWheel::SystemTime();
+		Scheduler::QueueDpc(dpc, (uint32_t)now, (uint32_t)(now >> 32));
+	}
+}
+
+/// @brief Adds `delta` to a guest word that guest code may be updating with lwarx/stwcx. at the same time
+/// @return The new value
+static int32_t AtomicAdd(uint32_t addr, int32_t delta)
+{
+	uint32_t value;
+	do
+		value = Memory::Read32(addr);
+	while (!Memory::CompareExchange32(addr, value, value + delta));
+	return value + delta;
+}
+
+void InitializeHeader(uint32_t object, uint8_t type, int32_t signalState)
+{
+	X_DISPATCHER_HEADER* header = GuestPtr<X_DISPATCHER_HEADER>(object).Map();
+	header->type = type;
+	header->absolute = 0;
+	header->processType = 0;
+	header->inserted = 0;
+	header->signalState = signalState;
+	// An empty list points back at itself
+	uint32_t waitList = object + offsetof(X_DISPATCHER_HEADER, waitList);
+	header->waitList.flink = waitList;
+	header->waitList.blink = waitList;
+}
+
+uint32_t Wait(uint32_t object, const int64_t* timeout)
+{
+	return WaitMultiple(&object, 1, false, timeout);
+}
+
+uint32_t WaitMultiple(const uint32_t* objects, int count, bool waitAll, const int64_t* timeout)
+{
+	std::shared_ptr<WaitState_t> wait = std::make_shared<WaitState_t>();
+	wait->objects.assign(objects, objects + count);
+	wait->waitAll = waitAll;
+	wait->timeoutStatus = STATUS_TIMEOUT;
+	return WaitFor(wait, timeout);
+}
+
+uint32_t Delay(int64_t interval)
+{
+	if (!interval)
+	{
+		HardwareThreads::GetCurrent()->GetCPU()->RequestYield();
+		return STATUS_SUCCESS;
+	}
+
+	std::shared_ptr<WaitState_t> wait = std::make_shared<WaitState_t>();
+	wait->timeoutStatus = STATUS_SUCCESS;
+	return WaitFor(wait, &interval);
+}
+
+int32_t SetEvent(uint32_t event)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	int32_t previous = Memory::Read32(event+HEADER_SIGNAL_STATE);
+	Memory::Write32(event+HEADER_SIGNAL_STATE, 1);
+	WakeWaiters(event);
+	return previous;
+}
+
+int32_t ResetEvent(uint32_t event)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	int32_t previous = Memory::Read32(event+HEADER_SIGNAL_STATE);
+	Memory::Write32(event+HEADER_SIGNAL_STATE, 0);
+	return previous;
+}
+
+int32_t PulseEvent(uint32_t event)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	int32_t previous = Memory::Read32(event+HEADER_SIGNAL_STATE);
+	Memory::Write32(event+HEADER_SIGNAL_STATE, 1);
+	WakeWaiters(event);
+	Memory::Write32(event+HEADER_SIGNAL_STATE, 0);
+	return previous;
+}
+
+uint32_t ReleaseSemaphore(uint32_t semaphore, int32_t adjustment, int32_t& previous)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	previous = Memory::Read32(semaphore+HEADER_SIGNAL_STATE);
+	int32_t limit = Memory::Read32(semaphore+SEMAPHORE_LIMIT);
+	if (adjustment <= 0 || adjustment > limit - previous)
+		return STATUS_SEMAPHORE_LIMIT_EXCEEDED;
+
+	Memory::Write32(semaphore+HEADER_SIGNAL_STATE, previous + adjustment);
+	WakeWaiters(semaphore);
+	return STATUS_SUCCESS;
+}
+
+uint32_t ReleaseMutant(uint32_t mutant, int32_t& previous)
+{
+	GuestThread_t* thread = Scheduler::GetCurrentThread();
+	assert(thread);
+
+	std::lock_guard<std::mutex> guard(lock);
+	previous = Memory::Read32(mutant+HEADER_SIGNAL_STATE);
+	if (previous > 0 || Memory::Read32(mutant+MUTANT_OWNER) != thread->kthread)
+		return STATUS_MUTANT_NOT_OWNED;
+
+	// Owned recursively until the count gets back to 1
+	Memory::Write32(mutant+HEADER_SIGNAL_STATE, previous + 1);
+	if (previous + 1 == 1)
+	{
+		Memory::Write32(mutant+MUTANT_OWNER, 0);
+		Memory::Write8(mutant+MUTANT_ABANDONED, 0);
+		WakeWaiters(mutant);
+	}
+	return STATUS_SUCCESS;
+}
+
+bool SetTimer(uint32_t timer, int64_t dueTime, uint32_t period, uint32_t dpc)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	bool wasSet = false;
+	auto it = kernelTimers.find(timer);
+	if (it != kernelTimers.end())
+	{
+		TimerWheel::Cancel(it->second.timer);
+		kernelTimers.erase(it);
+		wasSet = true;
+	}
+
+	X_KTIMER* ktimer = GuestPtr<X_KTIMER>(timer).Map();
+	ktimer->header.signalState = 0;
+	ktimer->dueTime = dueTime;
+	ktimer->dpc = dpc;
+	ktimer->period = period;
+
+	// A fresh Timer_t each time, so a callback already on its way for the old one can tell
+	std::shared_ptr<Timer_t> entry = std::make_shared<Timer_t>();
+	entry->callback = [timer, weak = std::weak_ptr<Timer_t>(entry)]() {OnKernelTimer(timer, weak.lock());};
+	kernelTimers[timer] = {entry, period, dpc};
+	TimerWheel::Arm(entry, TimerWheel::DueTime(dueTime));
+
+	return wasSet;
+}
+
+bool CancelTimer(uint32_t timer)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto it = kernelTimers.find(timer);
+	if (it == kernelTimers.end())
+		return false;
+
+	TimerWheel::Cancel(it->second.timer);
+	kernelTimers.erase(it);
+	return true;
+}
+
+void InitializeCriticalSection(uint32_t section, uint32_t spinCount)
+{
+	InitializeHeader(section, DISPATCHER_SYNCHRONIZATION_EVENT, 0);
+	X_RTL_CRITICAL_SECTION* cs = GuestPtr<X_RTL_CRITICAL_SECTION>(section).Map();
+	cs->header.absolute = std::min<uint32_t>((spinCount + 255) >> 8, 0xFF);
+	cs->lockCount = (uint32_t)-1;
+	cs->recursionCount = 0;
+	cs->owner = 0;
+}
+
+/// @brief The uncontended half of entering, shared with TryEnterCriticalSection
+static bool TryAcquire(uint32_t section, uint32_t kthread)
+{
+	if (Memory::Read32(section+SECTION_OWNER) == kthread)
+	{
+		AtomicAdd(section+SECTION_LOCK_COUNT, 1);
+		Memory::Write32(section+SECTION_RECURSION_COUNT, Memory::Read32(section+SECTION_RECURSION_COUNT) + 1);
+		return true;
+	}
+
+	if (Memory::Read32(section+SECTION_LOCK_COUNT) != (uint32_t)-1 || !Memory::CompareExchange32(section+SECTION_LOCK_COUNT, (uint32_t)-1, 0))
+		return false;
+
+	Memory::Write32(section+SECTION_OWNER, kthread);
+	Memory::Write32(section+SECTION_RECURSION_COUNT, 1);
+	return true;
+}
+
+void EnterCriticalSection(uint32_t section)
+{
+	GuestThread_t* thread = Scheduler::GetCurrentThread();
+	assert(thread);
+
+	uint32_t spinCount = Memory::Read8(section+HEADER_ABSOLUTE) * 256;
+	for (uint32_t i = 0; i <= spinCount; i++)
+		if (TryAcquire(section, thread->kthread))
+			return;
+
+	// LockCount goes from -1 to 0 for the first thread in, anything else means we have to wait for the event.
+	// Whoever leaves signals it, and the wait makes us the owner
+	if (AtomicAdd(section+SECTION_LOCK_COUNT, 1) == 0)
+	{
+		Memory::Write32(section+SECTION_OWNER, thread->kthread);
+		Memory::Write32(section+SECTION_RECURSION_COUNT, 1);
+		return;
+	}
+
+	std::shared_ptr<WaitState_t> wait = std::make_shared<WaitState_t>();
+	wait->objects.push_back(section);
+	wait->criticalSection = true;
+	wait->timeoutStatus = STATUS_TIMEOUT;
+	WaitFor(wait, nullptr);
+}
+
+bool TryEnterCriticalSection(uint32_t section)
+{
+	GuestThread_t* thread = Scheduler::GetCurrentThread();
+	assert(thread);
+	return TryAcquire(section, thread->kthread);
+}
+
+void LeaveCriticalSection(uint32_t section)
+{
+	int32_t recursion = Memory::Read32(section+SECTION_RECURSION_COUNT) - 1;
+	Memory::Write32(section+SECTION_RECURSION_COUNT, recursion);
+	if (recursion > 0)
+	{
+		AtomicAdd(section+SECTION_LOCK_COUNT, -1);
+		return;
+	}
+
+	Memory::Write32(section+SECTION_OWNER, 0);
+	if (AtomicAdd(section+SECTION_LOCK_COUNT, -1) != -1)
+		SetEvent(section);
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+
+// DISPATCHER_HEADER.Type
+#define DISPATCHER_NOTIFICATION_EVENT 0
+#define DISPATCHER_SYNCHRONIZATION_EVENT 1
+#define DISPATCHER_MUTANT 2
+#define DISPATCHER_SEMAPHORE 5
+#define DISPATCHER_NOTIFICATION_TIMER 8
+#define DISPATCHER_SYNCHRONIZATION_TIMER 9
+
+#define STATUS_SUCCESS 0x00000000
+#define STATUS_WAIT_0 0x00000000
+#define STATUS_ABANDONED_WAIT_0 0x00000080
+#define STATUS_TIMEOUT 0x00000102
+#define STATUS_INVALID_PARAMETER 0xC000000D
+#define STATUS_NO_MEMORY 0xC0000017
+#define STATUS_CONFLICTING_ADDRESSES 0xC0000018
+#define STATUS_MEMORY_NOT_ALLOCATED 0xC00000A0
+#define STATUS_MUTANT_NOT_OWNED 0xC0000046
+#define STATUS_SEMAPHORE_LIMIT_EXCEEDED 0xC0000047
+
+#define MAXIMUM_WAIT_OBJECTS 64
+
+/// @brief Kernel dispatcher objects (events, semaphores, mutants, timers) and the critical sections built on them.
+/// The objects live in guest memory with the console's layout, a DISPATCHER_HEADER followed by whatever the type needs,
+/// so titles that peek at them see what they expect. What the console keeps in the header's wait list lives on the host
+/// instead: threads waiting on an object are queued under its guest address, like a futex, and get taken off their
+/// hardware thread (see Scheduler::BlockCurrent) until a signal satisfies their wait or its timeout goes off on the timer wheel.
+/// The signaller does the acquiring for them (resetting the event, taking the mutant...) and hands them the status,
+/// since their kernel call returned long ago.
+/// Timeouts are NT's: nullptr waits forever, zero polls, negative is relative in 100ns units and positive an absolute system time
+namespace Dispatcher
+{
+
+void InitializeHeader(uint32_t object, uint8_t type, int32_t signalState);
+
+/// @brief Acquires `object` for the calling guest thread, waiting for it to be signalled if need be
+/// @return The status the wait ends with, for the kernel call to return. If the thread had to be switched out,
+/// it's the wakeup that gets to return the real one
+uint32_t Wait(uint32_t object, const int64_t* timeout);
+/// @brief Waits for any one of `objects` (STATUS_WAIT_0 + its index), or all of them at once
+uint32_t WaitMultiple(const uint32_t* objects, int count, bool waitAll, const int64_t* timeout);
+/// @brief Sleeps the calling guest thread, a zero interval just gives up the rest of its quantum
+uint32_t Delay(int64_t interval);
+
+/// @return The previous signal state
+int32_t SetEvent(uint32_t event);
+int32_t ResetEvent(uint32_t event);
+/// @brief Signals a notification event just long enough to release whoever is waiting on it now
+int32_t PulseEvent(uint32_t event);
+
+/// @param previous Set to the count before the release
+uint32_t ReleaseSemaphore(uint32_t semaphore, int32_t adjustment, int32_t& previous);
+/// @param previous Set to the signal state before the release
+uint32_t ReleaseMutant(uint32_t mutant, int32_t& previous);
+
+/// @brief Arms a KTIMER, re-arming it if it's set already. When it goes off it's signalled, and `dpc` (if any) gets queued
+/// @param period In milliseconds, zero for a one-shot
+/// @return Whether it was set already
+bool SetTimer(uint32_t timer, int64_t dueTime, uint32_t period, uint32_t dpc);
+/// @return Whether it was set
+bool CancelTimer(uint32_t timer);
+
+/// @brief The guest keeps spin count / 256 in the header's Absolute byte
+void InitializeCriticalSection(uint32_t section, uint32_t spinCount);
+void EnterCriticalSection(uint32_t section);
+bool TryEnterCriticalSection(uint32_t section);
+void LeaveCriticalSection(uint32_t section);
+
+}
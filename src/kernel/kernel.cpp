@@ -1,12 +1,32 @@
 #include <kernel/kernel.h>
 #include <kernel/Module.h>
 #include <unordered_map>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
 
 namespace Kernel
 {
 
+typedef struct
+{
+	IModule* module; // nullptr if the library isn't loaded
+	std::string library;
+	ExportHandler_t handler; // nullptr if the module doesn't have the export
+	uint32_t ordinal;
+} Thunk_t;
+
 std::unordered_map<std::string, IModule*> modules;
 
+// Written once when bound and never moved, so calls can index it while another image is being loaded
+static Thunk_t thunks[KERNEL_MAX_THUNKS];
+static std::atomic<uint32_t> thunkCount;
+static std::map<std::pair<IModule*, uint32_t>, uint32_t> boundThunks; // Every image importing the same export shares its thunk
+static std::map<std::pair<std::string, uint32_t>, uint32_t> missingThunks; // Same for libraries that aren't loaded
+static std::mutex bindLock;
+
 void RegisterModuleForName(const char *name, IModule *mod)
 {
 	printf("Registering module \"%s\"\n", name);
@@ -18,4 +38,59 @@ IModule *GetModuleByName(const char *name)
 	return modules[name];
 }
 
-}
\ No newline at end of file
+/// @brief Bound to exports the module knows the name of but doesn't implement, they were reported when bound
+static void Unimplemented(IModule*, CPUThread&)
+{
+}
+
+uint32_t BindThunk(IModule *module, uint32_t ordinal)
+{
+	std::lock_guard<std::mutex> guard(bindLock);
+
+	auto it = boundThunks.find({module, ordinal});
+	if (it != boundThunks.end())
+		return it->second;
+
+	uint32_t id = thunkCount.load(std::memory_order_relaxed);
+	if (id == KERNEL_MAX_THUNKS)
+	{
+		printf("Ran out of kernel thunks binding %s ordinal 0x%x\n", module->GetName().c_str(), ordinal);
+		exit(1);
+	}
+
+	Thunk_t& thunk = thunks[id];
+	thunk.module = module;
+	thunk.ordinal = ordinal;
+	thunk.handler = nullptr;
+
+	const Export_t* exp = module->LookupExport(ordinal);
+	if (!exp || exp->kind != EXPORT_FUNCTION)
+		printf("WARN: Import of unknown %s function with ordinal 0x%x\n", module->GetName().c_str(), ordinal);
+	else if (!exp->handler)
+	{
+		printf("WARN: Import of unimplemented function %s\n", exp->name);
+		thunk.handler = Unimplemented;
+	}
+	else
+		thunk.handler = exp->handler;
+
+	boundThunks[{module, ordinal}] = id;
+	thunkCount.store(id + 1, std::memory_order_release);
+	return id;
+}
+
+void CallThunk(uint32_t id, CPUThread &caller)
+{
+	if (id >= thunkCount.load(std::memory_order_acquire) || !thunks[id].handler)
+	{
+		if (id < thunkCount.load(std::memory_order_acquire))
+			printf("Unknown %s function called with ordinal 0x%08x\n", thunks[id].library.c_str(), thunks[id].ordinal);
+		else
+			printf("Kernel call through unbound thunk %d\n", id);
+		exit(1);
+	}
+
+	thunks[id].handler(thunks[id].module, caller);
+}
+
+}
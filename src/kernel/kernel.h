@@ -1,6 +1,13 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
+
 class IModule;
+class CPUThread;
+
+// Thunk ids go in r11 through a `li`, which sign extends, so they have to stay below 0x8000
+#define KERNEL_MAX_THUNKS 0x1000
 
 namespace Kernel
 {
@@ -8,4 +15,13 @@ namespace Kernel
 void RegisterModuleForName(const char* name, IModule* mod);
 IModule* GetModuleByName(const char* name);
 
-}
\ No newline at end of file
+/// @brief Resolves an import of `module` by ordinal to a slot in the thunk table, once, when the image is loaded.
+/// Imports the module doesn't know are reported here, the thunk only fails if the guest actually calls it
+/// @return The thunk id for the stub to load into r11 before its `sc`
+uint32_t BindThunk(IModule* module, uint32_t ordinal);
+/// @brief Like BindThunk, for imports from a library that isn't loaded. The image still loads, calling the thunk is fatal
+uint32_t BindMissingThunk(const std::string& library, uint32_t ordinal);
+/// @brief Runs the handler bound to `id`, what a kernel call's `sc` comes down to
+void CallThunk(uint32_t id, CPUThread& caller);
+
+}
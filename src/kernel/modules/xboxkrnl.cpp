@@ -8,12 +8,18 @@
 #include <sys/time.h>
 #include <time.h>
 #include <fstream>
+#include <algorithm>
 #include <vfs/VFS.h>
 
 #include <memory/memory.h>
+#include <memory/vmm.h>
+#include <memory/physical.h>
+#include <kernel/pool.h>
 #include <loader/xex.h>
-
-#define KE_UNIMPLEMENTED(x) printf("WARN: Call to unimplemented/unknown function " x "\n"); return;
+#include <loader/mappedfile.h>
+#include <kernel/scheduler.h>
+#include <kernel/dispatcher.h>
+#include <kernel/timerwheel.h>
 
 long long timeInMilliseconds(void) {
     struct timeval tv;
@@ -24,213 +30,140 @@ long long timeInMilliseconds(void) {
 
 XboxKrnlModule krnlModule;
 
-int arg_index = 0;
-uint64_t GetNextArg(cpuState_t& state)
-{
-	if (arg_index <= 5)
-	{
-		return state.regs[3+arg_index++];
-	}
-
-	printf("TODO: Stack args\n");
-	exit(1);
-}
-
 XboxKrnlModule::XboxKrnlModule()
 : IModule("xboxkrnl.exe")
 {
 }
 
+// Sorted by ordinal. Variables' names aren't known, only that they're not functions
+const Export_t XboxKrnlModule::exportTable[] =
+{
+	{0x003, EXPORT_FUNCTION, "DbgPrint", &Bind<&XboxKrnlModule::DbgPrint>},
+	{0x009, EXPORT_FUNCTION, "ExAllocatePool", &Bind<&XboxKrnlModule::ExAllocatePool>},
+	{0x00A, EXPORT_FUNCTION, "ExAllocatePoolWithTag", &Bind<&XboxKrnlModule::ExAllocatePoolWithTag>},
+	{0x00B, EXPORT_FUNCTION, "ExAllocatePoolTypeWithTag", &Bind<&XboxKrnlModule::ExAllocatePoolTypeWithTag>},
+	{0x00C, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x00E, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x00F, EXPORT_FUNCTION, "ExFreePool", &Bind<&XboxKrnlModule::ExFreePool>},
+	{0x010, EXPORT_FUNCTION, "ExGetXConfigSetting", &Bind<&XboxKrnlModule::ExGetXConfigSetting>},
+	{0x011, EXPORT_FUNCTION, "ExInitializeReadWriteLock", &Bind<&XboxKrnlModule::ExInitializeReadWriteLock>},
+	{0x012, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x015, EXPORT_FUNCTION, "ExRegisterTitleTerminationNotification", &Bind<&XboxKrnlModule::ExRegisterTitleTerminationNotification>},
+	{0x017, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x01B, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x01C, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x036, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x03A, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x03E, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x04D, EXPORT_FUNCTION, "KeAcquireSpinLockAtRaisedIrql", &Bind<&XboxKrnlModule::KeAcquireSpinLockAtRaisedIrql>},
+	{0x054, EXPORT_FUNCTION, "KeCancelTimer", &Bind<&XboxKrnlModule::KeCancelTimer>},
+	{0x059, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x05A, EXPORT_FUNCTION, "KeDelayExecutionThread", &Bind<&XboxKrnlModule::KeDelayExecutionThread>},
+	{0x05F, EXPORT_FUNCTION, "KeEnterCriticalRegion", &Bind<&XboxKrnlModule::KeEnterCriticalRegion>},
+	{0x066, EXPORT_FUNCTION, "KeGetCurrentProcessType", &Bind<&XboxKrnlModule::KeGetCurrentProcessType>},
+	{0x06F, EXPORT_FUNCTION, "KeInitializeDPC", &Bind<&XboxKrnlModule::KeInitializeDPC>},
+	{0x070, EXPORT_FUNCTION, "KeInitializeEvent", &Bind<&XboxKrnlModule::KeInitializeEvent>},
+	{0x072, EXPORT_FUNCTION, "KeInitializeMutant", &Bind<&XboxKrnlModule::KeInitializeMutant>},
+	{0x074, EXPORT_FUNCTION, "KeInitializeSemaphore", &Bind<&XboxKrnlModule::KeInitializeSemaphore>},
+	{0x075, EXPORT_FUNCTION, "KeInitializeTimerEx", &Bind<&XboxKrnlModule::KeInitializeTimerEx>},
+	{0x07B, EXPORT_FUNCTION, "KeInsertQueueDpc", &Bind<&XboxKrnlModule::KeInsertQueueDpc>},
+	{0x07D, EXPORT_FUNCTION, "KeLeaveCriticalRegion", &Bind<&XboxKrnlModule::KeLeaveCriticalRegion>},
+	{0x07F, EXPORT_FUNCTION, "KePulseEvent", &Bind<&XboxKrnlModule::KePulseEvent>},
+	{0x083, EXPORT_FUNCTION, "KeQueryPerformanceCounter", &Bind<&XboxKrnlModule::KeQueryPerformanceCounter>},
+	{0x084, EXPORT_FUNCTION, "KeQuerySystemTime", &Bind<&XboxKrnlModule::KeQuerySystemTime>},
+	{0x085, EXPORT_FUNCTION, "KeRaiseIrqlToDPC", &Bind<&XboxKrnlModule::KeRaiseIrqlToDPC>},
+	{0x087, EXPORT_FUNCTION, "KeReleaseMutant", &Bind<&XboxKrnlModule::KeReleaseMutant>},
+	{0x088, EXPORT_FUNCTION, "KeReleaseSemaphore", &Bind<&XboxKrnlModule::KeReleaseSemaphore>},
+	{0x089, EXPORT_FUNCTION, "KeReleaseSpinLockAtRaisedIrql", &Bind<&XboxKrnlModule::KeReleaseSpinLockAtRaisedIrql>},
+	{0x08F, EXPORT_FUNCTION, "KeRemoveQueueDpc", &Bind<&XboxKrnlModule::KeRemoveQueueDpc>},
+	{0x090, EXPORT_FUNCTION, "KeResetEvent", &Bind<&XboxKrnlModule::KeResetEvent>},
+	{0x09E, EXPORT_FUNCTION, "KeSetEvent", &Bind<&XboxKrnlModule::KeSetEvent>},
+	{0x0A6, EXPORT_FUNCTION, "KeSetTimer", &Bind<&XboxKrnlModule::KeSetTimer>},
+	{0x0A7, EXPORT_FUNCTION, "KeSetTimerEx", &Bind<&XboxKrnlModule::KeSetTimerEx>},
+	{0x0AD, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x0AF, EXPORT_FUNCTION, "KeWaitForMultipleObjects", &Bind<&XboxKrnlModule::KeWaitForMultipleObjects>},
+	{0x0B0, EXPORT_FUNCTION, "KeWaitForSingleObject", &Bind<&XboxKrnlModule::KeWaitForSingleObject>},
+	{0x0B4, EXPORT_FUNCTION, "KfReleaseSpinLock", &Bind<&XboxKrnlModule::KfReleaseSpinLock>},
+	{0x0B5, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x0BA, EXPORT_FUNCTION, "MmAllocatePhysicalMemory", &Bind<&XboxKrnlModule::MmAllocatePhysicalMemory>},
+	{0x0BE, EXPORT_FUNCTION, "MmFreePhysicalMemory", &Bind<&XboxKrnlModule::MmFreePhysicalMemory>},
+	{0x0C5, EXPORT_FUNCTION, "MmQueryAllocationSize", &Bind<&XboxKrnlModule::MmQueryAllocationSize>},
+	{0x0CB, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x0CC, EXPORT_FUNCTION, "NtAllocateVirtualMemory", &Bind<&XboxKrnlModule::NtAllocateVirtualMemory>},
+	{0x0D2, EXPORT_FUNCTION, "NtCreateFile", &Bind<&XboxKrnlModule::NtCreateFile>},
+	{0x0DC, EXPORT_FUNCTION, "NtFreeVirtualMemory", &Bind<&XboxKrnlModule::NtFreeVirtualMemory>},
+	{0x0E7, EXPORT_FUNCTION, "NtQueryFullAttributesFile", &Bind<&XboxKrnlModule::NtQueryFullAttributesFile>},
+	{0x0EE, EXPORT_FUNCTION, "NtQueryVirtualMemory", &Bind<&XboxKrnlModule::NtQueryVirtualMemory>},
+	{0x106, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x112, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x113, EXPORT_FUNCTION, "ObTranslateSymbolicLink", &Bind<&XboxKrnlModule::ObTranslateSymbolicLink>},
+	{0x125, EXPORT_FUNCTION, "RtlEnterCriticalSection", &Bind<&XboxKrnlModule::RtlEnterCriticalSection>},
+	{0x12C, EXPORT_FUNCTION, "RtlInitAnsiString", &Bind<&XboxKrnlModule::RtlInitAnsiString>},
+	{0x12E, EXPORT_FUNCTION, "RtlInitializeCriticalSection", &Bind<&XboxKrnlModule::RtlInitializeCriticalSection>},
+	{0x12F, EXPORT_FUNCTION, "RtlInitializeCriticalSectionAndSpinCount", &Bind<&XboxKrnlModule::RtlInitializeCriticalSectionAndSpinCount>},
+	{0x130, EXPORT_FUNCTION, "RtlLeaveCriticalSection", &Bind<&XboxKrnlModule::RtlLeaveCriticalSection>},
+	{0x13A, EXPORT_FUNCTION, "_snprintf", &Bind<&XboxKrnlModule::_snprintf>},
+	{0x140, EXPORT_FUNCTION, "RltTimeToTimeFields", &Bind<&XboxKrnlModule::RltTimeToTimeFields>},
+	{0x141, EXPORT_FUNCTION, "RtlTryEnterCriticalSection", &Bind<&XboxKrnlModule::RtlTryEnterCriticalSection>},
+	{0x152, EXPORT_FUNCTION, "KeAllocTLS", &Bind<&XboxKrnlModule::KeAllocTLS>},
+	{0x154, EXPORT_FUNCTION, "KeTlsGetValue", &Bind<&XboxKrnlModule::KeTlsGetValue>},
+	{0x156, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x157, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x158, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x193, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x195, EXPORT_FUNCTION, "XexGetModuleHandle", &Bind<&XboxKrnlModule::XexGetModuleHandle>},
+	{0x199, EXPORT_FUNCTION, "XexLoadImage", &Bind<&XboxKrnlModule::XexLoadImage>},
+	{0x1AA, EXPORT_FUNCTION, "ExDebugMonitorServices", nullptr},
+	{0x1AE, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x1AF, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x1BE, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x1BF, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x1C0, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x1C1, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x20D, EXPORT_FUNCTION, "DrvSetUserBindingCallback", nullptr},
+	{0x25C, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x266, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x26B, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x26D, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x26E, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x28A, EXPORT_FUNCTION, "NtAllocateEncryptedMemory", &Bind<&XboxKrnlModule::NtAllocateEncryptedMemory>},
+	{0x28F, EXPORT_FUNCTION, "DrvSetDeviceConfigChangeCallback", nullptr},
+	{0x2AB, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x2DB, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x2DC, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x2F1, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x328, EXPORT_FUNCTION, "DrvSetMicArrayStartCallback", nullptr},
+	{0x334, EXPORT_FUNCTION, "EtxProducerRegister", nullptr},
+	{0x345, EXPORT_VARIABLE, nullptr, nullptr},
+	{0x35B, EXPORT_FUNCTION, "DrvSetAudioLatencyCallback", nullptr},
+	{0x386, EXPORT_FUNCTION, "XInputdSetFailedConnectionOrBindCallback", nullptr},
+};
+
 void XboxKrnlModule::Initialize()
 {
 	Kernel::RegisterModuleForName(GetName().c_str(), this);
+
+	exportsByOrdinal.assign(exportTable[sizeof(exportTable) / sizeof(exportTable[0]) - 1].ordinal + 1, nullptr);
+	for (auto& exp : exportTable)
+		exportsByOrdinal[exp.ordinal] = &exp;
+
 	modHandle = 0x10000000; // One below the lowest XEX module handle, to avoid conflicts
 }
 
-void XboxKrnlModule::CallFunctionByOrdinal(uint32_t ordinal, CPUThread &caller)
+const Export_t* XboxKrnlModule::LookupExport(uint32_t ordinal)
 {
-	switch (ordinal)
-	{
-	case 0x03:
-		DbgPrint(caller);
-		return;
-	case 0x0A:
-		ExAllocatePoolWithTag(caller);
-		return;
-	case 0x10:
-		ExGetXConfigSetting(caller);
-		return;
-	case 0x11:
-		ExInitializeReadWriteLock(caller);
-		return;
-	case 0x15:
-		ExRegisterTitleTerminationNotification(caller);
-		return;
-	case 0x4D:
-		KeAcquireSpinLockAtRaisedIrql(caller);
-		return;
-	case 0x5F:
-		KeEnterCriticalRegion(caller);
-		return;
-	case 0x66:
-		KeGetCurrentProcessType(caller);
-		return;
-	case 0x6F:
-		KeInitializeDPC(caller);
-		return;
-	case 0x74:
-		KeInitializeSemaphore(caller);
-		return;
-	case 0x75:
-		KeInitializeTimerEx(caller);
-		return;
-	case 0x7D:
-		KeLeaveCriticalRegion(caller);
-		return;
-	case 0x83:
-		KeQueryPerformanceCounter(caller);
-		return;
-	case 0x84:
-		KeQuerySystemTime(caller);
-		return;
-	case 0x85:
-		KeRaiseIrqlToDPC(caller);
-		return;
-	case 0x89:
-		KeLeaveCriticalRegion(caller);
-		return;
-	case 0xB4:
-		KfReleaseSpinLock(caller);
-		return;
-	case 0xBA:
-		MmAllocatePhysicalMemory(caller);
-		return;
-	case 0xc5:
-		MmQueryAllocationSize(caller);
-		return;
-	case 0xcc:
-		NtAllocateVirtualMemory(caller);
-		return;
-	case 0xd2:
-		NtCreateFile(caller);
-		return;
-	case 0xe7:
-		NtQueryFullAttributesFile(caller);
-		return;
-	case 0xee:
-		NtQueryVirtualMemory(caller);
-		return;
-	case 0x113:
-		ObTranslateSymbolicLink(caller);
-		return;
-	case 0x125:
-		RtlEnterCriticalSection(caller);
-		return;
-	case 0x12C:
-		RtlInitAnsiString(caller);
-		return;
-	case 0x12E:
-		RtlInitializeCriticalSection(caller);
-		return;
-	case 0x130:
-		RtlLeaveCriticalSection(caller);
-		return;
-	case 0x13A:
-		_snprintf(caller);
-		return;
-	case 0x140:
-		RltTimeToTimeFields(caller);
-		return;
-	case 0x152:
-		KeAllocTLS(caller);
-		return;
-	case 0x154:
-		KeTlsGetValue(caller);
-		return;
-	case 0x195:
-		XexGetModuleHandle(caller);
-		return;
-	case 0x199:
-		XexLoadImage(caller);
-		return;
-	case 0x1AA:
-		KE_UNIMPLEMENTED("ExDebugMonitorServices");
-	case 0x20D:
-		KE_UNIMPLEMENTED("DrvSetUserBindingCallback");
-	case 0x28F:
-		KE_UNIMPLEMENTED("DrvSetDeviceConfigChangeCallback");
-	case 0x328:
-		KE_UNIMPLEMENTED("DrvSetMicArrayStartCallback");
-	case 0x35B:
-		KE_UNIMPLEMENTED("DrvSetAudioLatencyCallback");
-	case 0x386:
-		KE_UNIMPLEMENTED("XInputdSetFailedConnectionOrBindCallback");
-	case 0x28A:
-		NtAllocateEncryptedMemory(caller);
-		return;
-	case 0x334:
-		KE_UNIMPLEMENTED("EtxProducerRegister");
-	}
-
-	printf("Unknown xboxkrnl.exe function called with ordinal 0x%08x\n", ordinal);
-	exit(1);
+	return ordinal < exportsByOrdinal.size() ? exportsByOrdinal[ordinal] : nullptr;
 }
 
 std::ofstream debug_log;
 
-bool XboxKrnlModule::IsExportVariable(uint32_t ordinal)
-{
-	switch (ordinal)
-	{
-	case 0x0000000C:
-	case 0x0000000E:
-	case 0x00000012:
-	case 0x00000017:
-	case 0x0000001B:
-	case 0x0000001C:
-	case 0x00000036:
-	case 0x0000003A:
-	case 0x0000003E:
-	case 0x00000059:
-	case 0x000000AD:
-	case 0x000000B5:
-	case 0x000000CB:
-	case 0x00000106:
-	case 0x00000112:
-	case 0x00000156:
-	case 0x00000157:
-	case 0x00000158:
-	case 0x00000193:
-	case 0x000001AE:
-	case 0x000001AF:
-	case 0x000001BE:
-	case 0x000001BF:
-	case 0x000001C0:
-	case 0x000001C1:
-	case 0x0000025C:
-	case 0x00000266:
-	case 0x0000026B:
-	case 0x0000026D:
-	case 0x0000026E:
-	case 0x000002AB:
-	case 0x000002DB:
-	case 0x000002DC:
-	case 0x000002F1:
-	case 0x00000345:
-		return true;
-	}
-
-	return false;
-}
-
-void XboxKrnlModule::DbgPrint(CPUThread &caller)
+void XboxKrnlModule::DbgPrint(GuestString fmtStr, VarArgs args)
 {
 	if (!debug_log.is_open())
 		debug_log.open("debug.log");
 
-	arg_index = 0;
-	uint32_t srcPtr = GetNextArg(caller.GetState());
-	char* fmt = (char*)Memory::GetRawPtrForAddr(srcPtr);
+	std::string format = fmtStr.Str();
+	const char* fmt = format.c_str();
 
 	bool exitFmt = false;
 	char fill_char;
@@ -252,7 +185,7 @@ void XboxKrnlModule::DbgPrint(CPUThread &caller)
 				case 'x':
 				case 'X':
 				{
-					uint32_t hex = GetNextArg(caller.GetState());
+					uint32_t hex = args.Next();
 					int digit_count = 0;
 					uint32_t num = hex;
 					while (num)
@@ -286,34 +219,45 @@ void XboxKrnlModule::DbgPrint(CPUThread &caller)
 	}
 }
 
-void XboxKrnlModule::ExAllocatePoolWithTag(CPUThread &caller)
+uint32_t XboxKrnlModule::ExAllocatePool(uint32_t size)
 {
-	arg_index = 0;
-	uint64_t size = GetNextArg(caller.GetState());
-	uint32_t tag = GetNextArg(caller.GetState());
+	printf("ExAllocatePool(0x%08x)\n", size);
 
-	printf("ExAllocatePoolWithTag(0x%08lx, 0x%08x)\n", size, tag);
+	return Pool::Allocate(size, POOL_TAG_NONE);
+}
+
+uint32_t XboxKrnlModule::ExAllocatePoolWithTag(uint32_t size, uint32_t tag)
+{
+	printf("ExAllocatePoolWithTag(0x%08x, 0x%08x)\n", size, tag);
+
+	return Pool::Allocate(size, tag);
+}
 
-	caller.GetState().regs[3] = Memory::VirtAllocMemoryRange(0x3A000000, 0x3FBEFFFF, size);
-	Memory::AllocMemory(caller.GetState().regs[3], size);
+uint32_t XboxKrnlModule::ExAllocatePoolTypeWithTag(uint32_t size, uint32_t tag, uint32_t type)
+{
+	printf("ExAllocatePoolTypeWithTag(0x%08x, 0x%08x, %d)\n", size, tag, type);
+
+	// There's only the one pool
+	return Pool::Allocate(size, tag);
 }
 
-void XboxKrnlModule::ExGetXConfigSetting(CPUThread &caller)
+void XboxKrnlModule::ExFreePool(uint32_t addr)
 {
-	arg_index = 0;
-	uint16_t category = GetNextArg(caller.GetState());
-	uint16_t setting = GetNextArg(caller.GetState());
-	uint32_t bufPtr = GetNextArg(caller.GetState());
-	uint16_t bufSize = GetNextArg(caller.GetState());
-	uint32_t reqSizePtr = GetNextArg(caller.GetState());
+	printf("ExFreePool(0x%08x)\n", addr);
 
-	uint64_t result = 0;
+	if (!Pool::Free(addr))
+		printf("WARNING: 0x%08x isn't a pool allocation\n", addr);
+}
+
+int32_t XboxKrnlModule::ExGetXConfigSetting(uint16_t category, uint16_t setting, GuestPtr<uint8_t> buf, uint16_t bufSize, GuestPtr<uint16_t> reqSize)
+{
+	int32_t result = 0;
 
 	switch (category)
 	{
 	case 0xb:
 	{
-		result = (uint64_t)-1LL;
+		result = -1;
 		break;
 	}
 	default:
@@ -321,28 +265,23 @@ void XboxKrnlModule::ExGetXConfigSetting(CPUThread &caller)
 		exit(1);
 	}
 
-	caller.GetState().regs[3] = result;
+	printf("ExGetXConfigSetting(%d, %d, 0x%08x, %d, 0x%08x)\n", category, setting, buf.Addr(), bufSize, reqSize.Addr());
 
-	printf("ExGetXConfigSetting(%d, %d, 0x%08x, %d, 0x%08x)\n", category, setting, bufPtr, bufSize, reqSizePtr);
+	return result;
 }
 
-void XboxKrnlModule::ExInitializeReadWriteLock(CPUThread &caller)
+void XboxKrnlModule::ExInitializeReadWriteLock(GuestPtr<uint32_t> lock)
 {
-	uint32_t outPtr = caller.GetState().regs[3];
+	lock.At(0).Write((uint32_t)-1);
+	lock.At(1).Write(0);
+	lock.At(2).Write(0);
+	lock.At(3).Write(0);
 
-	Memory::Write32(outPtr+0x00, (uint32_t)-1);
-	Memory::Write32(outPtr+0x04, 0);
-	Memory::Write32(outPtr+0x08, 0);
-	Memory::Write32(outPtr+0x0C, 0);
-
-	printf("ExInitializeReadWriteLock(0x%08x)\n", outPtr);
+	printf("ExInitializeReadWriteLock(0x%08x)\n", lock.Addr());
 }
 
-void XboxKrnlModule::ExRegisterTitleTerminationNotification(CPUThread &caller)
+void XboxKrnlModule::ExRegisterTitleTerminationNotification(uint32_t terminationStructPtr, uint32_t create)
 {
-	uint32_t terminationStructPtr = caller.GetState().regs[3];
-	uint32_t create = caller.GetState().regs[4];
-
 	if (create)
 	{
 		// Add notification to the kernel
@@ -355,344 +294,432 @@ void XboxKrnlModule::ExRegisterTitleTerminationNotification(CPUThread &caller)
 	printf("ExRegisterTitleTerminationNotification(0x%08x, %d)\n", terminationStructPtr, create);
 }
 
-void XboxKrnlModule::KeAcquireSpinLockAtRaisedIrql(CPUThread &caller)
+void XboxKrnlModule::KeAcquireSpinLockAtRaisedIrql(uint32_t lockPtr)
+{
+	printf("KeAcquireSpinLockAtRaisedIrql(0x%08x)\n", lockPtr);
+}
+
+bool XboxKrnlModule::KeCancelTimer(uint32_t timerPtr)
 {
-	printf("KeAcquireSpinLockAtRaisedIrql(0x%08x)\n", caller.GetState().regs[3]);
+	return Dispatcher::CancelTimer(timerPtr);
 }
 
-void XboxKrnlModule::KeEnterCriticalRegion(CPUThread &caller)
+uint32_t XboxKrnlModule::KeDelayExecutionThread([[maybe_unused]] uint32_t waitMode, [[maybe_unused]] uint32_t alertable, GuestPtr<int64_t> interval)
+{
+	return Dispatcher::Delay(interval.Read());
+}
+
+void XboxKrnlModule::KeEnterCriticalRegion()
 {
 	printf("KeEnterCriticalRegion()\n");
 }
 
-void XboxKrnlModule::KeGetCurrentProcessType(CPUThread &caller)
+uint32_t XboxKrnlModule::KeGetCurrentProcessType()
 {
 	printf("KeGetCurrentProcessType()\n");
-	caller.GetState().regs[3] = 2;
+	return 2;
 }
 
-void XboxKrnlModule::KeInitializeDPC(CPUThread &caller)
+void XboxKrnlModule::KeInitializeDPC(GuestPtr<X_KDPC> dpc, uint32_t routine, uint32_t context)
 {
-	uint32_t dpcPtr = caller.GetState().regs[3];
-	uint32_t routine = caller.GetState().regs[4];
-	uint32_t context = caller.GetState().regs[5];
+	X_KDPC* kdpc = dpc.Map();
+	kdpc->type = 19;
+	kdpc->selectedCpu = 0;
+	kdpc->desiredCpu = 0;
+	kdpc->listEntry.flink = 0;
+	kdpc->listEntry.blink = 0;
+	kdpc->routine = routine;
+	kdpc->context = context;
+	kdpc->arg1 = 0;
+	kdpc->arg2 = 0;
 
-	Memory::Write16(dpcPtr+0x00, 19); // type
-	Memory::Write8(dpcPtr+0x02, 0); // selected CPU
-	Memory::Write8(dpcPtr+0x03, 0); // desired CPU
-	Memory::Write32(dpcPtr+0x04, 0); // list_entry.flink
-	Memory::Write32(dpcPtr+0x08, 0); // list_entry.blink
-	Memory::Write32(dpcPtr+0x0C, routine);
-	Memory::Write32(dpcPtr+0x10, context);
-	Memory::Write32(dpcPtr+0x14, 0);
-	Memory::Write32(dpcPtr+0x18, 0);
+	printf("KeInitializeDPC(0x%08x, 0x%08x, 0x%08x)\n", dpc.Addr(), routine, context);
+}
+
+void XboxKrnlModule::KeInitializeEvent(uint32_t eventPtr, uint32_t type, uint32_t state)
+{
+	Dispatcher::InitializeHeader(eventPtr, type ? DISPATCHER_SYNCHRONIZATION_EVENT : DISPATCHER_NOTIFICATION_EVENT, state ? 1 : 0);
 
-	printf("KeInitializeDPC(0x%08x, 0x%08x, 0x%08x)\n", dpcPtr, routine, context);
+	printf("KeInitializeEvent(0x%08x, %d, %d)\n", eventPtr, type, state);
 }
 
-void XboxKrnlModule::KeInitializeSemaphore(CPUThread &caller)
+void XboxKrnlModule::KeInitializeMutant(GuestPtr<X_KMUTANT> mutant, uint32_t initialOwner)
 {
-	uint32_t ptr = caller.GetState().regs[3];
-	uint32_t count = caller.GetState().regs[4];
-	uint32_t limit = caller.GetState().regs[5];
+	Dispatcher::InitializeHeader(mutant.Addr(), DISPATCHER_MUTANT, initialOwner ? 0 : 1);
+	X_KMUTANT* kmutant = mutant.Map();
+	kmutant->mutantListEntry.flink = 0;
+	kmutant->mutantListEntry.blink = 0;
+	kmutant->owner = initialOwner ? Scheduler::GetCurrentThread()->kthread : 0;
+	kmutant->abandoned = 0;
 
-	Memory::Write8(ptr+0x00, 5);
-	Memory::Write8(ptr+0x01, 0);
-	Memory::Write8(ptr+0x02, 0);
-	Memory::Write8(ptr+0x03, 0);
-	Memory::Write32(ptr+0x04, count);
-	Memory::Write32(ptr+0x08, 0);
-	Memory::Write32(ptr+0x0C, 0);
-	Memory::Write32(ptr+0x10, limit);
+	printf("KeInitializeMutant(0x%08x, %d)\n", mutant.Addr(), initialOwner);
+}
+
+void XboxKrnlModule::KeInitializeSemaphore(GuestPtr<X_KSEMAPHORE> semaphore, int32_t count, int32_t limit)
+{
+	Dispatcher::InitializeHeader(semaphore.Addr(), DISPATCHER_SEMAPHORE, count);
+	semaphore.Map()->limit = limit;
 
-	printf("KeInitializeSemaphore(0x%08x,%d,%d)\n", ptr, count, limit);
+	printf("KeInitializeSemaphore(0x%08x,%d,%d)\n", semaphore.Addr(), count, limit);
 }
 
-void XboxKrnlModule::KeInitializeTimerEx(CPUThread &caller)
+void XboxKrnlModule::KeInitializeTimerEx(GuestPtr<X_KTIMER> timer, uint32_t type, uint8_t processType)
 {
-	uint32_t timerPtr = caller.GetState().regs[3];
-	uint32_t type = caller.GetState().regs[4];
-	uint32_t processType = caller.GetState().regs[5];
+	Dispatcher::InitializeHeader(timer.Addr(), type ? DISPATCHER_SYNCHRONIZATION_TIMER : DISPATCHER_NOTIFICATION_TIMER, 0);
+	X_KTIMER* ktimer = timer.Map();
+	ktimer->header.processType = processType;
+	ktimer->dueTime = 0;
+	ktimer->timerListEntry.flink = 0;
+	ktimer->timerListEntry.blink = 0;
+	ktimer->dpc = 0;
+	ktimer->period = 0;
 
-	Memory::Write8(timerPtr+0x00, type+8);
-	Memory::Write8(timerPtr+0x02, processType);
-	Memory::Write8(timerPtr+0x03, 0);
-	Memory::Write32(timerPtr+0x04, 0);
-	// Offset 0x10: KTIMER
-	Memory::Write64(timerPtr+0x10, 0);
-	Memory::Write32(timerPtr+0x34, 0);
+	printf("KeInitializeTimerEx(0x%08x)\n", timer.Addr());
+}
 
-	printf("KeInitializeTimerEx(0x%08x)\n", timerPtr);
+bool XboxKrnlModule::KeInsertQueueDpc(uint32_t dpcPtr, uint32_t arg1, uint32_t arg2)
+{
+	return Scheduler::QueueDpc(dpcPtr, arg1, arg2);
 }
 
-void XboxKrnlModule::KeLeaveCriticalRegion(CPUThread &caller)
+void XboxKrnlModule::KeLeaveCriticalRegion()
 {
 	printf("KeLeaveCriticalRegion()\n");
 }
 
-void XboxKrnlModule::KeQueryPerformanceCounter(CPUThread &caller)
+int32_t XboxKrnlModule::KePulseEvent(uint32_t eventPtr)
+{
+	return Dispatcher::PulseEvent(eventPtr);
+}
+
+uint64_t XboxKrnlModule::KeQueryPerformanceCounter()
 {
 	printf("KeQueryPerformanceCounter()\n");
-	caller.GetState().regs[3] = 50000000;
+	return 50000000;
 }
 
-void XboxKrnlModule::KeQuerySystemTime(CPUThread &caller)
+void XboxKrnlModule::KeQuerySystemTime(GuestPtr<uint64_t> time)
 {
-	uint32_t timePtr = caller.GetState().regs[3];
-	printf("KeQuerySystemTime(0x%08x)\n", timePtr);
-	Memory::Write64(timePtr, time(NULL));
+	printf("KeQuerySystemTime(0x%08x)\n", time.Addr());
+	time.Write(TimerWheel::SystemTime());
 }
 
-void XboxKrnlModule::KeRaiseIrqlToDPC(CPUThread &caller)
+uint8_t XboxKrnlModule::KeRaiseIrqlToDPC(CPUThread &caller)
 {
 	uint8_t old_irql = Memory::Read8(caller.GetState().pcr_address+0x18);
 	Memory::Write8(caller.GetState().pcr_address+0x18, 2);
-	caller.GetState().regs[3] = old_irql;
 	printf("KeRaiseIrqlToDPC()\n");
+	return old_irql;
+}
+
+int32_t XboxKrnlModule::KeReleaseMutant(uint32_t mutantPtr)
+{
+	int32_t previous;
+	if (Dispatcher::ReleaseMutant(mutantPtr, previous) != STATUS_SUCCESS)
+		printf("KeReleaseMutant(0x%08x): not owned by the caller\n", mutantPtr);
+
+	return previous;
+}
+
+int32_t XboxKrnlModule::KeReleaseSemaphore(uint32_t semaphorePtr, [[maybe_unused]] int32_t increment, int32_t adjustment)
+{
+	int32_t previous;
+	if (Dispatcher::ReleaseSemaphore(semaphorePtr, adjustment, previous) != STATUS_SUCCESS)
+		printf("KeReleaseSemaphore(0x%08x, %d): limit exceeded\n", semaphorePtr, adjustment);
+
+	return previous;
+}
+
+void XboxKrnlModule::KeReleaseSpinLockAtRaisedIrql(uint32_t lockPtr)
+{
+	printf("KeReleaseSpinLockAtRaisedIrql(0x%08x)\n", lockPtr);
+}
+
+bool XboxKrnlModule::KeRemoveQueueDpc(uint32_t dpcPtr)
+{
+	return Scheduler::RemoveDpc(dpcPtr);
+}
+
+int32_t XboxKrnlModule::KeResetEvent(uint32_t eventPtr)
+{
+	return Dispatcher::ResetEvent(eventPtr);
 }
 
-void XboxKrnlModule::KeReleaseSpinLockAtRaisedIrql(CPUThread &caller)
+int32_t XboxKrnlModule::KeSetEvent(uint32_t eventPtr)
 {
-	printf("KeReleaseSpinLockAtRaisedIrql(0x%08x)\n", caller.GetState().regs[3]);
+	return Dispatcher::SetEvent(eventPtr);
 }
 
-void XboxKrnlModule::KfReleaseSpinLock(CPUThread &caller)
+bool XboxKrnlModule::KeSetTimer(uint32_t timerPtr, int64_t dueTime, uint32_t dpcPtr)
 {
-	printf("KfReleaseSpinLock(0x%08x)\n", caller.GetState().regs[3]);
-	Memory::Write8(caller.GetState().pcr_address+0x18, (uint8_t)caller.GetState().regs[4]);
+	return Dispatcher::SetTimer(timerPtr, dueTime, 0, dpcPtr);
 }
 
-void XboxKrnlModule::MmAllocatePhysicalMemory(CPUThread &caller)
+bool XboxKrnlModule::KeSetTimerEx(uint32_t timerPtr, int64_t dueTime, uint32_t period, uint32_t dpcPtr)
 {
-	int flags = caller.GetState().regs[3];
-	uint32_t region_size = caller.GetState().regs[4];
+	return Dispatcher::SetTimer(timerPtr, dueTime, period, dpcPtr);
+}
 
-	uint32_t base = Memory::VirtAllocMemoryRange(0xE0000000, 0xFFD00000, region_size);
-	Memory::AllocMemory(base, region_size);
+uint32_t XboxKrnlModule::KeWaitForMultipleObjects(uint32_t count, GuestPtr<uint32_t> objectsPtr, uint32_t waitType, [[maybe_unused]] uint32_t waitReason, [[maybe_unused]] uint32_t waitMode, [[maybe_unused]] uint32_t alertable, GuestPtr<int64_t> timeoutPtr)
+{
+	if (!count || count > MAXIMUM_WAIT_OBJECTS)
+		return STATUS_INVALID_PARAMETER;
 
-	caller.GetState().regs[3] = base;
+	uint32_t objects[MAXIMUM_WAIT_OBJECTS];
+	for (uint32_t i = 0; i < count; i++)
+		objects[i] = objectsPtr.At(i).Read();
+
+	int64_t timeout = timeoutPtr ? timeoutPtr.Read() : 0;
+
+	// WaitType 0 is WaitAll, 1 is WaitAny
+	return Dispatcher::WaitMultiple(objects, count, waitType == 0, timeoutPtr ? &timeout : nullptr);
+}
+
+uint32_t XboxKrnlModule::KeWaitForSingleObject(uint32_t objectPtr, [[maybe_unused]] uint32_t waitReason, [[maybe_unused]] uint32_t waitMode, [[maybe_unused]] uint32_t alertable, GuestPtr<int64_t> timeoutPtr)
+{
+	int64_t timeout = timeoutPtr ? timeoutPtr.Read() : 0;
 
+	return Dispatcher::Wait(objectPtr, timeoutPtr ? &timeout : nullptr);
+}
+
+void XboxKrnlModule::KfReleaseSpinLock(CPUThread &caller, uint32_t lockPtr, uint8_t oldIrql)
+{
+	printf("KfReleaseSpinLock(0x%08x)\n", lockPtr);
+	Memory::Write8(caller.GetState().pcr_address+0x18, oldIrql);
+}
+
+uint32_t XboxKrnlModule::MmAllocatePhysicalMemory(uint32_t flags, uint32_t regionSize, uint32_t protect, uint32_t minAddr, uint32_t maxAddr, uint32_t alignment)
+{
 	printf("MmAllocatePhysicalMemory(%d, 0x%08x, 0x%x, 0x%08x, 0x%08x, 0x%08x)\n", 
-			flags, (uint32_t)caller.GetState().regs[4], 
-			(uint32_t)caller.GetState().regs[5], (uint32_t)caller.GetState().regs[6], 
-			(uint32_t)caller.GetState().regs[7], (uint32_t)caller.GetState().regs[8]);
+			flags, regionSize, protect, minAddr, maxAddr, alignment);
+
+	if (!(protect & (PAGE_READONLY | PAGE_READWRITE)))
+		return 0;
+
+	// The page size picks the alias it's mapped in
+	uint32_t pageSize = 4*1024;
+	if (protect & MEM_LARGE_PAGES)
+		pageSize = 64*1024;
+	else if (protect & MEM_16MB_PAGES)
+		pageSize = 16*1024*1024;
+
+	return Physical::Allocate(regionSize, pageSize, minAddr, maxAddr, alignment, protect & ~(MEM_LARGE_PAGES | MEM_16MB_PAGES));
 }
 
-void XboxKrnlModule::MmQueryAllocationSize(CPUThread &caller)
+void XboxKrnlModule::MmFreePhysicalMemory(uint32_t type, uint32_t baseAddr)
+{
+	printf("MmFreePhysicalMemory(%d, 0x%08x)\n", type, baseAddr);
+
+	if (!Physical::Free(baseAddr))
+		printf("WARNING: 0x%08x isn't a physical allocation\n", baseAddr);
+}
+
+uint32_t XboxKrnlModule::MmQueryAllocationSize(uint32_t base)
 {
-	uint32_t base = caller.GetState().regs[3];
-	AllocInfo info;
-	uint32_t size = 0;
-	if (Memory::GetAllocInfo(base, info))
-		size = info.regionSize;
-	caller.GetState().regs[3] = size;
 	printf("MmQueryAllocationSize(0x%08x)\n", base);
+	return VMM::AllocationSize(base);
 }
 
-// TODO: Make this not suck
-void XboxKrnlModule::NtAllocateVirtualMemory(CPUThread &caller)
+uint32_t XboxKrnlModule::NtAllocateVirtualMemory(GuestPtr<uint32_t> baseAddr, GuestPtr<uint32_t> regionSizePtr, uint32_t allocType, uint32_t protect)
 {
-	uint32_t region_size_ptr = caller.GetState().regs[4];
-	uint32_t out_addr_ptr = caller.GetState().regs[3];
-	uint32_t alloc_type = caller.GetState().regs[5];
+	uint32_t regionSize = regionSizePtr.Read();
+	uint32_t addr = baseAddr.Read();
+
+	if (!regionSize || !(allocType & (MEM_RESERVE | MEM_COMMIT)))
+		return STATUS_INVALID_PARAMETER;
 
-	uint32_t region_size = Memory::Read32(region_size_ptr);
+	// 64 KB pages come from their own range
+	bool largePages = allocType & MEM_LARGE_PAGES;
+	uint32_t pageSize = largePages ? VMM_LARGE_PAGE_SIZE : VMM_PAGE_SIZE;
+	regionSize = (regionSize + pageSize - 1) & ~(pageSize - 1);
 
-	uint32_t addr = Memory::Read32(out_addr_ptr);
-	if (!addr)
+	// Committing with no address reserves too
+	if ((allocType & MEM_RESERVE) || !addr)
 	{
-		if (alloc_type & 0x20000000)
-			addr = Memory::VirtAllocMemoryRange(0x7A000000, 0x7EFFFFFF, region_size);
+		if (addr)
+		{
+			addr &= ~(pageSize - 1);
+			if (!VMM::ReserveAt(addr, regionSize, protect))
+				return STATUS_CONFLICTING_ADDRESSES;
+		}
 		else
-			addr = Memory::VirtAllocMemoryRange(0x20000000, 0x2FFFFFFF, region_size);
+		{
+			bool topDown = allocType & MEM_TOP_DOWN;
+			if (largePages)
+				addr = VMM::Reserve(0x7A000000, 0x7F000000, regionSize, pageSize, topDown, protect);
+			else
+				addr = VMM::Reserve(0x20000000, 0x30000000, regionSize, pageSize, topDown, protect);
+			if (!addr)
+				return STATUS_NO_MEMORY;
+		}
 	}
-	Memory::AllocMemory(addr, region_size);
 
-	Memory::Write32(out_addr_ptr, addr);
+	if ((allocType & MEM_COMMIT) && !VMM::Commit(addr, regionSize, protect))
+		return STATUS_CONFLICTING_ADDRESSES;
+
+	baseAddr.Write(addr);
+	regionSizePtr.Write(regionSize);
 
-	printf("NtAllocateVirtualMemory(0x%08lx, 0x%08x, 0x%08x) = 0x%08x\n", caller.GetState().regs[3], region_size, out_addr_ptr, addr);
+	printf("NtAllocateVirtualMemory(0x%08x, 0x%08x, 0x%x) = 0x%08x\n", baseAddr.Addr(), regionSize, allocType, addr);
 
-	caller.GetState().regs[3] = 0;
+	return STATUS_SUCCESS;
 }
 
-void XboxKrnlModule::NtCreateFile(CPUThread &caller)
+uint32_t XboxKrnlModule::NtCreateFile([[maybe_unused]] GuestPtr<uint32_t> handleOut, [[maybe_unused]] uint32_t desiredAccess, GuestPtr<X_OBJECT_ATTRIBUTES> objectAttrs, [[maybe_unused]] uint32_t ioStatusPtr, uint32_t allocSizePtr)
 {
-	arg_index = 0;
-	uint32_t handleOut = GetNextArg(caller.GetState());
-	uint32_t desiredAccess = GetNextArg(caller.GetState());
-	uint32_t objectAttrsPtr = GetNextArg(caller.GetState());
-	uint32_t ioStatusPtr = GetNextArg(caller.GetState());
-	uint32_t allocSizeptr = GetNextArg(caller.GetState());
+	assert(allocSizePtr == 0);
 
-	assert(allocSizeptr == 0);
+	if (!objectAttrs)
+		return 0xC000000D;
 
-	if (!objectAttrsPtr)
+	const X_ANSI_STRING* name = GuestPtr<X_ANSI_STRING>(objectAttrs.View()->name).View();
+	std::string path = GuestString(name->buffer).Str();
+
+	printf("Opening file \"%s\"\n", path.c_str());
+	return (uint32_t)-1U;
+}
+
+uint32_t XboxKrnlModule::NtFreeVirtualMemory(GuestPtr<uint32_t> baseAddr, GuestPtr<uint32_t> regionSizePtr, uint32_t freeType)
+{
+	uint32_t addr = baseAddr.Read();
+	uint32_t regionSize = regionSizePtr.Read();
+
+	printf("NtFreeVirtualMemory(0x%08x, 0x%08x, 0x%x)\n", addr, regionSize, freeType);
+
+	VirtualRegion_t region;
+	// Physical memory only goes back through MmFreePhysicalMemory
+	if (!VMM::Query(addr, region) || region.state == MEM_FREE || region.type == MEM_PHYSICAL)
+		return STATUS_MEMORY_NOT_ALLOCATED;
+
+	if (freeType == MEM_RELEASE)
 	{
-		caller.GetState().regs[3] = 0xC000000D;
-		return;
+		// Only whole allocations can be released
+		if (regionSize || addr != region.allocationBase)
+			return STATUS_INVALID_PARAMETER;
+		regionSize = VMM::AllocationSize(addr);
+		VMM::Release(addr);
 	}
+	else if (freeType == MEM_DECOMMIT)
+	{
+		// A size of 0 means the rest of the allocation
+		if (!regionSize)
+			regionSize = region.allocationBase + VMM::AllocationSize(addr) - region.baseAddress;
+		addr = region.baseAddress;
+		if (!VMM::Decommit(addr, regionSize))
+			return STATUS_INVALID_PARAMETER;
+	}
+	else
+		return STATUS_INVALID_PARAMETER;
 
-	uint32_t namePtr = Memory::Read32(objectAttrsPtr+4);
-	const char* path = (char*)Memory::GetRawPtrForAddr(Memory::Read32(namePtr+4));
-
-	printf("Opening file \"%s\"\n", path);
-	caller.GetState().regs[3] = (uint32_t)-1U;
+	baseAddr.Write(addr);
+	regionSizePtr.Write(regionSize);
+	return STATUS_SUCCESS;
 }
 
-void XboxKrnlModule::NtQueryFullAttributesFile(CPUThread &caller)
+uint32_t XboxKrnlModule::NtQueryFullAttributesFile(GuestPtr<X_OBJECT_ATTRIBUTES> objectAttrs, uint32_t openInfo)
 {
-	arg_index = 0;
-	uint32_t objAttrPtr = GetNextArg(caller.GetState());
-	uint32_t openInfo = GetNextArg(caller.GetState());
-
-	uint32_t ansiPtr = Memory::Read32(objAttrPtr+0x4);
-	uint32_t namePtr = Memory::Read32(ansiPtr+0x04);
+	const X_ANSI_STRING* ansi = GuestPtr<X_ANSI_STRING>(objectAttrs.View()->name).View();
 
-	std::string name = (char*)Memory::GetRawPtrForAddr(namePtr);
+	std::string name = GuestString(ansi->buffer).Str();
 
-	printf("NtQueryFullAttributesFile(\"%s\" (0x%08x), 0x%08x)\n", name.c_str(), objAttrPtr, openInfo);
+	printf("NtQueryFullAttributesFile(\"%s\" (0x%08x), 0x%08x)\n", name.c_str(), objectAttrs.Addr(), openInfo);
 
 	FileHandle_t handle = VFS::OpenFile(name, OPENMODE_READ | OPENMODE_BINARY);
 	if (handle == FILE_INVALID_HANDLE)
-	{
-		caller.GetState().regs[3] = 0xC000000FL;
-		return;
-	}
+		return 0xC000000FL;
 
 	assert(0);
+	return 0;
 }
 
-void XboxKrnlModule::NtQueryVirtualMemory(CPUThread &caller)
+uint32_t XboxKrnlModule::NtQueryVirtualMemory(uint32_t baseAddr, GuestPtr<X_MEMORY_BASIC_INFORMATION> outBasicInfo)
 {
-	arg_index = 0;
-	uint32_t base_addr = GetNextArg(caller.GetState());
-	uint32_t outBasicInfoPtr = GetNextArg(caller.GetState());
-
-	printf("NtQueryVirtualMemory(0x%08x, 0x%08x)\n", base_addr, outBasicInfoPtr);
+	printf("NtQueryVirtualMemory(0x%08x, 0x%08x)\n", baseAddr, outBasicInfo.Addr());
 	
-	AllocInfo info;
-	if (!Memory::GetAllocInfo(base_addr, info))
-	{
-		caller.GetState().regs[3] = 0xC000000DL;
-		return;
-	}
+	VirtualRegion_t region;
+	if (!VMM::Query(baseAddr, region))
+		return STATUS_INVALID_PARAMETER;
 
-	Memory::Write32(outBasicInfoPtr+0x00, info.baseAddress);
-	Memory::Write32(outBasicInfoPtr+0x04, info.baseAddress);
-	Memory::Write32(outBasicInfoPtr+0x08, 0x4);
-	Memory::Write32(outBasicInfoPtr+0x0C, info.regionSize);
-	Memory::Write32(outBasicInfoPtr+0x10, 0x1000);
-	Memory::Write32(outBasicInfoPtr+0x14, 0x4);
-	Memory::Write32(outBasicInfoPtr+0x18, 0x20000);
+	X_MEMORY_BASIC_INFORMATION* basicInfo = outBasicInfo.Map();
+	basicInfo->baseAddress = region.baseAddress;
+	basicInfo->allocationBase = region.allocationBase;
+	basicInfo->allocationProtect = region.allocationProtect;
+	basicInfo->regionSize = region.regionSize;
+	basicInfo->state = region.state;
+	basicInfo->protect = region.protect;
+	basicInfo->type = region.type;
 
-	caller.GetState().regs[3] = 0;
+	return STATUS_SUCCESS;
 }
 
-void XboxKrnlModule::ObTranslateSymbolicLink(CPUThread& caller)
+uint32_t XboxKrnlModule::ObTranslateSymbolicLink()
 {
 	printf("TODO: ObTranslateSymbolicLink\n");
-	caller.GetState().regs[3] = (uint64_t)-1U;
+	return (uint32_t)-1U;
 }
 
-void XboxKrnlModule::RtlEnterCriticalSection(CPUThread &caller)
+void XboxKrnlModule::RtlEnterCriticalSection(uint32_t critPtr)
 {
-	uint32_t critPtr = caller.GetState().regs[3];
-
-	if (Memory::Read32(critPtr) != 0)
-	{
-		// TODO: Recursive locks and waiting on locks
-		printf("Critical section already entered!\n");
-		// exit(1);
-	}
-
-	Memory::Write64(critPtr, 1);
-	Memory::Write64(critPtr+0x08, 1);
-
-	caller.GetState().regs[3] = 0;
-
-	printf("RtlEnterCriticalSection(0x%08x)\n", critPtr);
+	Dispatcher::EnterCriticalSection(critPtr);
 }
 
-void XboxKrnlModule::RtlInitAnsiString(CPUThread &caller)
+void XboxKrnlModule::RtlInitAnsiString(GuestPtr<X_ANSI_STRING> dst, GuestString str)
 {
-	// WIN32 STRING struct has the following layout:
-	// USHORT Length;
-	// USHORT MaximumLength;
-	// PCHAR Buffer;
-
-	arg_index = 0;
-	
-	uint32_t dstPtr = GetNextArg(caller.GetState());
-	uint32_t strPtr = GetNextArg(caller.GetState());
-
-	if (strPtr)
+	X_ANSI_STRING* ansi = dst.Map();
+	if (str)
 	{
-		const char* str = (const char*)Memory::GetRawPtrForAddr(strPtr);
-		uint16_t len = (uint16_t)strlen(str);
-		Memory::Write16(dstPtr+0, len);
-		Memory::Write16(dstPtr+2, len+1);
-		printf("RtlInitAnsiString(0x%08x, \"%s\" (0x%08x))\n", dstPtr, str, strPtr);
+		uint16_t len = (uint16_t)str.Length();
+		ansi->length = len;
+		ansi->maximumLength = len+1;
+		printf("RtlInitAnsiString(0x%08x, \"%s\" (0x%08x))\n", dst.Addr(), str.Str().c_str(), str.Addr());
 	}
 	else
 	{
-		Memory::Write16(dstPtr+0, 0);
-		Memory::Write16(dstPtr+2, 0);
-		printf("RtlInitAnsiString(0x%08x, NULL\n", dstPtr);
+		ansi->length = 0;
+		ansi->maximumLength = 0;
+		printf("RtlInitAnsiString(0x%08x, NULL\n", dst.Addr());
 	}
-	Memory::Write32(dstPtr+4, strPtr);
+	ansi->buffer = str.Addr();
 }
 
-void XboxKrnlModule::RtlInitializeCriticalSection(CPUThread &caller)
+void XboxKrnlModule::RtlInitializeCriticalSection(uint32_t sectionPtr)
 {
-	arg_index = 0;
-	uint32_t sectionPtr = GetNextArg(caller.GetState());
-
-	Memory::Write64(sectionPtr+0x00, 0); // LockCount
-	Memory::Write64(sectionPtr+0x08, 0); // RecursionCount
-	Memory::Write32(sectionPtr+0x0C, 0); // OwningThread
-	Memory::Write64(sectionPtr+0x10, 0); // SpinCount
-
-	caller.GetState().regs[3] = 0;
+	Dispatcher::InitializeCriticalSection(sectionPtr, 0);
 
 	printf("RtlInitializeCriticalSection(0x%08x)\n", sectionPtr);
 }
 
-void XboxKrnlModule::RtlLeaveCriticalSection(CPUThread &caller)
+uint32_t XboxKrnlModule::RtlInitializeCriticalSectionAndSpinCount(uint32_t sectionPtr, uint32_t spinCount)
 {
-	uint32_t critPtr = caller.GetState().regs[3];
+	Dispatcher::InitializeCriticalSection(sectionPtr, spinCount);
 
-	Memory::Write64(critPtr, 0);
-	Memory::Write64(critPtr+0x08, 0);
+	printf("RtlInitializeCriticalSectionAndSpinCount(0x%08x, %d)\n", sectionPtr, spinCount);
 
-	caller.GetState().regs[3] = 0;
+	return 0;
+}
 
-	printf("RtlLeaveCriticalSection(0x%08x)\n", critPtr);
+void XboxKrnlModule::RtlLeaveCriticalSection(uint32_t critPtr)
+{
+	Dispatcher::LeaveCriticalSection(critPtr);
 }
 
-void XboxKrnlModule::_snprintf(CPUThread &caller)
+void XboxKrnlModule::_snprintf(uint32_t dstPtr, uint32_t dstMaxLen, GuestString fmt, VarArgs args)
 {
-	uint32_t dstPtr = caller.GetState().regs[3];
-	uint32_t dstMaxLen = caller.GetState().regs[4];
-	uint32_t sourceBuffer = caller.GetState().regs[5];
-	
 	// So, this is a bit complicated
 	// That's because of the whole va_args thing
-	char* source = (char*)Memory::GetRawPtrForAddr(sourceBuffer);
-	char* dest = (char*)Memory::GetRawPtrForAddr(dstPtr);
-	source[dstMaxLen+1] = 0;
+	std::string source = fmt.Str();
 	
-	printf("snprintf(0x%08x, %d, 0x%08x, ...)\n", dstPtr, dstMaxLen, sourceBuffer);
-	printf("(%s)\n", source);
+	printf("snprintf(0x%08x, %d, 0x%08x, ...)\n", dstPtr, dstMaxLen, fmt.Addr());
+	printf("(%s)\n", source.c_str());
 
 	bool exitFmt = false;
 	bool is_short = false;
 
-	arg_index = 3;
-
-	char* p = source, *d = dest;
-	while (*p && (d - dest) < dstMaxLen)
+	// Formatted on the host, then copied out in one go
+	std::string dest;
+	const char* p = source.c_str();
+	while (*p && dest.size() < dstMaxLen)
 	{
-		size_t remaining = dstMaxLen - (d - dest);
 		switch (*p)
 		{
 		case '%':
@@ -708,11 +735,7 @@ void XboxKrnlModule::_snprintf(CPUThread &caller)
 					break;
 				case 's':
 				{
-					uint32_t strAddr = GetNextArg(caller.GetState());
-					char* str = (char*)Memory::GetRawPtrForAddr(strAddr);
-					size_t len = strlen(str);
-					strncpy(d, str, len < remaining ? len : remaining);
-					d += len < remaining ? len : remaining;
+					dest += GuestString(args.Next()).Str();
 					exitFmt = true;
 					break;
 				}
@@ -724,61 +747,64 @@ void XboxKrnlModule::_snprintf(CPUThread &caller)
 			break;
 		}
 		default:
-			*d = *p;
+			dest += *p;
 			p++;
-			d++;
 			break;
 		}
 	}
+
+	// Like MSVC's, it's only terminated if there's room
+	if (dest.size() < dstMaxLen)
+		dest += '\0';
+	Memory::CopyFromHost(dstPtr, dest.data(), std::min<size_t>(dest.size(), dstMaxLen));
 }
 
-void XboxKrnlModule::RltTimeToTimeFields(CPUThread &caller)
+void XboxKrnlModule::RltTimeToTimeFields(GuestPtr<uint64_t> time, GuestPtr<X_TIME_FIELDS> timeFields)
 {
-	arg_index = 0;
-	uint32_t timePtr = GetNextArg(caller.GetState());
-	time_t time_val = Memory::Read64(timePtr);
-	uint32_t outPtr = GetNextArg(caller.GetState());
+	// FILETIMEs count 100ns units from 1601
+	time_t time_val = time.Read() / 10000000 - 11644473600LL;
 
 	tm* t = localtime(&time_val);
 	
-	Memory::Write16(outPtr, (t->tm_year + 1900) - 1601);
-	Memory::Write16(outPtr+2, t->tm_mon);
-	Memory::Write16(outPtr+4, t->tm_mday);
-	Memory::Write16(outPtr+6, t->tm_hour);
-	Memory::Write16(outPtr+8, t->tm_min);
-	Memory::Write16(outPtr+10, t->tm_sec);
-	Memory::Write16(outPtr+12, timeInMilliseconds() % 999);
-	Memory::Write16(outPtr+14, t->tm_wday);
+	X_TIME_FIELDS* fields = timeFields.Map();
+	fields->year = (t->tm_year + 1900) - 1601;
+	fields->month = t->tm_mon;
+	fields->day = t->tm_mday;
+	fields->hour = t->tm_hour;
+	fields->minute = t->tm_min;
+	fields->second = t->tm_sec;
+	fields->milliseconds = timeInMilliseconds() % 999;
+	fields->weekday = t->tm_wday;
 
-	printf("RltTimeToTimeFields(0x%08x, 0x%08x)\n", timePtr, outPtr);
+	printf("RltTimeToTimeFields(0x%08x, 0x%08x)\n", time.Addr(), timeFields.Addr());
+}
+
+bool XboxKrnlModule::RtlTryEnterCriticalSection(uint32_t critPtr)
+{
+	return Dispatcher::TryEnterCriticalSection(critPtr);
 }
 
-void XboxKrnlModule::KeAllocTLS(CPUThread &caller)
+uint32_t XboxKrnlModule::KeAllocTLS(CPUThread &caller)
 {
 	uint32_t addr = caller.GetState().tls_lowest_alloced;
 	caller.GetState().tls_lowest_alloced += 0x80;
 
 	printf("KeAllocTLS()\n");
 
-	caller.GetState().regs[3] = addr / 0x80;
+	return addr / 0x80;
 }
 
-void XboxKrnlModule::KeTlsGetValue(CPUThread &caller)
+uint32_t XboxKrnlModule::KeTlsGetValue(CPUThread &caller, uint32_t slot)
 {
-	uint32_t slot = caller.GetState().regs[3];
-	caller.GetState().regs[3] = Memory::Read32(caller.GetState().tls_addr+(slot-1)*0x80);
 	printf("KeTlsGetValue(%d)\n", slot);
+	return Memory::Read32(caller.GetState().tls_addr+(slot-1)*0x80);
 }
 
-void XboxKrnlModule::XexGetModuleHandle(CPUThread &caller)
+uint32_t XboxKrnlModule::XexGetModuleHandle(GuestString nameStr, GuestPtr<uint32_t> handle)
 {
-	arg_index = 0;
-	uint32_t namePtr = GetNextArg(caller.GetState());
-	uint32_t handlePtr = GetNextArg(caller.GetState());
+	std::string name = nameStr.Str();
 
-	std::string name = (char*)Memory::GetRawPtrForAddr(namePtr);
-
-	printf("XexGetModuleHandle(\"%s\", 0x%08x)\n", name.c_str(), handlePtr);
+	printf("XexGetModuleHandle(\"%s\", 0x%08x)\n", name.c_str(), handle.Addr());
 
 	auto mod = Kernel::GetModuleByName(name.c_str());
 	if (!mod)
@@ -787,37 +813,27 @@ void XboxKrnlModule::XexGetModuleHandle(CPUThread &caller)
 		exit(1);
 	}
 
-	Memory::Write32(handlePtr, mod->GetHandle());
-	caller.GetState().regs[3] = 0;
+	handle.Write(mod->GetHandle());
+	return 0;
 }
 
-void XboxKrnlModule::XexLoadImage(CPUThread &caller)
+// r3 is left as whatever the module's entrypoint returned, so this doesn't return a value through the shim
+void XboxKrnlModule::XexLoadImage(CPUThread &caller, GuestString nameStr, [[maybe_unused]] uint32_t typeInfo, [[maybe_unused]] uint32_t version, [[maybe_unused]] GuestPtr<uint32_t> handle)
 {
 	auto& cpuState = caller.GetState();
-	arg_index = 0;
-	uint32_t namePtr = GetNextArg(cpuState);
-	uint32_t typeInfo = GetNextArg(cpuState);
-	uint32_t version = GetNextArg(cpuState);
-	uint32_t handlePtr = GetNextArg(cpuState);
-
-	char* name = (char*)Memory::GetRawPtrForAddr(namePtr);
-
-	printf("Loading module \"%s\"\n", name);
+	std::string name = nameStr.Str();
 
-	std::ifstream file(caller.xexRef.GetPath()+"/"+name, std::ios::ate | std::ios::binary);
+	printf("Loading module \"%s\"\n", name.c_str());
 
-	if (!file.is_open())
+	MappedFile file;
+	if (!file.Open(caller.xexRef.GetPath()+"/"+name))
 	{
 		cpuState.regs[3] = (int64_t)(int32_t)0xC000000FL;
 		return;
 	}
 
-	size_t size = file.tellg();
-	file.seekg(0, std::ios::beg);
-	char* buf = new char[size];
-	file.read(buf, size);
-	
-	XexLoader mod = XexLoader((uint8_t*)buf, size, caller.xexRef.GetPath()+"/"+name);
+	XexLoader mod = XexLoader(file.Data(), file.Size(), caller.xexRef.GetPath()+"/"+name);
+	file.Close();
 
 	uint32_t old_lr = cpuState.lr;
 	uint32_t old_pc = cpuState.pc;
@@ -832,27 +848,25 @@ void XboxKrnlModule::XexLoadImage(CPUThread &caller)
 
 	cpuState.pc = mod.GetEntryPoint();
 
+	Scheduler::EnterNestedRun();
 	while (!caller.DoneRunningEntry())
 	{
 		caller.Run();
 	}
+	Scheduler::LeaveNestedRun();
 
 	cpuState.pc = old_pc;
 	cpuState.lr = old_lr;
 	caller.xexRef = old_xex;
 }
 
-void XboxKrnlModule::NtAllocateEncryptedMemory(CPUThread &caller)
+uint32_t XboxKrnlModule::NtAllocateEncryptedMemory(uint32_t unknown, uint32_t regionSize, GuestPtr<uint32_t> outAddr)
 {
-	uint32_t region_size = caller.GetState().regs[4];
-	uint32_t out_addr_ptr = caller.GetState().regs[5];
-
-	uint32_t addr = Memory::VirtAllocMemoryRange(0x8C000000, 0x8FFFFFFF, region_size);
-	Memory::AllocMemory(addr, region_size);
+	uint32_t addr = VMM::Allocate(0x8C000000, 0x8FFFFFFF, regionSize);
 
-	Memory::Write32(out_addr_ptr, addr);
+	outAddr.Write(addr);
 
-	printf("NtAllocateEncryptedMemory(0x%08lx, 0x%08x, 0x%08x) = 0x%08x\n", caller.GetState().regs[3], region_size, out_addr_ptr, addr);
+	printf("NtAllocateEncryptedMemory(0x%08x, 0x%08x, 0x%08x) = 0x%08x\n", unknown, regionSize, outAddr.Addr(), addr);
 
-	caller.GetState().regs[3] = 0;
+	return 0;
 }
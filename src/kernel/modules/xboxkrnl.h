@@ -2,6 +2,9 @@
 
 #include <kernel/Module.h>
 #include <kernel/kernel.h>
+#include <kernel/shim.h>
+#include <kernel/xtypes.h>
+#include <vector>
 
 class XboxKrnlModule : public IModule
 {
@@ -9,47 +12,77 @@ public:
 	XboxKrnlModule();
 	void Initialize();
 
-	void CallFunctionByOrdinal(uint32_t ordinal, CPUThread& caller);
+	virtual const Export_t* LookupExport(uint32_t ordinal);
 	virtual uint32_t GetHandle() const {return modHandle;}
-
-	bool IsExportVariable(uint32_t ordinal);
 private:
-	void DbgPrint(CPUThread& caller); // 0x03
-	void ExAllocatePoolWithTag(CPUThread& caller); // 0x0A
-	void ExGetXConfigSetting(CPUThread& caller); // 0x10
-	void ExInitializeReadWriteLock(CPUThread& caller); // 0x11
-	void ExRegisterTitleTerminationNotification(CPUThread& caller); // 0x15
-	void KeAcquireSpinLockAtRaisedIrql(CPUThread& caller); // 0x4D
-	void KeEnterCriticalRegion(CPUThread& caller); // 0x5F
-	void KeGetCurrentProcessType(CPUThread& caller); // 0x66
-	void KeInitializeDPC(CPUThread& caller); // 0x6F
-	void KeInitializeSemaphore(CPUThread& caller); // 0x74
-	void KeInitializeTimerEx(CPUThread& caller); // 0x75
-	void KeLeaveCriticalRegion(CPUThread& caller); // 0x7D
-	void KeQueryPerformanceCounter(CPUThread& caller); // 0x83
-	void KeQuerySystemTime(CPUThread& caller); // 0x84
-	void KeRaiseIrqlToDPC(CPUThread& caller); // 0x85
-	void KeReleaseSpinLockAtRaisedIrql(CPUThread& caller); // 0x89
-	void KfReleaseSpinLock(CPUThread& caller); // 0xb4
-	void MmAllocatePhysicalMemory(CPUThread& caller); // 0xba
-	void MmQueryAllocationSize(CPUThread& caller); // 0xc5
-	void NtAllocateVirtualMemory(CPUThread& caller); // 0xcc
-	void NtCreateFile(CPUThread& caller); // 0xd2
-	void NtQueryFullAttributesFile(CPUThread& caller); // 0xe7
-	void NtQueryVirtualMemory(CPUThread& caller); // 0xee
-	void ObTranslateSymbolicLink(CPUThread& caller); // 0x113
-	void RtlEnterCriticalSection(CPUThread& caller); // 0x125
-	void RtlInitAnsiString(CPUThread& caller); // 0x12C
-	void RtlInitializeCriticalSection(CPUThread& caller); // 0x12E
-	void RtlLeaveCriticalSection(CPUThread& caller); // 0x130
-	void _snprintf(CPUThread& caller); // 0x13A
-	void RltTimeToTimeFields(CPUThread& caller); // 0x140
-	void KeAllocTLS(CPUThread& caller); // 0x152
-	void KeTlsGetValue(CPUThread& caller); // 0x154
-	void XexGetModuleHandle(CPUThread& caller); // 0x195
+	/// @brief Adapts a handler to the thunk table's signature, see Kernel::Shim
+	template<auto handler>
+	static void Bind(IModule* module, CPUThread& caller)
+	{
+		Kernel::Shim<handler>::Call(module, caller);
+	}
+
+	static const Export_t exportTable[];
+	std::vector<const Export_t*> exportsByOrdinal; // Indexed by ordinal, filled in from exportTable
+
+	void DbgPrint(GuestString fmt, VarArgs args); // 0x03
+	uint32_t ExAllocatePool(uint32_t size); // 0x09
+	uint32_t ExAllocatePoolWithTag(uint32_t size, uint32_t tag); // 0x0A
+	uint32_t ExAllocatePoolTypeWithTag(uint32_t size, uint32_t tag, uint32_t type); // 0x0B
+	void ExFreePool(uint32_t addr); // 0x0F
+	int32_t ExGetXConfigSetting(uint16_t category, uint16_t setting, GuestPtr<uint8_t> buf, uint16_t bufSize, GuestPtr<uint16_t> reqSize); // 0x10
+	void ExInitializeReadWriteLock(GuestPtr<uint32_t> lock); // 0x11
+	void ExRegisterTitleTerminationNotification(uint32_t terminationStructPtr, uint32_t create); // 0x15
+	void KeAcquireSpinLockAtRaisedIrql(uint32_t lockPtr); // 0x4D
+	bool KeCancelTimer(uint32_t timerPtr); // 0x54
+	uint32_t KeDelayExecutionThread(uint32_t waitMode, uint32_t alertable, GuestPtr<int64_t> interval); // 0x5A
+	void KeEnterCriticalRegion(); // 0x5F
+	uint32_t KeGetCurrentProcessType(); // 0x66
+	void KeInitializeDPC(GuestPtr<X_KDPC> dpc, uint32_t routine, uint32_t context); // 0x6F
+	void KeInitializeEvent(uint32_t eventPtr, uint32_t type, uint32_t state); // 0x70
+	void KeInitializeMutant(GuestPtr<X_KMUTANT> mutant, uint32_t initialOwner); // 0x72
+	void KeInitializeSemaphore(GuestPtr<X_KSEMAPHORE> semaphore, int32_t count, int32_t limit); // 0x74
+	void KeInitializeTimerEx(GuestPtr<X_KTIMER> timer, uint32_t type, uint8_t processType); // 0x75
+	bool KeInsertQueueDpc(uint32_t dpcPtr, uint32_t arg1, uint32_t arg2); // 0x7B
+	void KeLeaveCriticalRegion(); // 0x7D
+	int32_t KePulseEvent(uint32_t eventPtr); // 0x7F
+	uint64_t KeQueryPerformanceCounter(); // 0x83
+	void KeQuerySystemTime(GuestPtr<uint64_t> time); // 0x84
+	uint8_t KeRaiseIrqlToDPC(CPUThread& caller); // 0x85
+	int32_t KeReleaseMutant(uint32_t mutantPtr); // 0x87
+	int32_t KeReleaseSemaphore(uint32_t semaphorePtr, int32_t increment, int32_t adjustment); // 0x88
+	void KeReleaseSpinLockAtRaisedIrql(uint32_t lockPtr); // 0x89
+	bool KeRemoveQueueDpc(uint32_t dpcPtr); // 0x8F
+	int32_t KeResetEvent(uint32_t eventPtr); // 0x90
+	int32_t KeSetEvent(uint32_t eventPtr); // 0x9E
+	bool KeSetTimer(uint32_t timerPtr, int64_t dueTime, uint32_t dpcPtr); // 0xA6
+	bool KeSetTimerEx(uint32_t timerPtr, int64_t dueTime, uint32_t period, uint32_t dpcPtr); // 0xA7
+	uint32_t KeWaitForMultipleObjects(uint32_t count, GuestPtr<uint32_t> objects, uint32_t waitType, uint32_t waitReason, uint32_t waitMode, uint32_t alertable, GuestPtr<int64_t> timeout); // 0xAF
+	uint32_t KeWaitForSingleObject(uint32_t objectPtr, uint32_t waitReason, uint32_t waitMode, uint32_t alertable, GuestPtr<int64_t> timeout); // 0xB0
+	void KfReleaseSpinLock(CPUThread& caller, uint32_t lockPtr, uint8_t oldIrql); // 0xb4
+	uint32_t MmAllocatePhysicalMemory(uint32_t flags, uint32_t regionSize, uint32_t protect, uint32_t minAddr, uint32_t maxAddr, uint32_t alignment); // 0xba
+	void MmFreePhysicalMemory(uint32_t type, uint32_t baseAddr); // 0xbe
+	uint32_t MmQueryAllocationSize(uint32_t base); // 0xc5
+	uint32_t NtAllocateVirtualMemory(GuestPtr<uint32_t> baseAddr, GuestPtr<uint32_t> regionSize, uint32_t allocType, uint32_t protect); // 0xcc
+	uint32_t NtCreateFile(GuestPtr<uint32_t> handleOut, uint32_t desiredAccess, GuestPtr<X_OBJECT_ATTRIBUTES> objectAttrs, uint32_t ioStatusPtr, uint32_t allocSizePtr); // 0xd2
+	uint32_t NtFreeVirtualMemory(GuestPtr<uint32_t> baseAddr, GuestPtr<uint32_t> regionSize, uint32_t freeType); // 0xdc
+	uint32_t NtQueryFullAttributesFile(GuestPtr<X_OBJECT_ATTRIBUTES> objectAttrs, uint32_t openInfo); // 0xe7
+	uint32_t NtQueryVirtualMemory(uint32_t baseAddr, GuestPtr<X_MEMORY_BASIC_INFORMATION> outBasicInfo); // 0xee
+	uint32_t ObTranslateSymbolicLink(); // 0x113
+	void RtlEnterCriticalSection(uint32_t critPtr); // 0x125
+	void RtlInitAnsiString(GuestPtr<X_ANSI_STRING> dst, GuestString str); // 0x12C
+	void RtlInitializeCriticalSection(uint32_t sectionPtr); // 0x12E
+	uint32_t RtlInitializeCriticalSectionAndSpinCount(uint32_t sectionPtr, uint32_t spinCount); // 0x12F
+	void RtlLeaveCriticalSection(uint32_t critPtr); // 0x130
+	void _snprintf(uint32_t dstPtr, uint32_t dstMaxLen, GuestString fmt, VarArgs args); // 0x13A
+	void RltTimeToTimeFields(GuestPtr<uint64_t> time, GuestPtr<X_TIME_FIELDS> timeFields); // 0x140
+	bool RtlTryEnterCriticalSection(uint32_t critPtr); // 0x141
+	uint32_t KeAllocTLS(CPUThread& caller); // 0x152
+	uint32_t KeTlsGetValue(CPUThread& caller, uint32_t slot); // 0x154
+	uint32_t XexGetModuleHandle(GuestString name, GuestPtr<uint32_t> handle); // 0x195
 	// Warning: This will modify CPU state by calling the new module's entrypoint!
-	void XexLoadImage(CPUThread& caller); // 0x199
-	void NtAllocateEncryptedMemory(CPUThread& caller); // 0x28A
+	void XexLoadImage(CPUThread& caller, GuestString name, uint32_t typeInfo, uint32_t version, GuestPtr<uint32_t> handle); // 0x199
+	uint32_t NtAllocateEncryptedMemory(uint32_t unknown, uint32_t regionSize, GuestPtr<uint32_t> outAddr); // 0x28A
 
 	uint32_t modHandle; // Set this to some arbitrary (and ridiculous) value to avoid trampling on other xex handles
 };
@@ -0,0 +1,149 @@
+#include <kernel/pool.h>
+#include <memory/memory.h>
+#include <memory/physical.h>
+#include <cstdio>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+
+#define POOL_MIN_SHIFT 4
+#define POOL_SLAB_SIZE 0x1000
+
+namespace Pool
+{
+
+typedef struct
+{
+	uint32_t size; // What was asked for
+	uint32_t tag;
+	int sizeClass; // -1 for large blocks, which have pages of their own
+} Block_t;
+
+typedef struct
+{
+	uint64_t bytes;
+	uint64_t count;
+	uint64_t peakBytes;
+	uint64_t totalAllocations;
+} TagStats_t;
+
+static const int numClasses = __builtin_ctz(POOL_MAX_SMALL_SIZE) - POOL_MIN_SHIFT + 1;
+
+// Guards everything below
+static std::mutex lock;
+static std::unordered_map<uint32_t, Block_t> blocks; // Live allocations by address
+static std::vector<uint32_t> freeBlocks[numClasses];
+static uint32_t arenaNext = 0, arenaEnd = 0; // The part of the newest arena that isn't slabs yet
+static std::map<uint32_t, TagStats_t> tagStats;
+
+static int ClassFor(uint32_t size)
+{
+	int sizeClass = 0;
+	while ((1U << (sizeClass + POOL_MIN_SHIFT)) < size)
+		sizeClass++;
+	return sizeClass;
+}
+
+/// @brief Splits a fresh page into blocks for `sizeClass`, lowest address handed out first
+static void Refill(int sizeClass)
+{
+	if (arenaNext == arenaEnd)
+	{
+		arenaNext = Physical::AllocateKernel(POOL_ARENA_SIZE);
+		arenaEnd = arenaNext + POOL_ARENA_SIZE;
+	}
+
+	uint32_t slab = arenaNext;
+	arenaNext += POOL_SLAB_SIZE;
+
+	uint32_t blockSize = 1U << (sizeClass + POOL_MIN_SHIFT);
+	for (uint32_t offset = POOL_SLAB_SIZE; offset; offset -= blockSize)
+		freeBlocks[sizeClass].push_back(slab + offset - blockSize);
+}
+
+uint32_t Allocate(uint32_t size, uint32_t tag)
+{
+	uint32_t addr;
+	uint32_t blockSize;
+	int sizeClass = -1;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (size <= POOL_MAX_SMALL_SIZE)
+		{
+			sizeClass = ClassFor(size);
+			if (freeBlocks[sizeClass].empty())
+				Refill(sizeClass);
+
+			addr = freeBlocks[sizeClass].back();
+			freeBlocks[sizeClass].pop_back();
+			blockSize = 1U << (sizeClass + POOL_MIN_SHIFT);
+		}
+		else
+		{
+			addr = Physical::AllocateKernel(size);
+			blockSize = size;
+		}
+
+		blocks[addr] = {size, tag, sizeClass};
+
+		TagStats_t& stats = tagStats[tag];
+		stats.bytes += size;
+		stats.count++;
+		stats.totalAllocations++;
+		if (stats.bytes > stats.peakBytes)
+			stats.peakBytes = stats.bytes;
+	}
+
+	// Fresh pages always were, reused blocks have to be too
+	if (sizeClass >= 0)
+		Memory::Fill(addr, 0, blockSize);
+	return addr;
+}
+
+bool Free(uint32_t addr)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto it = blocks.find(addr);
+	if (it == blocks.end())
+		return false;
+
+	Block_t block = it->second;
+	blocks.erase(it);
+
+	TagStats_t& stats = tagStats[block.tag];
+	stats.bytes -= block.size;
+	stats.count--;
+
+	if (block.sizeClass >= 0)
+		freeBlocks[block.sizeClass].push_back(addr);
+	else
+		Physical::Free(addr);
+	return true;
+}
+
+void DumpStats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	printf("Pool usage by tag:\n");
+	printf("Tag   Bytes      Blocks     Peak bytes Allocations\n");
+	for (auto& [tag, stats] : tagStats)
+	{
+		// Tags are four characters, most significant first
+		char name[5];
+		for (int i = 0; i < 4; i++)
+		{
+			char c = tag >> (24 - i * 8);
+			name[i] = (c >= 0x20 && c < 0x7F) ? c : '.';
+		}
+		name[4] = 0;
+
+		printf("%s  %-10lu %-10lu %-10lu %lu\n", name, stats.bytes, stats.count, stats.peakBytes, stats.totalAllocations);
+	}
+}
+
+}
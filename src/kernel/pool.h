@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+// The pool hands out blocks in power of two size classes from 16 bytes up to this, anything bigger gets its own pages
+#define POOL_MAX_SMALL_SIZE 2048
+// What NT tags ExAllocatePool's allocations with, 'enoN'
+#define POOL_TAG_NONE 0x656E6F4E
+// Small blocks are carved out of arenas of this much physical memory, a page at a time
+#define POOL_ARENA_SIZE 0x100000
+
+/// @brief The kernel pool, behind ExAllocatePoolWithTag and ExFreePool. Small requests come out of size-class slabs:
+/// one 4 KB page of an arena split into equal blocks, with freed blocks going back on their class's free list,
+/// so a 16-byte allocation costs 16 bytes rather than a page. What each block holds, and the usage per tag,
+/// is kept on the host, titles can't trample it
+namespace Pool
+{
+
+/// @return The block's guest address, zeroed. Running out of memory is fatal
+uint32_t Allocate(uint32_t size, uint32_t tag);
+/// @return false if `addr` isn't a live pool allocation
+bool Free(uint32_t addr);
+
+/// @brief Prints the bytes and blocks in use, and peak and total allocations, for each tag
+void DumpStats();
+
+}
@@ -0,0 +1,536 @@
+#include <kernel/scheduler.h>
+#include <cpu/hwthread.h>
+#include <kernel/shim.h>
+#include <kernel/xtypes.h>
+#include <memory/memory.h>
+#include <memory/vmm.h>
+#include <memory/physical.h>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#include <cassert>
+
+// Batches (see CPUThread::Run) a thread gets before others queued on its hardware thread get a turn
+#define QUANTUM_BATCHES 4
+#define DPC_STACK_SIZE (64*1024)
+
+namespace Scheduler
+{
+
+/// @brief One per hardware thread. The owner pops from the front, thieves take from the back
+typedef struct
+{
+	std::mutex lock;
+	std::deque<GuestThread_t*> levels[THREAD_PRIORITY_LEVELS];
+	std::atomic<uint32_t> nonEmpty; // Bit n is set if levels[n] has threads, readable without the lock
+} RunQueue_t;
+
+static RunQueue_t queues[HW_THREAD_COUNT];
+
+// Guards the fields of every thread and everything below. Taken before a queue's lock, never after
+static std::mutex lock;
+static std::condition_variable cond;
+static std::vector<GuestThread_t*> threads;
+static uint32_t nextId = 1;
+static int nextWorker = 0; // Spreads new threads over the hardware threads
+static uint64_t enqueued = 0; // Bumped whenever a thread is queued, idle workers wait for it to change
+static bool shuttingDown = false;
+// What each hardware thread is running, and the CPUThread holding its registers meanwhile
+static GuestThread_t* current[HW_THREAD_COUNT];
+static CPUThread* runningOn[HW_THREAD_COUNT];
+
+/// @brief Where each queued thread is queued, so it can be found again to requeue
+static std::unordered_map<GuestThread_t*, int> queuedOn;
+
+static std::deque<uint32_t> dpcs;
+static std::atomic<size_t> dpcCount; // dpcs.size(), readable without the lock
+static uint32_t dpcStacks[HW_THREAD_COUNT];
+
+static int HighestLevel(uint32_t mask)
+{
+	return mask ? 31 - __builtin_clz(mask) : -1;
+}
+
+/// @brief Puts a ready thread at the back of a run queue. With `lock` held
+static void Enqueue(GuestThread_t* thread)
+{
+	int worker = thread->lastWorker;
+	if (worker < 0 || !(thread->affinity & (1 << worker)))
+	{
+		for (int i = 0; i < HW_THREAD_COUNT; i++)
+		{
+			worker = (nextWorker + i) % HW_THREAD_COUNT;
+			if (thread->affinity & (1 << worker))
+				break;
+		}
+		nextWorker = (worker + 1) % HW_THREAD_COUNT;
+	}
+
+	RunQueue_t& queue = queues[worker];
+	{
+		std::lock_guard<std::mutex> guard(queue.lock);
+		queue.levels[thread->priority].push_back(thread);
+		queue.nonEmpty |= 1 << thread->priority;
+	}
+
+	thread->state = THREAD_READY;
+	queuedOn[thread] = worker;
+	enqueued++;
+	cond.notify_all();
+}
+
+/// @brief Takes a queued thread back out, so it can be queued somewhere else. With `lock` held
+/// @return false if a worker has already popped it
+static bool Dequeue(GuestThread_t* thread)
+{
+	auto it = queuedOn.find(thread);
+	if (it == queuedOn.end())
+		return false;
+
+	RunQueue_t& queue = queues[it->second];
+	queuedOn.erase(it);
+
+	std::lock_guard<std::mutex> guard(queue.lock);
+	auto& level = queue.levels[thread->priority];
+	auto pos = std::find(level.begin(), level.end(), thread);
+	if (pos == level.end())
+		return false;
+
+	level.erase(pos);
+	if (level.empty())
+		queue.nonEmpty &= ~(1 << thread->priority);
+	return true;
+}
+
+/// @brief Pops the best thread `worker` may run from `queue`: its own queue from the front, anyone else's from the back
+static GuestThread_t* Pop(RunQueue_t& queue, int worker, bool steal)
+{
+	if (!queue.nonEmpty.load(std::memory_order_relaxed))
+		return nullptr;
+
+	std::lock_guard<std::mutex> guard(queue.lock);
+	for (int p = HighestLevel(queue.nonEmpty); p >= 0; p--)
+	{
+		auto& level = queue.levels[p];
+		if (level.empty())
+			continue;
+
+		GuestThread_t* thread = nullptr;
+		if (!steal)
+		{
+			thread = level.front();
+			level.pop_front();
+		}
+		else
+		{
+			auto pos = std::find_if(level.rbegin(), level.rend(), [worker](GuestThread_t* t) {return t->affinity & (1 << worker);});
+			if (pos == level.rend())
+				continue;
+			thread = *pos;
+			level.erase(std::next(pos).base());
+		}
+
+		if (level.empty())
+			queue.nonEmpty &= ~(1 << p);
+		return thread;
+	}
+
+	return nullptr;
+}
+
+/// @brief With `lock` held
+static void SwitchIn(int worker, CPUThread& cpu, GuestThread_t* thread)
+{
+	cpu.SwapContext(thread->context);
+
+	// Threads move between processors, so the PCR is whichever one they land on
+	cpuState_t& state = cpu.GetState();
+	state.pcr_address = cpu.GetPCR();
+	state.regs[13] = cpu.GetPCR();
+	Memory::Write32(cpu.GetPCR()+0x00, state.tls_addr);
+	Memory::Write32(cpu.GetPCR()+0x100, thread->kthread);
+	// The kernel does a dummy stwcx. on every switch for the same reason
+	state.reserved = false;
+
+	if (thread->hasWaitResult)
+	{
+		state.regs[3] = thread->waitResult;
+		thread->hasWaitResult = false;
+	}
+
+	thread->state = THREAD_RUNNING;
+	thread->lastWorker = worker;
+	current[worker] = thread;
+	runningOn[worker] = &cpu;
+}
+
+/// @brief With `lock` held
+static void SwitchOut(int worker, CPUThread& cpu, GuestThread_t* thread)
+{
+	cpu.SwapContext(thread->context);
+	current[worker] = nullptr;
+	runningOn[worker] = nullptr;
+}
+
+/// @brief Runs every queued DPC on `worker`, with whatever is switched in set aside meanwhile
+static void RunDpcs(int worker, CPUThread& cpu)
+{
+	while (dpcCount.load(std::memory_order_relaxed))
+	{
+		uint32_t dpc;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (dpcs.empty())
+				return;
+			dpc = dpcs.front();
+			dpcs.pop_front();
+			dpcCount = dpcs.size();
+
+			if (!dpcStacks[worker])
+			{
+				dpcStacks[worker] = VMM::Allocate(0x70000000, 0x7F000000, DPC_STACK_SIZE);
+			}
+		}
+
+		cpuState_t interrupted = {};
+		cpu.SwapContext(interrupted);
+
+		const X_KDPC* kdpc = GuestPtr<X_KDPC>(dpc).View();
+		cpuState_t& state = cpu.GetState();
+		state.pc = kdpc->routine;
+		state.lr = THREAD_EXIT_ADDRESS;
+		state.regs[1] = dpcStacks[worker] + DPC_STACK_SIZE;
+		state.regs[3] = dpc;
+		state.regs[4] = kdpc->context;
+		state.regs[5] = kdpc->arg1;
+		state.regs[6] = kdpc->arg2;
+		state.regs[13] = cpu.GetPCR();
+		state.pcr_address = cpu.GetPCR();
+		state.tls_addr = interrupted.tls_addr;
+
+		while (!cpu.DoneRunningEntry())
+			cpu.Run();
+
+		cpu.SwapContext(interrupted);
+		cpu.GetState().reserved = false;
+	}
+}
+
+/// @brief Finds the next thread for `worker` and switches it in, waiting for one if there's nothing to do
+/// @return nullptr once the scheduler shuts down
+static GuestThread_t* FindWork(int worker, CPUThread& cpu)
+{
+	while (true)
+	{
+		RunDpcs(worker, cpu);
+
+		uint64_t seen;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (shuttingDown)
+				return nullptr;
+			seen = enqueued;
+		}
+
+		GuestThread_t* thread = Pop(queues[worker], worker, false);
+		for (int i = 1; !thread && i < HW_THREAD_COUNT; i++)
+			thread = Pop(queues[(worker + i) % HW_THREAD_COUNT], worker, true);
+
+		if (thread)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			queuedOn.erase(thread);
+
+			// Suspends don't bother taking threads out of the queues
+			if (thread->suspendCount > 0)
+			{
+				thread->state = THREAD_SUSPENDED;
+				continue;
+			}
+
+			SwitchIn(worker, cpu, thread);
+			return thread;
+		}
+
+		HardwareThreads::EnterIdle();
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			cond.wait(guard, [seen]() {return enqueued != seen || shuttingDown;});
+		}
+		HardwareThreads::LeaveIdle();
+	}
+}
+
+/// @brief Whether a running thread should make way at the end of its quantum. With `lock` held
+static bool ShouldSwitch(int worker, GuestThread_t* thread)
+{
+	if (!(thread->affinity & (1 << worker)))
+		return true;
+	return HighestLevel(queues[worker].nonEmpty) >= thread->priority;
+}
+
+void RunWorker(int id, CPUThread& cpu)
+{
+	GuestThread_t* thread = nullptr;
+	while (true)
+	{
+		if (!thread)
+		{
+			thread = FindWork(id, cpu);
+			if (!thread)
+				return;
+		}
+
+		RunDpcs(id, cpu);
+
+		for (int i = 0; i < QUANTUM_BATCHES; i++)
+		{
+			cpu.Run();
+			if (cpu.DoneRunningEntry() || cpu.TakeYieldRequest())
+				break;
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		if (shuttingDown)
+		{
+			SwitchOut(id, cpu, thread);
+			return;
+		}
+
+		// Woken before it got off the hardware thread
+		if (thread->hasWaitResult)
+		{
+			cpu.GetState().regs[3] = thread->waitResult;
+			thread->hasWaitResult = false;
+		}
+
+		if (cpu.DoneRunningEntry())
+		{
+			printf("Thread %d returned from its entry point\n", thread->id);
+			thread->state = THREAD_TERMINATED;
+			cond.notify_all();
+		}
+		else if (thread->state == THREAD_WAITING)
+		{
+			// Wake re-queues it
+		}
+		else if (thread->suspendCount > 0)
+			thread->state = THREAD_SUSPENDED;
+		else if (!ShouldSwitch(id, thread))
+			continue;
+
+		SwitchOut(id, cpu, thread);
+		if (thread->state == THREAD_RUNNING)
+			Enqueue(thread);
+		thread = nullptr;
+	}
+}
+
+GuestThread_t* CreateThread(uint32_t entryPoint, uint32_t stackSize, int priority, uint8_t affinity, bool suspended)
+{
+	GuestThread_t* thread = new GuestThread_t();
+
+	if (stackSize < 16*1024)
+		stackSize = 16*1024;
+
+	thread->stackSize = stackSize;
+	thread->stackBase = VMM::Allocate(0x70000000, 0x7F000000, stackSize);
+
+	thread->kthread = Physical::AllocateKernel(4096);
+
+	cpuState_t& context = thread->context;
+	context.tls_addr = Physical::AllocateKernel(4096);
+	context.tls_lowest_alloced = 0x80;
+
+	context.pc = entryPoint;
+	context.lr = THREAD_EXIT_ADDRESS;
+	context.regs[1] = thread->stackBase + stackSize;
+
+	thread->priority = std::clamp(priority, 0, THREAD_PRIORITY_LEVELS - 1);
+	thread->affinity = (affinity & THREAD_AFFINITY_ALL) ? (affinity & THREAD_AFFINITY_ALL) : THREAD_AFFINITY_ALL;
+	thread->suspendCount = suspended ? 1 : 0;
+	thread->state = THREAD_SUSPENDED;
+	thread->lastWorker = -1;
+
+	std::lock_guard<std::mutex> guard(lock);
+	thread->id = nextId++;
+	threads.push_back(thread);
+
+	printf("Created thread %d at 0x%08x, stack base is 0x%08x\n", thread->id, entryPoint, thread->stackBase);
+
+	if (!suspended)
+		Enqueue(thread);
+	return thread;
+}
+
+void SetArg(GuestThread_t* thread, int num, uint64_t value)
+{
+	printf("Setting arg%d: 0x%08lx\n", num, value);
+
+	std::lock_guard<std::mutex> guard(lock);
+	assert(num < 8 && thread->state == THREAD_SUSPENDED);
+	thread->context.regs[3 + num] = value;
+}
+
+int Suspend(GuestThread_t* thread)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	int previous = thread->suspendCount++;
+	for (int i = 0; i < HW_THREAD_COUNT; i++)
+		if (current[i] == thread)
+			runningOn[i]->RequestYield();
+
+	return previous;
+}
+
+int Resume(GuestThread_t* thread)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	int previous = thread->suspendCount;
+	if (thread->suspendCount > 0)
+		thread->suspendCount--;
+
+	if (thread->suspendCount == 0 && thread->state == THREAD_SUSPENDED)
+		Enqueue(thread);
+
+	return previous;
+}
+
+void SetPriority(GuestThread_t* thread, int priority)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	bool requeue = thread->state == THREAD_READY && Dequeue(thread);
+	thread->priority = std::clamp(priority, 0, THREAD_PRIORITY_LEVELS - 1);
+	if (requeue)
+		Enqueue(thread);
+}
+
+void SetAffinity(GuestThread_t* thread, uint8_t affinity)
+{
+	affinity &= THREAD_AFFINITY_ALL;
+	if (!affinity)
+		return;
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	bool requeue = thread->state == THREAD_READY && Dequeue(thread);
+	thread->affinity = affinity;
+	if (requeue)
+		Enqueue(thread);
+
+	// A running thread moves at the end of its current block
+	for (int i = 0; i < HW_THREAD_COUNT; i++)
+		if (current[i] == thread && !(affinity & (1 << i)))
+			runningOn[i]->RequestYield();
+}
+
+GuestThread_t* GetCurrentThread()
+{
+	HardwareThread* hw = HardwareThreads::GetCurrent();
+	return hw ? current[hw->GetId()] : nullptr;
+}
+
+bool BlockCurrent()
+{
+	HardwareThread* hw = HardwareThreads::GetCurrent();
+	assert(hw);
+
+	std::lock_guard<std::mutex> guard(lock);
+	GuestThread_t* thread = current[hw->GetId()];
+	if (thread->nestedRuns)
+		return false;
+
+	thread->state = THREAD_WAITING;
+	hw->GetCPU()->RequestYield();
+	return true;
+}
+
+void Wake(GuestThread_t* thread, uint64_t result)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (thread->state != THREAD_WAITING)
+		return;
+
+	thread->hasWaitResult = true;
+	thread->waitResult = result;
+
+	bool switchedIn = false;
+	for (int i = 0; i < HW_THREAD_COUNT; i++)
+		switchedIn |= current[i] == thread;
+
+	// Woken before it got off its hardware thread, so it never has to
+	if (switchedIn)
+		thread->state = THREAD_RUNNING;
+	else if (thread->suspendCount > 0)
+		thread->state = THREAD_SUSPENDED;
+	else
+		Enqueue(thread);
+}
+
+bool QueueDpc(uint32_t dpc, uint32_t arg1, uint32_t arg2)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (std::find(dpcs.begin(), dpcs.end(), dpc) != dpcs.end())
+		return false;
+
+	X_KDPC* kdpc = GuestPtr<X_KDPC>(dpc).Map();
+	kdpc->arg1 = arg1;
+	kdpc->arg2 = arg2;
+	dpcs.push_back(dpc);
+	dpcCount = dpcs.size();
+
+	// Idle hardware threads pick it up too
+	enqueued++;
+	cond.notify_all();
+	return true;
+}
+
+bool RemoveDpc(uint32_t dpc)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	auto pos = std::find(dpcs.begin(), dpcs.end(), dpc);
+	if (pos == dpcs.end())
+		return false;
+
+	dpcs.erase(pos);
+	dpcCount = dpcs.size();
+	return true;
+}
+
+void EnterNestedRun()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	GetCurrentThread()->nestedRuns++;
+}
+
+void LeaveNestedRun()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	GetCurrentThread()->nestedRuns--;
+}
+
+void WaitForExit(GuestThread_t* thread)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	cond.wait(guard, [thread]() {return thread->state == THREAD_TERMINATED;});
+}
+
+void Shutdown()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	shuttingDown = true;
+	for (int i = 0; i < HW_THREAD_COUNT; i++)
+		if (runningOn[i])
+			runningOn[i]->RequestYield();
+	cond.notify_all();
+}
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cpu/CPU.h>
+#include <cstdint>
+
+#define THREAD_PRIORITY_LEVELS 32
+// NT's normal priority, what threads get unless they ask for something else
+#define THREAD_PRIORITY_NORMAL 8
+#define THREAD_AFFINITY_ALL 0x3F
+// Threads start with LR pointing here, so returning from the entry point ends the thread (see CPUThread::DoneRunningEntry)
+#define THREAD_EXIT_ADDRESS 0xBCBCBCBC
+
+enum GuestThreadState
+{
+	THREAD_READY, // Runnable, in some hardware thread's run queue
+	THREAD_RUNNING,
+	THREAD_WAITING, // Blocked until someone calls Scheduler::Wake
+	THREAD_SUSPENDED, // Would be ready, but the suspend count isn't zero
+	THREAD_TERMINATED,
+};
+
+/// @brief A guest thread, the host side of a KTHREAD. Owned by the scheduler, fields are only changed under its lock
+typedef struct
+{
+	uint32_t id;
+	uint32_t kthread; // Guest KTHREAD, PCR+0x100 points here while the thread runs
+	uint32_t stackBase;
+	uint32_t stackSize;
+
+	GuestThreadState state;
+	int priority; // 0-31, higher runs first
+	uint8_t affinity; // Bit n allows hardware thread n
+	int suspendCount;
+	int lastWorker; // Hardware thread it last ran on, it goes back there if it can
+	int nestedRuns; // Kernel calls on its stack that run guest code themselves (XexLoadImage), it can't be switched out meanwhile
+	bool hasWaitResult; // Set by Wake, waitResult goes in r3 before the thread runs again
+	uint64_t waitResult;
+
+	cpuState_t context; // Registers while switched out. While running they live in the CPUThread running it
+} GuestThread_t;
+
+/// @brief Multiplexes guest threads onto the hardware threads (see cpu/hwthread.h).
+/// Every hardware thread has its own run queue, one FIFO per priority, and steals from the others when it runs dry.
+/// A thread keeps its hardware thread for a quantum of batches, and past that as long as nothing of the same or higher
+/// priority is queued there. Switching is swapping the thread's context with the CPUThread's registers
+namespace Scheduler
+{
+
+/// @brief Allocates the stack, TLS and KTHREAD of a new thread, which starts at `entryPoint` once it's resumed
+/// (or right away, if `suspended` is false)
+GuestThread_t* CreateThread(uint32_t entryPoint, uint32_t stackSize, int priority, uint8_t affinity, bool suspended);
+/// @brief Sets argument register `num` (r3 onwards) of a thread that hasn't started yet
+void SetArg(GuestThread_t* thread, int num, uint64_t value);
+
+/// @brief Both return the previous suspend count. A running thread stops at the end of its current block
+int Suspend(GuestThread_t* thread);
+int Resume(GuestThread_t* thread);
+void SetPriority(GuestThread_t* thread, int priority);
+void SetAffinity(GuestThread_t* thread, uint8_t affinity);
+
+/// @brief The guest thread running on the calling hardware thread, nullptr on any other host thread
+GuestThread_t* GetCurrentThread();
+
+/// @brief Takes the calling guest thread off its hardware thread once the current block ends, until someone
+/// calls Wake on it. Meant for kernel calls, whose return value is whatever the wakeup passes
+/// @return false if the thread is under a nested run and can't be switched out, the caller has to block the host thread instead
+bool BlockCurrent();
+/// @brief Makes a waiting thread ready again
+/// @param result Returned from the kernel call the thread blocked in
+void Wake(GuestThread_t* thread, uint64_t result);
+
+/// @brief Bracket a kernel call running guest code on the calling thread's hardware thread, see GuestThread_t::nestedRuns
+void EnterNestedRun();
+void LeaveNestedRun();
+
+/// @brief Blocks the calling host thread until `thread` has returned from its entry point
+void WaitForExit(GuestThread_t* thread);
+
+/// @brief Queues a KDPC to run on the next hardware thread that gets between two quanta, interrupting whatever it's running.
+/// The routine gets its own stack and returns to the sentinel like a thread's entry point does
+/// @return false if it's queued already, in which case the arguments stay as they were
+bool QueueDpc(uint32_t dpc, uint32_t arg1, uint32_t arg2);
+/// @return Whether it was queued
+bool RemoveDpc(uint32_t dpc);
+
+/// @brief The main loop of hardware thread `id`, returns after Shutdown
+void RunWorker(int id, CPUThread& cpu);
+/// @brief Makes every hardware thread drop what it's running and return from RunWorker
+void Shutdown();
+
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <kernel/Module.h>
+#include <memory/memory.h>
+
+// Arguments past the eighth go in the caller's parameter save area, one doubleword each
+#define ARG_REGISTER_COUNT 8
+#define ARG_STACK_OFFSET 0x50
+
+/// @brief A guest pointer to a `T`, which is read and written big-endian. Converts to false if it's null.
+/// `T` is either an integer, or a struct of be<> fields (see kernel/xtypes.h) that's mapped whole
+template<typename T>
+class GuestPtr
+{
+	static_assert((std::is_integral_v<T> && sizeof(T) <= 8) || std::is_standard_layout_v<T>);
+public:
+	GuestPtr(uint32_t addr) : addr(addr) {}
+	explicit operator bool() const {return addr != 0;}
+	uint32_t Addr() const {return addr;}
+
+	/// @brief The `index`th `T` after this one
+	GuestPtr<T> At(uint32_t index) const {return GuestPtr<T>(addr + index * sizeof(T));}
+
+	T Read() const
+	{
+		if constexpr (sizeof(T) == 1) return (T)Memory::Read8(addr);
+		else if constexpr (sizeof(T) == 2) return (T)Memory::Read16(addr);
+		else if constexpr (sizeof(T) == 4) return (T)Memory::Read32(addr);
+		else return (T)Memory::Read64(addr);
+	}
+
+	void Write(T value) const
+	{
+		if constexpr (sizeof(T) == 1) Memory::Write8(addr, value);
+		else if constexpr (sizeof(T) == 2) Memory::Write16(addr, value);
+		else if constexpr (sizeof(T) == 4) Memory::Write32(addr, value);
+		else Memory::Write64(addr, value);
+	}
+
+	/// @brief The struct in place, for filling in. Counts as a store to all of it
+	T* Map() const {return (T*)Memory::Map(addr, sizeof(T), true);}
+	/// @brief The struct in place, for reading
+	const T* View() const {return (const T*)Memory::Map(addr, sizeof(T), false);}
+private:
+	uint32_t addr;
+};
+
+/// @brief A guest pointer to a NUL terminated string
+class GuestString
+{
+public:
+	GuestString(uint32_t addr) : addr(addr) {}
+	explicit operator bool() const {return addr != 0;}
+	uint32_t Addr() const {return addr;}
+	uint32_t Length() const {return Memory::StrLen(addr);}
+
+	/// @brief A host copy of the string. It can cross pages
+	std::string Str() const
+	{
+		std::string str(Length(), '\0');
+		Memory::CopyToHost(str.data(), addr, str.size());
+		return str;
+	}
+private:
+	uint32_t addr;
+};
+
+namespace Kernel
+{
+
+/// @brief The `slot`th integer argument of the kernel call `caller` is making
+inline uint64_t GetArg(CPUThread& caller, int slot)
+{
+	auto& state = caller.GetState();
+	if (slot < ARG_REGISTER_COUNT)
+		return state.regs[3 + slot];
+	return Memory::Read64((uint32_t)state.regs[1] + ARG_STACK_OFFSET + (slot - ARG_REGISTER_COUNT) * 8);
+}
+
+}
+
+/// @brief Whatever arguments follow the fixed ones, for handlers of variadic exports (the printf family)
+class VarArgs
+{
+public:
+	VarArgs(CPUThread& caller, int slot) : caller(caller), slot(slot) {}
+	uint64_t Next() {return Kernel::GetArg(caller, slot++);}
+private:
+	CPUThread& caller;
+	int slot;
+};
+
+namespace Kernel
+{
+
+/// @brief How a handler parameter of type `T` is filled in, and how many argument slots it takes up.
+/// Integers, GuestPtr and GuestString take one, `CPUThread&` is the caller itself and VarArgs picks up where the others stop
+template<typename T, typename = void>
+struct ArgTraits;
+
+template<typename T>
+struct ArgTraits<T, std::enable_if_t<std::is_integral_v<T>>>
+{
+	static constexpr int slots = 1;
+	static T Get(CPUThread& caller, int slot) {return (T)GetArg(caller, slot);}
+};
+
+template<typename T>
+struct ArgTraits<GuestPtr<T>>
+{
+	static constexpr int slots = 1;
+	static GuestPtr<T> Get(CPUThread& caller, int slot) {return GuestPtr<T>((uint32_t)GetArg(caller, slot));}
+};
+
+template<>
+struct ArgTraits<GuestString>
+{
+	static constexpr int slots = 1;
+	static GuestString Get(CPUThread& caller, int slot) {return GuestString((uint32_t)GetArg(caller, slot));}
+};
+
+template<>
+struct ArgTraits<CPUThread&>
+{
+	static constexpr int slots = 0;
+	static CPUThread& Get(CPUThread& caller, int) {return caller;}
+};
+
+template<>
+struct ArgTraits<VarArgs>
+{
+	static constexpr int slots = 0;
+	static VarArgs Get(CPUThread& caller, int slot) {return VarArgs(caller, slot);}
+};
+
+/// @brief The argument slot parameter `index` starts at, the slots of every parameter before it added up
+template<typename... Args>
+constexpr int SlotOf(size_t index)
+{
+	constexpr int slots[] = {ArgTraits<Args>::slots..., 0};
+	int slot = 0;
+	for (size_t i = 0; i < index; i++)
+		slot += slots[i];
+	return slot;
+}
+
+template<auto handler>
+struct Shim;
+
+/// @brief Turns a module's member function with typed parameters into an ExportHandler_t. Which register or stack slot
+/// each parameter comes from is worked out at compile time, and a non-void return value goes back in r3,
+/// sign extended if its type is signed
+template<typename Module, typename Ret, typename... Args, Ret (Module::*handler)(Args...)>
+struct Shim<handler>
+{
+	static void Call(IModule* module, CPUThread& caller)
+	{
+		Invoke(static_cast<Module*>(module), caller, std::index_sequence_for<Args...>());
+	}
+private:
+	template<size_t... I>
+	static void Invoke(Module* module, CPUThread& caller, std::index_sequence<I...>)
+	{
+		if constexpr (std::is_void_v<Ret>)
+			(module->*handler)(ArgTraits<Args>::Get(caller, SlotOf<Args...>(I))...);
+		else
+		{
+			Ret result = (module->*handler)(ArgTraits<Args>::Get(caller, SlotOf<Args...>(I))...);
+			if constexpr (std::is_signed_v<Ret>)
+				caller.GetState().regs[3] = (uint64_t)(int64_t)result;
+			else
+				caller.GetState().regs[3] = (uint64_t)result;
+		}
+	}
+};
+
+}
@@ -0,0 +1,188 @@
+#include <kernel/timerwheel.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+// From 1601, where FILETIMEs start, to 1970
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL
+
+namespace TimerWheel
+{
+
+typedef std::list<std::shared_ptr<Timer_t>> TimerList_t;
+
+static std::mutex lock;
+static std::condition_variable cond;
+static TimerList_t wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static TimerList_t beyond; // Too far out for the top level, looked at again every time it comes round
+static uint64_t currentTick; // Every tick up to and including this one has gone off
+static size_t armedCount;
+static bool shuttingDown;
+static std::thread host;
+static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+/// @brief Puts an armed timer in the level and slot for its due time. With `lock` held
+static void Insert(const std::shared_ptr<Timer_t>& timer)
+{
+	// The level is picked by the highest bit the due time and now differ in, so a timer never lands in a slot that's
+	// already been passed in this turn of its level. One cascading down on the very tick it's due goes in the slot that's up next
+	uint64_t differs = timer->due ^ currentTick;
+	int level = differs ? (63 - __builtin_clzll(differs)) / TIMER_WHEEL_BITS : 0;
+
+	TimerList_t* list;
+	if (level >= TIMER_WHEEL_LEVELS)
+		list = &beyond;
+	else
+		list = &wheel[level][(timer->due >> (level * TIMER_WHEEL_BITS)) & (TIMER_WHEEL_SLOTS - 1)];
+
+	timer->slot = list;
+	timer->pos = list->insert(list->end(), timer);
+}
+
+/// @brief Re-inserts everything in `list`, which moves it down to the levels below. With `lock` held
+static void Cascade(TimerList_t& list)
+{
+	TimerList_t moving;
+	moving.swap(list);
+	for (auto& timer : moving)
+		Insert(timer);
+}
+
+/// @brief Moves the wheel on one tick, collecting whatever goes off. With `lock` held
+static void Advance(std::vector<std::shared_ptr<Timer_t>>& expired)
+{
+	uint64_t tick = ++currentTick;
+
+	// Higher levels first, what they cascade may land in a lower level's slot that's also up now
+	if (!(tick & ((1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1)))
+		Cascade(beyond);
+	for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+	{
+		uint64_t mask = (1ULL << (level * TIMER_WHEEL_BITS)) - 1;
+		if (!(tick & mask))
+			Cascade(wheel[level][(tick >> (level * TIMER_WHEEL_BITS)) & (TIMER_WHEEL_SLOTS - 1)]);
+	}
+
+	TimerList_t& slot = wheel[0][tick & (TIMER_WHEEL_SLOTS - 1)];
+	for (auto& timer : slot)
+	{
+		timer->armed = false;
+		timer->slot = nullptr;
+		expired.push_back(timer);
+	}
+	armedCount -= slot.size();
+	slot.clear();
+}
+
+/// @brief The next tick something happens on, a level 0 slot with timers in it or the next cascade. With `lock` held
+static uint64_t NextEventTick()
+{
+	uint64_t boundary = (currentTick | (TIMER_WHEEL_SLOTS - 1)) + 1;
+	for (uint64_t tick = currentTick + 1; tick < boundary; tick++)
+		if (!wheel[0][tick & (TIMER_WHEEL_SLOTS - 1)].empty())
+			return tick;
+	return boundary;
+}
+
+static void ThreadMain()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	std::vector<std::shared_ptr<Timer_t>> expired;
+	while (!shuttingDown)
+	{
+		if (!armedCount)
+		{
+			cond.wait(guard);
+			continue;
+		}
+
+		uint64_t target = Now() / TIMER_TICK;
+		while (currentTick < target && armedCount)
+			Advance(expired);
+
+		if (!expired.empty())
+		{
+			guard.unlock();
+			for (auto& timer : expired)
+				timer->callback();
+			expired.clear();
+			guard.lock();
+			continue;
+		}
+
+		cond.wait_until(guard, start + std::chrono::nanoseconds(NextEventTick() * TIMER_TICK * 100));
+	}
+}
+
+void Initialize()
+{
+	host = std::thread(ThreadMain);
+}
+
+void Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		shuttingDown = true;
+		cond.notify_all();
+	}
+	host.join();
+}
+
+uint64_t Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 100;
+}
+
+uint64_t SystemTime()
+{
+	auto sinceEpoch = std::chrono::system_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count() / 100 + FILETIME_UNIX_EPOCH;
+}
+
+uint64_t DueTime(int64_t timeout)
+{
+	if (timeout < 0)
+		return Now() + (uint64_t)-timeout;
+
+	uint64_t now = SystemTime();
+	return Now() + ((uint64_t)timeout > now ? (uint64_t)timeout - now : 0);
+}
+
+void Arm(const std::shared_ptr<Timer_t>& timer, uint64_t due)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (timer->armed)
+		timer->slot->erase(timer->pos);
+	else
+		armedCount++;
+
+	// The wheel doesn't turn while nothing is armed, catch up without going through every tick in between
+	if (armedCount == 1)
+		currentTick = std::max(currentTick, Now() / TIMER_TICK);
+
+	// Rounded up, a timer never goes off early. Anything already due goes off on the next tick
+	timer->due = std::max((due + TIMER_TICK - 1) / TIMER_TICK, currentTick + 1);
+	timer->armed = true;
+	Insert(timer);
+	cond.notify_all();
+}
+
+bool Cancel(const std::shared_ptr<Timer_t>& timer)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (!timer->armed)
+		return false;
+
+	timer->slot->erase(timer->pos);
+	timer->slot = nullptr;
+	timer->armed = false;
+	armedCount--;
+	return true;
+}
+
+}
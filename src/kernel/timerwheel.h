@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <list>
+
+// Guest times are in 100ns units, the wheel turns once a millisecond
+#define TIMER_TICK 10000
+// Each level is 64 times coarser than the one below, four of them cover about four and a half hours
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+
+struct Timer_t;
+typedef std::list<std::shared_ptr<Timer_t>>::iterator TimerPos_t;
+
+/// @brief Something that happens at a point in time. Owned by whoever arms it, the wheel holds a reference while it's armed
+typedef struct Timer_t
+{
+	std::function<void()> callback; // Runs on the timer thread, without any of the wheel's locks held
+
+	// Managed by the wheel
+	uint64_t due; // In ticks
+	bool armed;
+	std::list<std::shared_ptr<Timer_t>>* slot;
+	TimerPos_t pos;
+} Timer_t;
+
+/// @brief Every timeout in the kernel: KTIMERs, wait timeouts and sleeps. A hierarchical timer wheel, so arming and
+/// cancelling are O(1) no matter how many timers are pending. Timers go in the level whose slots are just fine enough to tell
+/// their due time apart from now, and move down a level each time the level below comes round to their slot.
+/// A host thread turns the wheel and runs the callbacks, at a millisecond's resolution
+namespace TimerWheel
+{
+
+void Initialize();
+void Shutdown();
+
+/// @brief Time since startup in 100ns units, the clock due times are on
+uint64_t Now();
+/// @brief The time of day the guest sees, 100ns units since 1601 (a FILETIME)
+uint64_t SystemTime();
+/// @brief Converts an NT timeout (negative for relative to now, positive for an absolute system time) to a time on Now()'s clock
+uint64_t DueTime(int64_t timeout);
+
+/// @brief Arms `timer` to go off once Now() reaches `due`, or re-arms it if it's armed already
+void Arm(const std::shared_ptr<Timer_t>& timer, uint64_t due);
+/// @return Whether the timer was armed. One that's going off right now still calls back, its owner has to cope
+bool Cancel(const std::shared_ptr<Timer_t>& timer);
+
+}
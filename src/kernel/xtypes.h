@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <util.h>
+
+// Kernel structures as titles see them in guest memory. Map them with GuestPtr<T>::Map (see kernel/shim.h)
+// rather than reading and writing each field through Memory
+
+typedef struct
+{
+	be<uint32_t> flink;
+	be<uint32_t> blink;
+} X_LIST_ENTRY;
+static_assert(sizeof(X_LIST_ENTRY) == 0x08);
+
+typedef struct
+{
+	uint8_t type; // One of the DISPATCHER_ types in kernel/dispatcher.h
+	uint8_t absolute; // Critical sections keep their spin count / 256 here
+	uint8_t processType;
+	uint8_t inserted;
+	be<int32_t> signalState;
+	X_LIST_ENTRY waitList;
+} X_DISPATCHER_HEADER;
+static_assert(offsetof(X_DISPATCHER_HEADER, signalState) == 0x04);
+static_assert(offsetof(X_DISPATCHER_HEADER, waitList) == 0x08);
+static_assert(sizeof(X_DISPATCHER_HEADER) == 0x10);
+
+typedef struct
+{
+	be<uint16_t> type;
+	uint8_t selectedCpu;
+	uint8_t desiredCpu;
+	X_LIST_ENTRY listEntry;
+	be<uint32_t> routine;
+	be<uint32_t> context;
+	be<uint32_t> arg1;
+	be<uint32_t> arg2;
+} X_KDPC;
+static_assert(offsetof(X_KDPC, routine) == 0x0C);
+static_assert(offsetof(X_KDPC, arg2) == 0x18);
+static_assert(sizeof(X_KDPC) == 0x1C);
+
+typedef struct
+{
+	X_DISPATCHER_HEADER header;
+	X_LIST_ENTRY mutantListEntry;
+	be<uint32_t> owner; // The owning KTHREAD
+	uint8_t abandoned;
+} X_KMUTANT;
+static_assert(offsetof(X_KMUTANT, owner) == 0x18);
+static_assert(offsetof(X_KMUTANT, abandoned) == 0x1C);
+static_assert(sizeof(X_KMUTANT) == 0x20);
+
+typedef struct
+{
+	X_DISPATCHER_HEADER header;
+	be<int32_t> limit;
+} X_KSEMAPHORE;
+static_assert(offsetof(X_KSEMAPHORE, limit) == 0x10);
+static_assert(sizeof(X_KSEMAPHORE) == 0x14);
+
+typedef struct
+{
+	X_DISPATCHER_HEADER header;
+	be<uint64_t> dueTime;
+	X_LIST_ENTRY timerListEntry;
+	be<uint32_t> dpc;
+	be<uint32_t> period;
+} X_KTIMER;
+static_assert(offsetof(X_KTIMER, dueTime) == 0x10);
+static_assert(offsetof(X_KTIMER, dpc) == 0x20);
+static_assert(offsetof(X_KTIMER, period) == 0x24);
+static_assert(sizeof(X_KTIMER) == 0x28);
+
+/// @brief The header is a synchronization event, which contended entries wait on
+typedef struct
+{
+	X_DISPATCHER_HEADER header;
+	be<uint32_t> lockCount; // -1 when free
+	be<uint32_t> recursionCount;
+	be<uint32_t> owner; // The owning KTHREAD
+} X_RTL_CRITICAL_SECTION;
+static_assert(offsetof(X_RTL_CRITICAL_SECTION, lockCount) == 0x10);
+static_assert(offsetof(X_RTL_CRITICAL_SECTION, owner) == 0x18);
+static_assert(sizeof(X_RTL_CRITICAL_SECTION) == 0x1C);
+
+typedef struct
+{
+	be<uint16_t> length;
+	be<uint16_t> maximumLength;
+	be<uint32_t> buffer;
+} X_ANSI_STRING;
+static_assert(sizeof(X_ANSI_STRING) == 0x08);
+
+typedef struct
+{
+	be<uint32_t> rootDirectory;
+	be<uint32_t> name; // An X_ANSI_STRING
+	be<uint32_t> attributes;
+} X_OBJECT_ATTRIBUTES;
+static_assert(offsetof(X_OBJECT_ATTRIBUTES, name) == 0x04);
+static_assert(sizeof(X_OBJECT_ATTRIBUTES) == 0x0C);
+
+typedef struct
+{
+	be<uint32_t> baseAddress;
+	be<uint32_t> allocationBase;
+	be<uint32_t> allocationProtect;
+	be<uint32_t> regionSize;
+	be<uint32_t> state;
+	be<uint32_t> protect;
+	be<uint32_t> type;
+} X_MEMORY_BASIC_INFORMATION;
+static_assert(sizeof(X_MEMORY_BASIC_INFORMATION) == 0x1C);
+
+typedef struct
+{
+	be<uint16_t> year;
+	be<uint16_t> month;
+	be<uint16_t> day;
+	be<uint16_t> hour;
+	be<uint16_t> minute;
+	be<uint16_t> second;
+	be<uint16_t> milliseconds;
+	be<uint16_t> weekday;
+} X_TIME_FIELDS;
+static_assert(sizeof(X_TIME_FIELDS) == 0x10);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/// @brief A blocking FIFO with room for `capacity` items, for connecting the stages of a pipeline running on
+/// different threads. Push waits while it's full and Pop while it's empty, so a fast stage can only get so far ahead.
+/// Either end can Close it: Pop drains what's left and then fails, Push fails straight away
+template<typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+	/// @return false if the queue was closed, and `item` was dropped
+	bool Push(T&& item)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		notFull.wait(guard, [this] {return closed || items.size() < capacity;});
+		if (closed)
+			return false;
+
+		items.push_back(std::move(item));
+		notEmpty.notify_one();
+		return true;
+	}
+
+	/// @return false once the queue is closed and empty
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		notEmpty.wait(guard, [this] {return closed || !items.empty();});
+		if (items.empty())
+			return false;
+
+		item = std::move(items.front());
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	void Close()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		closed = true;
+		notFull.notify_all();
+		notEmpty.notify_all();
+	}
+private:
+	std::mutex lock;
+	std::condition_variable notFull, notEmpty;
+	std::deque<T> items;
+	size_t capacity;
+	bool closed = false;
+};
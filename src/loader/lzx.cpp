@@ -32,6 +32,11 @@ inline bool bit_scan_forward(int64_t v, uint32_t* out_first_set_index) {
   return bit_scan_forward(static_cast<uint64_t>(v), out_first_set_index);
 }
 
+typedef struct
+{
+	const LzxSource_t* source;
+} mspackStreamFile_t;
+
 mspackMemoryFile_t* mspack_memory_open(mspack_system* sys, void* buffer, const size_t size)
 {
 	auto memfile = (mspackMemoryFile_t*)calloc(1, sizeof(mspackMemoryFile_t));
@@ -69,6 +74,12 @@ int mspack_memory_write(mspack_file* file, void* buffer, int chars)
 	return (int)total;
 }
 
+int mspack_stream_read(mspack_file* file, void* buffer, int chars)
+{
+	auto stream = (mspackStreamFile_t*)file;
+	return (*stream->source)(buffer, chars);
+}
+
 void* mspack_memory_alloc(mspack_system*, size_t chars)
 {
 	return calloc(chars, 1);
@@ -146,5 +157,36 @@ int lzx_decompress(const void *lzx_data, size_t lzx_len, void *dest, size_t dest
 		sys = NULL;
 	}
 
+	return res;
+}
+
+int lzx_decompress_stream(const LzxSource_t& source, void* dest, size_t dest_len, uint32_t window_size)
+{
+	int res = 1;
+
+	uint32_t window_bits;
+	if (!bit_scan_forward(window_size, &window_bits))
+		return res;
+
+	mspack_system* sys = mspack_memory_sys_create();
+	if (!sys)
+		return res;
+	// Only the input is read, and only the output written
+	sys->read = mspack_stream_read;
+
+	mspackStreamFile_t lzxsrc = {&source};
+	mspackMemoryFile_t* lzxdst = mspack_memory_open(sys, dest, dest_len);
+	lzxd_stream* lzxd = lzxd_init(sys, (mspack_file*)&lzxsrc, (mspack_file*)lzxdst, window_bits, 0, 0x8000, (off_t)dest_len, 0);
+
+	if (lzxd)
+	{
+		res = lzxd_decompress(lzxd, (off_t)dest_len);
+		lzxd_free(lzxd);
+	}
+
+	if (lzxdst)
+		mspack_memory_close(lzxdst);
+	mspack_memory_sys_destroy(sys);
+
 	return res;
 }
\ No newline at end of file
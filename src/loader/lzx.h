@@ -2,7 +2,15 @@
 
 #include <string>
 #include <vector>
+#include <functional>
 
 int lzx_decompress(const void* lzx_data, size_t lzx_len, void* dest,
                    size_t dest_len, uint32_t window_size, void* window_data,
-                   size_t window_data_len);
\ No newline at end of file
+                   size_t window_data_len);
+
+/// @brief Where lzx_decompress_stream gets its compressed data: fills `buffer` with up to `len` bytes and returns how many,
+/// 0 once there's no more, or -1 on an error
+typedef std::function<int(void* buffer, int len)> LzxSource_t;
+
+/// @brief lzx_decompress, pulling the compressed data from `source` as the decoder needs it rather than from one buffer
+int lzx_decompress_stream(const LzxSource_t& source, void* dest, size_t dest_len, uint32_t window_size);
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include <loader/mappedfile.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string &path)
+{
+	Close();
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		printf("Failed to open file %s: %s\n", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		printf("Failed to open file %s: %s\n", path.c_str(), strerror(errno));
+		close(fd);
+		return false;
+	}
+	if (!st.st_size)
+	{
+		printf("Failed to open file %s: It's empty\n", path.c_str());
+		close(fd);
+		return false;
+	}
+
+	// The mapping keeps the file alive on its own
+	void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		printf("Failed to map file %s: %s\n", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	// It's read front to back
+	madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+	data = (uint8_t*)mapping;
+	size = st.st_size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		munmap(data, size);
+	data = nullptr;
+	size = 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/// @brief A file mapped read-only into the host's address space, so loading it doesn't copy it into a buffer first.
+/// Pages are only read in as they're touched, and it's unmapped again when the object goes away
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/// @return false, with the reason printed, if the file can't be opened or mapped
+	bool Open(const std::string& path);
+	void Close();
+
+	const uint8_t* Data() const {return data;}
+	size_t Size() const {return size;}
+private:
+	uint8_t* data = nullptr;
+	size_t size = 0;
+};
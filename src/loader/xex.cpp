@@ -4,16 +4,49 @@
 #include <cstdlib>
 #include <vector>
 #include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <functional>
 #include <fstream>
-#include <crypto/rijndael-alg-fst.h>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <crypto/aes.h>
+#include <crypto/sha1.h>
 #include <memory/memory.h>
+#include <memory/vmm.h>
 #include <util.h>
 #include <loader/lzx.h>
+#include <loader/boundedqueue.h>
 #include <kernel/kernel.h>
 #include <kernel/modules/xboxkrnl.h>
+#include <vfs/VFS.h>
+
+// How many blocks each stage of LZX decoding can get ahead of the next
+#define XEX_PIPELINE_DEPTH 4
 
 static uint32_t handle = 0x10000001;
 
+bool XexLoader::verifyHashes = false;
+bool XexLoader::useCache = true;
+
+// Bump this whenever the loader changes what ends up in the image, so older cache entries are decoded again
+#define XEX_CACHE_VERSION 1
+#define XEX_CACHE_MAGIC 0x43584557 // "WEXC"
+// The image starts a page into the file, so it can be mapped straight into guest memory
+#define XEX_CACHE_HEADER_SIZE 0x1000
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t baseAddress;
+	uint32_t imageSize;
+	uint8_t headerDigest[SHA1_DIGEST_SIZE];
+} xexCacheHeader_t;
+
 XexLoader* xam;
 
 uint32_t mainXexBase, mainXexSize;
@@ -28,23 +61,136 @@ void aes_decrypt_buffer(const uint8_t* session_key, const uint8_t* input_buffer,
                         const size_t input_size, uint8_t* output_buffer,
                         const size_t output_size)
 {
-	uint32_t rk[4 * (MAXNR + 1)];
-	uint8_t ivec[16] = {0};
-	int32_t Nr = rijndaelKeySetupDec(rk, session_key, 128);
-	const uint8_t* ct = input_buffer;
-	uint8_t* pt = output_buffer;
-	for (size_t n = 0; n < input_size; n += 16, ct += 16, pt += 16)
-	{
-		rijndaelDecrypt(rk, Nr, ct, pt);
-		for (size_t i = 0; i < 16; i++)
+	const AesBackend_t* aes = aes_backend();
+	AesKey_t key;
+	uint8_t ivec[AES_BLOCK_SIZE] = {0};
+	aes->keySetupDec(&key, session_key);
+	aes->cbcDecrypt(&key, ivec, input_buffer, output_buffer, std::min(input_size, output_size) / AES_BLOCK_SIZE);
+}
+
+/// @brief The image payload, everything after the headers, as one stream of plaintext that's decrypted as it's read.
+/// The whole payload is a single CBC chain, so reads pick up where the last one left off
+class PayloadReader
+{
+public:
+	/// @param key The session key, or nullptr if the payload isn't encrypted
+	/// @param offset Where in the payload to start reading. Each block's IV is just the ciphertext before it,
+	/// so reading can start anywhere without decrypting what comes first
+	PayloadReader(const uint8_t* data, size_t size, const uint8_t* key, size_t offset = 0)
+	: end(data + size), encrypted(key), aes(aes_backend())
+	{
+		offset = std::min(offset, size);
+		p = data + (offset & ~15);
+		if (encrypted)
+		{
+			aes->keySetupDec(&aesKey, key);
+			if (p != data)
+				memcpy(iv, p - 16, 16);
+		}
+
+		uint8_t skip[16];
+		Read(skip, offset % 16);
+	}
+
+	/// @brief How many bytes of the file are left to read
+	size_t Remaining() const
+	{
+		return (end - p) + (16 - carryPos);
+	}
+
+	/// @brief Reads the next `len` bytes into `out`. Anything past the end of the file reads as zeroes
+	void Read(uint8_t* out, size_t len)
+	{
+		while (len)
 		{
-			pt[i] ^= ivec[i];
-			ivec[i] = ct[i];
+			// What's left of a block that was decrypted for an earlier, unaligned read
+			if (carryPos < 16)
+			{
+				size_t n = std::min(len, 16 - carryPos);
+				memcpy(out, carry + carryPos, n);
+				carryPos += n;
+				out += n;
+				len -= n;
+				continue;
+			}
+
+			size_t avail = end - p;
+			if (!avail)
+			{
+				memset(out, 0, len);
+				return;
+			}
+
+			if (!encrypted)
+			{
+				size_t n = std::min(len, avail);
+				memcpy(out, p, n);
+				p += n;
+				out += n;
+				len -= n;
+			}
+			else if (len >= 16 && avail >= 16)
+			{
+				size_t n = std::min(len, avail) & ~15;
+				DecryptBlocks(p, out, n / 16);
+				p += n;
+				out += n;
+				len -= n;
+			}
+			else
+			{
+				uint8_t in[16] = {0};
+				size_t n = std::min<size_t>(16, avail);
+				memcpy(in, p, n);
+				p += n;
+				DecryptBlocks(in, carry, 1);
+				carryPos = 0;
+			}
 		}
 	}
+private:
+	void DecryptBlocks(const uint8_t* in, uint8_t* out, size_t count)
+	{
+		aes->cbcDecrypt(&aesKey, iv, in, out, count);
+	}
+
+	const uint8_t* p;
+	const uint8_t* end;
+	bool encrypted;
+	const AesBackend_t* aes;
+	AesKey_t aesKey;
+	uint8_t iv[16] = {0};
+	uint8_t carry[16];
+	size_t carryPos = 16;
+};
+
+/// @brief Runs `fn(0)` through `fn(count - 1)` on as many threads as the host has cores, each taking the next index when it's done
+static void ParallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+	std::atomic<size_t> next(0);
+	auto worker = [&]
+	{
+		for (size_t i; (i = next++) < count;)
+			fn(i);
+	};
+
+	size_t threads = std::min<size_t>(count, std::max(1U, std::thread::hardware_concurrency()));
+	std::vector<std::thread> pool;
+	for (size_t i = 1; i < threads; i++)
+		pool.emplace_back(worker);
+	worker();
+	for (auto& thread : pool)
+		thread.join();
+}
+
+/// @brief Lowers `first` to `index`, for finding the first failure out of ones found in any order
+static void RecordFirst(std::atomic<size_t>& first, size_t index)
+{
+	size_t current = first;
+	while (index < current && !first.compare_exchange_weak(current, index));
 }
 
-XexLoader::XexLoader(uint8_t *buffer, size_t len, std::string path)
+XexLoader::XexLoader(const uint8_t *buffer, size_t len, std::string path)
 : IModule(path.substr(path.find_last_of('/')+1).c_str())
 {
 	this->buffer = buffer;
@@ -84,7 +230,7 @@ XexLoader::XexLoader(uint8_t *buffer, size_t len, std::string path)
 		mainXexSize = image_size();
 
 	// Parse security info, including AES key decryption
-	uint8_t* aes_key = (buffer+header.sec_info_offset+336);
+	const uint8_t* aes_key = (buffer+header.sec_info_offset+336);
 	aes_decrypt_buffer(xe_xex2_retail_key, aes_key, 16, session_key, 16);
 
 	printf("AES key is 0x%02x", session_key[0]);
@@ -128,38 +274,50 @@ XexLoader::XexLoader(uint8_t *buffer, size_t len, std::string path)
 		}
 	}
 
-	// Decrypt/decompress the file
-	printf("%d, %d\n", encryptionFormat, compressionFormat);
-	char* outBuffer;
-	uint32_t uncompressedSize;
-	switch (compressionFormat)
-	{
-	case 1:
-		uncompressedSize = ReadImageBasicCompressed(buffer, len, &outBuffer);
-		break;
-	case 2:
-		uncompressedSize = ReadImageCompressed(buffer, len, &outBuffer);
-		break;
-	default:
-		printf("Unknown compression format %d\n", compressionFormat);
-		exit(1);
+	uint32_t imageSize = image_size();
+	VMM::AllocateAt(baseAddress, imageSize);
+	sha1(buffer, header.header_size, headerDigest);
+
+	// Decrypt/decompress the file straight into the image's pages, which start out zeroed, unless it's been done before
+	bool cached = useCache && LoadCachedImage(imageSize);
+	uint8_t* image = Memory::Map(baseAddress, imageSize, true);
+	bool decoded = false;
+	if (!cached)
+	{
+		printf("%d, %d\n", encryptionFormat, compressionFormat);
+		if (verifyHashes && compressionFormat == 2)
+			VerifyCompressionBlocks(buffer, len);
+
+		switch (compressionFormat)
+		{
+		case 1:
+			decoded = ReadImageBasicCompressed(buffer, len, image, imageSize);
+			break;
+		case 2:
+			decoded = ReadImageCompressed(buffer, len, image, imageSize);
+			break;
+		default:
+			printf("Unknown compression format %d\n", compressionFormat);
+			exit(1);
+		}
 	}
 
-	std::ofstream out("out.pe");
-	out.write(outBuffer, uncompressedSize);
-	out.close();
+	// A cached image is checked too, the cache file may have been damaged since
+	if (verifyHashes)
+		VerifyPages(image, imageSize);
 
-	// We've got the PE header inside outBuffer now
-	if (*(uint32_t*)outBuffer != 0x00905a4d /*"PE" followed by 0x9000*/)
+	// Only images that decoded cleanly are worth keeping
+	if (useCache && decoded)
+		StoreCachedImage(image, imageSize);
+
+	// We've got the PE header at the start of the image now
+	if (*(uint32_t*)image != 0x00905a4d /*"PE" followed by 0x9000*/)
 	{
 		printf("Invalid PE magic\n");
 	}
 	else
 		printf("Found valid PE header file\n");
 
-	void* base = Memory::AllocMemory(baseAddress, uncompressedSize);
-	memcpy(base, outBuffer, uncompressedSize);
-
 	// Load exports
 	exportBaseAddr = bswap32(*(uint32_t*)&buffer[header.sec_info_offset+0x160]);
 	if (exportBaseAddr)
@@ -215,7 +373,7 @@ XexLoader::XexLoader(uint8_t *buffer, size_t len, std::string path)
 
 		printf("Parsing imports for \"%s\"\n", lib.name.c_str());
 		
-		ParseLibraryInfo(importBaseAddr+libraryoffs+sizeof(libraryHeader_t), lib, libraries.size(), lib.name);
+		ParseLibraryInfo(importBaseAddr+libraryoffs+sizeof(libraryHeader_t), lib, lib.name);
 
 		libraries.push_back(lib);
 
@@ -223,6 +381,9 @@ XexLoader::XexLoader(uint8_t *buffer, size_t len, std::string path)
 	}
 
 	Kernel::RegisterModuleForName(GetName().c_str(), this);
+
+	// The file's the caller's, and may be gone once we return
+	this->buffer = nullptr;
 }
 
 uint32_t XexLoader::GetEntryPoint() const
@@ -275,7 +436,7 @@ void XexLoader::ParseFileInfo(uint32_t offset)
 	info = fileInfo;
 }
 
-void XexLoader::ParseLibraryInfo(uint32_t offset, xexLibrary_t &lib, int index, std::string& name)
+void XexLoader::ParseLibraryInfo(uint32_t offset, xexLibrary_t &lib, std::string& name)
 {
 	for (uint32_t i = 0; i < lib.header.count; i++)
 	{
@@ -285,13 +446,15 @@ void XexLoader::ParseLibraryInfo(uint32_t offset, xexLibrary_t &lib, int index,
 		uint32_t record = Memory::Read32(recordAddr);
 
 		// Write the following routine to RAM:
-		// li r11, mod_func_id
+		// li r11, thunk_id
 		// sc 2
 		// blr
 		// nop
 		if ((record >> 24) == 1 && name != "xam.xex")
 		{
-			Memory::Write32(recordAddr+0x00, 0x39600000 | (index << 12) | (record & 0xFFFF));
+			IModule* mod = Kernel::GetModuleByName(name.c_str());
+			uint32_t thunk = mod ? Kernel::BindThunk(mod, record & 0xFFFF) : Kernel::BindMissingThunk(name, record & 0xFFFF);
+			Memory::Write32(recordAddr+0x00, 0x39600000 | thunk);
 			Memory::Write32(recordAddr+0x04, 0x44000042);
 			Memory::Write32(recordAddr+0x08, 0x4e800020);
 			Memory::Write32(recordAddr+0x0C, 0x60000000);
@@ -310,7 +473,9 @@ void XexLoader::ParseLibraryInfo(uint32_t offset, xexLibrary_t &lib, int index,
 		}
 		else
 		{
-			if (name == "xboxkrnl.exe" && krnlModule.IsExportVariable(record & 0xFFFF))
+			IModule* mod = Kernel::GetModuleByName(name.c_str());
+			const Export_t* exp = mod ? mod->LookupExport(record & 0xFFFF) : nullptr;
+			if (exp && exp->kind == EXPORT_VARIABLE)
 			{
 				printf("TODO: Variable import 0x%08x\n", record);
 			}
@@ -318,143 +483,331 @@ void XexLoader::ParseLibraryInfo(uint32_t offset, xexLibrary_t &lib, int index,
 	}
 }
 
-int XexLoader::ReadImageBasicCompressed(uint8_t *buffer, size_t xex_len, char** outBuffer)
+bool XexLoader::ReadImageBasicCompressed(const uint8_t *buffer, size_t xex_len, uint8_t* image, uint32_t imageSize)
 {
-	const uint8_t* p = buffer+header.header_size;
-	std::vector<basicCompression_t> blocks((info.info_size - 8) / 8);
-	uint32_t uncompressedSize = 0;
-	for (size_t i = 0; i < (info.info_size - 8) / 8; i++)
-	{
-		uint32_t offset = fileInfoOffset + 8 + (i * 8);
-		basicCompression_t comp = *(basicCompression_t*)&buffer[offset];
-		comp.data_size = bswap32(comp.data_size);
-		comp.zero_size = bswap32(comp.zero_size);
-		blocks.push_back(comp);
-		uncompressedSize += comp.data_size + comp.zero_size;
+	PayloadReader payload(buffer + header.header_size, xex_len - header.header_size, encryptionFormat ? session_key : nullptr);
+
+	size_t blockCount = (info.info_size - 8) / 8;
+	uint8_t* d = image;
+	for (size_t i = 0; i < blockCount; i++)
+	{
+		basicCompression_t block = *(basicCompression_t*)&buffer[fileInfoOffset + 8 + (i * 8)];
+		block.data_size = bswap32(block.data_size);
+		block.zero_size = bswap32(block.zero_size);
+
+		if ((uint64_t)(d - image) + block.data_size + block.zero_size > imageSize)
+		{
+			printf("ERROR: Image data runs past the end of the image (0x%08x bytes)\n", imageSize);
+			exit(1);
+		}
+
+		// The zeroes are already there
+		payload.Read(d, block.data_size);
+		d += block.data_size + block.zero_size;
 	}
 
-	printf("Image is %d bytes uncompressed\n", uncompressedSize);
+	printf("Image is %ld bytes uncompressed\n", d - image);
+	return true;
+}
+
+bool XexLoader::ReadImageCompressed(const uint8_t *buffer, size_t xex_len, uint8_t* image, uint32_t imageSize)
+{
+	PayloadReader payload(buffer + header.header_size, xex_len - header.header_size, encryptionFormat ? session_key : nullptr);
 
-	char* out = new char[uncompressedSize];
-	*outBuffer = out;
-	uint8_t* d = (uint8_t*)out;
+	normalCompressionHeader_t hdr = *(normalCompressionHeader_t*)(buffer + fileInfoOffset + sizeof(fileFormatInfo_t));
+	hdr.windowSize = bswap32(hdr.windowSize);
+	hdr.firstBlock.blockSize = bswap32(hdr.firstBlock.blockSize);
 
-	uint32_t rk[4 * (MAXNR + 1)];
-	uint8_t ivec[16] = {0};
-	int32_t Nr = rijndaelKeySetupDec(rk, session_key, 128);
+	// Each block starts with the next block's size and hash, followed by chunks of LZX data,
+	// each with a 16-bit size in front, up to one of size 0.
+	// Three stages go through the blocks at once, each on its own thread: decrypting them off the file,
+	// stripping them down to just their LZX data, and decoding that into the image.
+	// The queues between them only hold a few blocks, so memory use doesn't grow with the image
+	BoundedQueue<std::vector<uint8_t>> decrypted(XEX_PIPELINE_DEPTH), compressed(XEX_PIPELINE_DEPTH);
+	std::atomic<bool> corrupt = false;
 
-	for (size_t n = 0; n < blocks.size(); n++)
+	std::thread decryptStage([&]
 	{
-		const uint32_t dataSize = blocks[n].data_size;
-		const uint32_t zeroSize = blocks[n].zero_size;
+		uint32_t blockSize = hdr.firstBlock.blockSize;
+		while (blockSize)
+		{
+			// A size from a damaged file could ask for gigabytes, and anything past its end would just read as zeroes
+			if (blockSize < sizeof(normalCompressionBlock_t) || blockSize > payload.Remaining())
+			{
+				corrupt = true;
+				break;
+			}
+
+			std::vector<uint8_t> block(blockSize);
+			payload.Read(block.data(), blockSize);
+			blockSize = bswap32(*(uint32_t*)block.data());
+			if (!decrypted.Push(std::move(block)))
+				break;
+		}
+		decrypted.Close();
+	});
+
+	std::thread reassembleStage([&]
+	{
+		std::vector<uint8_t> block;
+		while (decrypted.Pop(block))
+		{
+			// The chunks are moved down over the headers in place
+			size_t pos = sizeof(normalCompressionBlock_t), end = 0;
+			while (pos + 2 <= block.size())
+			{
+				size_t chunkSize = (block[pos] << 8) | block[pos + 1];
+				pos += 2;
+				if (!chunkSize)
+					break;
+				if (pos + chunkSize > block.size())
+				{
+					corrupt = true;
+					break;
+				}
+
+				memmove(&block[end], &block[pos], chunkSize);
+				pos += chunkSize;
+				end += chunkSize;
+			}
 
-		const uint8_t* ct = p;
-		uint8_t* pt = d;
-		for (size_t m = 0; m < dataSize; m += 16, ct += 16, pt += 16)
+			block.resize(end);
+			if (corrupt || !compressed.Push(std::move(block)))
+				break;
+		}
+		// Unblocks the decrypt stage too, if we stopped early
+		decrypted.Close();
+		compressed.Close();
+	});
+
+	std::vector<uint8_t> block;
+	size_t pos = 0;
+	LzxSource_t source = [&](void* outPtr, int len) -> int
+	{
+		uint8_t* out = (uint8_t*)outPtr;
+		int total = 0;
+		while (total < len)
 		{
-			rijndaelDecrypt(rk, Nr, ct, pt);
-			for (size_t i = 0; i < 16; i++)
+			if (pos == block.size())
 			{
-				pt[i] ^= ivec[i];
-				ivec[i] = ct[i];
+				pos = 0;
+				if (!compressed.Pop(block))
+				{
+					block.clear();
+					break;
+				}
+				continue;
 			}
+
+			size_t n = std::min<size_t>(block.size() - pos, len - total);
+			memcpy(out + total, &block[pos], n);
+			pos += n;
+			total += n;
 		}
 
-		p += dataSize;
-		d += dataSize + zeroSize;
+		return (!total && corrupt) ? -1 : total;
+	};
+
+	int result = lzx_decompress_stream(source, image, imageSize, hdr.windowSize);
+
+	// The decoder can finish without reading everything, the stages might still be waiting to hand over more
+	compressed.Close();
+	decrypted.Close();
+	decryptStage.join();
+	reassembleStage.join();
+
+	if (result || corrupt)
+	{
+		printf("WARNING: Image failed to decompress\n");
+		return false;
 	}
 
-	return uncompressedSize;
+	return true;
 }
 
-int XexLoader::ReadImageCompressed(uint8_t *buffer, size_t xex_len, char **outBuffer)
+void XexLoader::VerifyCompressionBlocks(const uint8_t *buffer, size_t xex_len)
 {
-	const uint32_t exe_length = (uint32_t)(xex_len - header.header_size);
-	const uint8_t* exe_buffer = (const uint8_t*)(buffer + header.header_size);
-
-	uint8_t* compress_buffer = NULL;
-	const uint8_t* p = NULL;
-	uint8_t* d = NULL;
-
-	bool free_input = false;
-	const uint8_t* input_buffer = exe_buffer;
-	size_t input_size = exe_length;
-
-	switch (encryptionFormat)
-	{
-	case 0:
-		break;
-	case 1:
-		free_input = true;
-		input_buffer = (const uint8_t*)calloc(1, exe_length);
-		aes_decrypt_buffer(session_key, exe_buffer, exe_length, (uint8_t*)input_buffer, exe_length);
-		break;
+	typedef struct
+	{
+		size_t offset; // In the payload
+		uint32_t size;
+		uint8_t hash[SHA1_DIGEST_SIZE];
+	} Block_t;
+
+	const uint8_t* data = buffer + header.header_size;
+	size_t size = xex_len - header.header_size;
+	const uint8_t* key = encryptionFormat ? session_key : nullptr;
+
+	// Walking the chain only needs the start of each block decrypted
+	std::vector<Block_t> blocks;
+	normalCompressionBlock_t cur = ((normalCompressionHeader_t*)(buffer + fileInfoOffset + sizeof(fileFormatInfo_t)))->firstBlock;
+	cur.blockSize = bswap32(cur.blockSize);
+	for (size_t offset = 0; cur.blockSize; offset += blocks.back().size)
+	{
+		if (cur.blockSize < sizeof(normalCompressionBlock_t) || offset + cur.blockSize > size)
+		{
+			printf("ERROR: Compression block %ld at 0x%08lx runs past the end of the file\n", blocks.size(), header.header_size + offset);
+			exit(1);
+		}
+
+		Block_t block = {};
+		block.offset = offset;
+		block.size = cur.blockSize;
+		memcpy(block.hash, cur.blockHash, SHA1_DIGEST_SIZE);
+		blocks.push_back(block);
+
+		PayloadReader(data, size, key, offset).Read((uint8_t*)&cur, sizeof(cur));
+		cur.blockSize = bswap32(cur.blockSize);
 	}
 
-	normalCompressionHeader_t hdr = *(normalCompressionHeader_t*)(buffer + fileInfoOffset + sizeof(fileFormatInfo_t));
-	hdr.windowSize = bswap32(hdr.windowSize);
-	hdr.firstBlock.blockSize = bswap32(hdr.firstBlock.blockSize);
+	std::atomic<size_t> firstBad(SIZE_MAX);
+	ParallelFor(blocks.size(), [&](size_t i)
+	{
+		std::vector<uint8_t> plain(blocks[i].size);
+		PayloadReader(data, size, key, blocks[i].offset).Read(plain.data(), plain.size());
+
+		uint8_t digest[SHA1_DIGEST_SIZE];
+		sha1(plain.data(), plain.size(), digest);
+		if (memcmp(digest, blocks[i].hash, SHA1_DIGEST_SIZE))
+			RecordFirst(firstBad, i);
+	});
 
-	normalCompressionBlock_t curBlock = hdr.firstBlock;
+	if (size_t bad = firstBad; bad != SIZE_MAX)
+	{
+		printf("ERROR: Compression block %ld at 0x%08lx fails its hash check\n", bad, header.header_size + blocks[bad].offset);
+		exit(1);
+	}
 
-	compress_buffer = (uint8_t*)calloc(1, exe_length);
+	printf("Verified %ld compression blocks\n", blocks.size());
+}
 
-	p = input_buffer;
-	d = compress_buffer;
+void XexLoader::VerifyPages(const uint8_t *image, uint32_t imageSize)
+{
+	typedef struct
+	{
+		uint32_t offset; // In the image
+		uint32_t size;
+		const char* digest;
+	} Range_t;
 
-	int result_code = 0;
+	uint32_t pageDescriptorCount = bswap32(*(uint32_t*)&buffer[header.sec_info_offset + 0x180]);
+	uint32_t pageSize = PageSize();
 
-	uint32_t blockOffs = sizeof(normalCompressionBlock_t);
-	while (curBlock.blockSize)
+	// Each descriptor's digest covers the pages it describes
+	std::vector<Range_t> ranges;
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < pageDescriptorCount; i++)
 	{
-		const uint8_t* pnext = p + curBlock.blockSize;
-		normalCompressionBlock_t next_block = *(normalCompressionBlock_t*)p;
-		blockOffs += sizeof(normalCompressionBlock_t);
+		const pageDescriptor_t* desc = (const pageDescriptor_t*)&buffer[header.sec_info_offset + 0x184 + (i * 0x18)];
+		pageDescriptor_t page = *desc;
+		page.value = bswap32(page.value);
 
-		next_block.blockSize = bswap32(next_block.blockSize);
+		ranges.push_back({offset, page.page_count * pageSize, desc->data_digest});
+		offset += page.page_count * pageSize;
+	}
 
-		p += 4;
-		p += 20;
+	if (offset > imageSize)
+	{
+		printf("ERROR: Page descriptors cover 0x%08x bytes, but the image is 0x%08x\n", offset, imageSize);
+		exit(1);
+	}
 
-		while (true)
-		{
-			const size_t chunk_size = (p[0] << 8) | p[1];
-			p += 2;
-			if (!chunk_size)
-				break;
-			
-			memcpy(d, p, chunk_size);
-			p += chunk_size;
-			d += chunk_size;
-		}
+	std::atomic<size_t> firstBad(SIZE_MAX);
+	ParallelFor(ranges.size(), [&](size_t i)
+	{
+		uint8_t digest[SHA1_DIGEST_SIZE];
+		sha1(image + ranges[i].offset, ranges[i].size, digest);
+		if (memcmp(digest, ranges[i].digest, SHA1_DIGEST_SIZE))
+			RecordFirst(firstBad, i);
+	});
 
-		p = pnext;
-		curBlock = next_block;
+	if (size_t bad = firstBad; bad != SIZE_MAX)
+	{
+		printf("ERROR: Pages at 0x%08x (page descriptor %ld) fail their hash check\n", baseAddress + ranges[bad].offset, bad);
+		exit(1);
 	}
 
-	uint32_t uncompressed_size = image_size();
-	char* out = new char[uncompressed_size];
+	printf("Verified %ld page ranges\n", ranges.size());
+}
 
-	(*outBuffer) = out;
+std::string XexLoader::CachePath() const
+{
+	char name[SHA1_DIGEST_SIZE * 2 + 1];
+	for (int i = 0; i < SHA1_DIGEST_SIZE; i++)
+		sprintf(&name[i * 2], "%02x", headerDigest[i]);
+	return VFS::GetRootDirectory() + "/cache/" + name + ".img";
+}
 
-	if (!result_code)
+bool XexLoader::LoadCachedImage(uint32_t imageSize)
+{
+	std::string cachePath = CachePath();
+	int fd = open(cachePath.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	xexCacheHeader_t hdr;
+	struct stat st;
+	bool valid = pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && fstat(fd, &st) == 0
+		&& hdr.magic == XEX_CACHE_MAGIC && hdr.version == XEX_CACHE_VERSION
+		&& hdr.baseAddress == baseAddress && hdr.imageSize == imageSize
+		&& !memcmp(hdr.headerDigest, headerDigest, SHA1_DIGEST_SIZE)
+		&& (uint64_t)st.st_size == XEX_CACHE_HEADER_SIZE + (uint64_t)imageSize;
+
+	bool loaded = valid && Memory::MapFile(baseAddress, imageSize, fd, XEX_CACHE_HEADER_SIZE);
+	close(fd);
+
+	if (valid && !loaded)
 	{
-		std::memset(out, 0, uncompressed_size);
+		// Whatever did make it in has to go, the decoders count on the image starting out zeroed
+		printf("WARNING: Failed to read cached image %s, decoding it again\n", cachePath.c_str());
+		memset(Memory::Map(baseAddress, imageSize, true), 0, imageSize);
+	}
+	else if (loaded)
+		printf("Loaded image from %s\n", cachePath.c_str());
 
-		result_code = lzx_decompress(compress_buffer, d - compress_buffer, out, uncompressed_size,
-          hdr.windowSize, nullptr, 0);
+	return loaded;
+}
+
+void XexLoader::StoreCachedImage(const uint8_t *image, uint32_t imageSize)
+{
+	std::string cachePath = CachePath();
+	std::string tempPath = cachePath + ".tmp";
+
+	std::error_code err;
+	std::filesystem::create_directories(VFS::GetRootDirectory() + "/cache", err);
+
+	xexCacheHeader_t hdr = {};
+	hdr.magic = XEX_CACHE_MAGIC;
+	hdr.version = XEX_CACHE_VERSION;
+	hdr.baseAddress = baseAddress;
+	hdr.imageSize = imageSize;
+	memcpy(hdr.headerDigest, headerDigest, SHA1_DIGEST_SIZE);
+	std::vector<char> headerPage(XEX_CACHE_HEADER_SIZE);
+	memcpy(headerPage.data(), &hdr, sizeof(hdr));
+
+	// Written to the side and renamed over, so nothing ever loads a half written entry
+	std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+	out.write(headerPage.data(), headerPage.size());
+	out.write((const char*)image, imageSize);
+	out.close();
+
+	if (!out || (std::filesystem::rename(tempPath, cachePath, err), err))
+	{
+		printf("WARNING: Failed to write cached image %s\n", cachePath.c_str());
+		std::filesystem::remove(tempPath, err);
 	}
+}
 
-	if (compress_buffer)
-		free((void*)compress_buffer);
-	if (free_input)
-		free((void*)input_buffer);
-	return uncompressed_size;
+uint32_t XexLoader::PageSize() const
+{
+	uint32_t imageFlags = bswap32(*(uint32_t*)&buffer[header.sec_info_offset + 0x10C]);
+	return (imageFlags & XEX_IMAGE_PAGE_SIZE_4KB) ? 4096 : 64*1024;
 }
 
 uint32_t XexLoader::image_size()
 {
 	uint32_t pageDescriptorCount = bswap32(*(uint32_t*)&buffer[header.sec_info_offset + 0x180]);
+	uint32_t pageSize = PageSize();
 
 	uint32_t totalSize = 0;
 
@@ -464,7 +817,7 @@ uint32_t XexLoader::image_size()
 		pageDescriptor_t page = *(pageDescriptor_t*)&buffer[offs];
 		page.value = bswap32(page.value);
 		
-		totalSize += page.value * 4096;
+		totalSize += page.page_count * pageSize;
 	}
 
 	return totalSize;
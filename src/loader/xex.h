@@ -5,6 +5,7 @@
 #include <vector>
 #include <string>
 #include <kernel/Module.h>
+#include <crypto/sha1.h>
 
 /// @brief The header of a .xex file
 typedef struct
@@ -105,15 +106,19 @@ typedef struct
 	uint32_t base;
 } xexExport_t;
 
+// Security info image flags
+#define XEX_IMAGE_PAGE_SIZE_4KB 0x10000000
+
 extern uint32_t mainXexBase, mainXexSize;
 
 class XexLoader : public IModule
 {
 public:
-	/// @brief Loads a .xex file from a buffer into memory
-	/// @param buffer The contents of the .xex file, loaded into memory
+	/// @brief Loads a .xex file from a buffer into memory. The image is decrypted and decompressed straight into guest memory,
+	/// so the buffer is best a MappedFile (see loader/mappedfile.h). It's only needed until this returns
+	/// @param buffer The contents of the .xex file
 	/// @param len The size, in bytes, of the file buffer
-	XexLoader(uint8_t* buffer, size_t len, std::string path);
+	XexLoader(const uint8_t* buffer, size_t len, std::string path);
 
 	uint32_t GetEntryPoint() const;
 	uint32_t GetStackSize() const;
@@ -127,20 +132,38 @@ public:
 
 	uint32_t LookupOrdinal(uint32_t ordinal);
 	virtual uint32_t GetHandle() const {return xexHandle;}
+
+	/// @brief Check every compression block and page of the images loaded from now on against the hashes in the file,
+	/// and refuse to load corrupt ones
+	static bool verifyHashes;
+	/// @brief Keep decoded images under the VFS root's cache directory, and load them from there when the same .xex comes up again
+	static bool useCache;
 private:
 	void ParseFileInfo(uint32_t offset);
-	void ParseLibraryInfo(uint32_t offset, xexLibrary_t& lib, int index, std::string& name);
-
-	int ReadImageBasicCompressed(uint8_t* buffer, size_t xex_len, char** outBuffer);
-	int ReadImageCompressed(uint8_t* buffer, size_t xex_len, char** outBuffer);
+	void ParseLibraryInfo(uint32_t offset, xexLibrary_t& lib, std::string& name);
+
+	/// @brief Fill in the committed image at `image` from the file's payload
+	/// @return false if it didn't decode cleanly
+	bool ReadImageBasicCompressed(const uint8_t* buffer, size_t xex_len, uint8_t* image, uint32_t imageSize);
+	bool ReadImageCompressed(const uint8_t* buffer, size_t xex_len, uint8_t* image, uint32_t imageSize);
+	/// @brief Hash checks for verifyHashes. Everything's hashed in parallel, any mismatch is fatal
+	void VerifyCompressionBlocks(const uint8_t* buffer, size_t xex_len);
+	void VerifyPages(const uint8_t* image, uint32_t imageSize);
+
+	/// @brief The decoded image is cached by a hash of the headers, which hold the digests of every page
+	std::string CachePath() const;
+	/// @return false if there's no usable cache entry, in which case the image has to be decoded
+	bool LoadCachedImage(uint32_t imageSize);
+	void StoreCachedImage(const uint8_t* image, uint32_t imageSize);
 
 	xexHeader_t header;
 	uint32_t xexHandle;
 
 	std::string path;
 
-	uint8_t* buffer;
+	const uint8_t* buffer; // The file, only while it's being loaded
 	uint8_t session_key[16];
+	uint8_t headerDigest[SHA1_DIGEST_SIZE];
 
 	uint16_t compressionFormat, encryptionFormat;
 	uint32_t fileInfoOffset = 0;
@@ -158,6 +181,7 @@ private:
 	
 	std::vector<xexLibrary_t> libraries;
 
+	uint32_t PageSize() const;
 	uint32_t image_size();
 };
 
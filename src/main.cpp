@@ -1,18 +1,32 @@
 #include <loader/xex.h>
+#include <loader/mappedfile.h>
 #include <memory/memory.h>
 #include <cpu/CPU.h>
 #include <cstdio>
-#include <fstream>
 #include <kernel/kernel.h>
 #include <kernel/modules/xboxkrnl.h>
 #include <vfs/VFS.h>
+#include <cpu/trace.h>
+#include <cpu/jit/jit.h>
+#include <cpu/ir/frontend.h>
+#include <cpu/hwthread.h>
+#include <kernel/timerwheel.h>
+#include <kernel/scheduler.h>
+#include <kernel/pool.h>
+#include <cstring>
 
-CPUThread* mainThread;
 uint32_t mainThreadStackSize;
 
 void atexit_handler()
 {
-	mainThread->Dump();
+	// exit() can come from any hardware thread, stop the others before looking at state they're changing
+	HardwareThreads::PauseAll();
+
+	HardwareThread* hw = HardwareThreads::GetCurrent();
+	if (!hw)
+		hw = HardwareThreads::Get(0);
+	if (hw)
+		hw->GetCPU()->Dump();
 }
 
 int main(int argc, char** argv)
@@ -24,62 +38,114 @@ int main(int argc, char** argv)
 	VFS::MountDirectory("/Device/Harddisk0/Partition1", "drv0p1");
 	VFS::MountDirectory("/Device/Cdrom0", "cdrom");
 
-	if (argc < 2)
+	const char* xexPath = nullptr;
+	bool useJit = false;
+	bool useIR = false;
+	bool useFastmem = false;
+	bool poolStats = false;
+	for (int i = 1; i < argc; i++)
 	{
-		printf("Usage: %s <xex name>\n", argv[0]);
+		if (!strcmp(argv[i], "--trace"))
+			Trace::EnableText();
+		else if (!strncmp(argv[i], "--trace-file=", 13))
+		{
+			if (!Trace::EnableBinary(argv[i]+13))
+				return 1;
+		}
+		else if (!strcmp(argv[i], "--jit"))
+			useJit = true;
+		else if (!strcmp(argv[i], "--ir"))
+			useIR = true;
+		else if (!strcmp(argv[i], "--fastmem"))
+			useFastmem = true;
+		else if (!strcmp(argv[i], "--pool-stats"))
+			poolStats = true;
+		else if (!strcmp(argv[i], "--verify-xex"))
+			XexLoader::verifyHashes = true;
+		else if (!strcmp(argv[i], "--no-xex-cache"))
+			XexLoader::useCache = false;
+		else if (argv[i][0] == '-')
+		{
+			printf("Unknown option \"%s\"\n", argv[i]);
+			return 1;
+		}
+		else
+			xexPath = argv[i];
+	}
+
+	if (!xexPath)
+	{
+		printf("Usage: %s [options] <xex name>\n", argv[0]);
+		printf("\t--ir\t\t\tRun guest code through the optimizing IR interpreter\n");
+		printf("\t--jit\t\t\tRecompile guest code to x86-64 instead of interpreting it\n");
+		printf("\t--fastmem\t\tLet JIT code access guest memory through one flat host mapping\n");
+		printf("\t--pool-stats\t\tPrint kernel pool usage by tag on exit\n");
+		printf("\t--verify-xex\t\tCheck loaded images against their block and page hashes\n");
+		printf("\t--no-xex-cache\t\tDecode every image from scratch, rather than using .waternoose/cache\n");
+		printf("\t--trace\t\t\tPrint every executed instruction\n");
+		printf("\t--trace-file=<path>\tWrite a binary instruction trace to <path>, see tracedump\n");
 		return 0;
 	}
 
-	char* xam_buf;
-	size_t xam_size;
+#ifndef WATERNOOSE_TRACE
+	if (Trace::mode != Trace::TRACE_OFF)
+		printf("WARN: Tracing was not compiled in, rebuild with -DWATERNOOSE_TRACE=ON\n");
+#endif
 
-	std::ifstream file(".waternoose/systemroot/xam.xex", std::ios::binary | std::ios::ate);
-	if (!file.is_open())
-		printf("Failed to open file %s\n", ".waternoose/systemroot/xam.xex");
-	xam_size = file.tellg();
-	file.seekg(0, std::ios::beg);
-	xam_buf = new char[xam_size];
-	file.read(xam_buf, xam_size);
-	file.close();
+	if ((useJit || useIR) && Trace::mode != Trace::TRACE_OFF)
+	{
+		printf("WARN: Tracing only works in the interpreter, ignoring --jit and --ir\n");
+		useJit = useIR = false;
+	}
 
-	char* buf;
-	size_t size;
+	if (useFastmem && !useJit)
+		printf("WARN: Only the JIT uses the fastmem window, --fastmem does nothing without --jit\n");
 
-	file.open(argv[1], std::ios::binary | std::ios::ate);
-	size = file.tellg();
-	file.seekg(0, std::ios::beg);
-	buf = new char[size];
-	file.read(buf, size);
-	file.close();
+	MappedFile xamFile, titleFile;
+	if (!xamFile.Open(".waternoose/systemroot/xam.xex") || !titleFile.Open(xexPath))
+		return 1;
 
-	Memory::Initialize();
+	Memory::Initialize(useFastmem);
+	CPUThread::InitDecoder();
+	if (useJit)
+		JIT::Initialize();
+	if (useIR)
+		IR::Enable();
 
 	krnlModule.Initialize();
 
 	std::atexit(Memory::Dump);
+	if (poolStats)
+		std::atexit(Pool::DumpStats);
 
-	xam = new XexLoader((uint8_t*)xam_buf, xam_size, ".waternoose/SystemRoot/xam.xex");
-	//XexLoader loader((uint8_t*)buf, size, argv[0]);
+	xam = new XexLoader(xamFile.Data(), xamFile.Size(), ".waternoose/SystemRoot/xam.xex");
+	xamFile.Close();
+	//XexLoader loader(titleFile.Data(), titleFile.Size(), argv[0]);
+
+	// Handlers run in reverse, so the hardware threads are parked before the trace is flushed and nothing's written after
+	std::atexit(Trace::Shutdown);
+	std::atexit(atexit_handler);
+
+	TimerWheel::Initialize();
+	HardwareThreads::Initialize(*xam);
 
 #if 1
 	mainThreadStackSize = xam->GetStackSize();
-	mainThread = new CPUThread(xam->GetEntryPoint(), xam->GetStackSize(), *xam);
-	mainThread->SetArg(0, 0xBCBCBCBC);
-	mainThread->SetArg(1, 1);
-	mainThread->SetArg(2, 0);
+	GuestThread_t* mainThread = Scheduler::CreateThread(xam->GetEntryPoint(), xam->GetStackSize(), THREAD_PRIORITY_NORMAL, THREAD_AFFINITY_ALL, true);
+	Scheduler::SetArg(mainThread, 0, 0xBCBCBCBC);
+	Scheduler::SetArg(mainThread, 1, 1);
+	Scheduler::SetArg(mainThread, 2, 0);
 #else
 	mainThreadStackSize = loader.GetStackSize();
-	mainThread = new CPUThread(loader.GetEntryPoint(), loader.GetStackSize(), loader);
+	GuestThread_t* mainThread = Scheduler::CreateThread(loader.GetEntryPoint(), loader.GetStackSize(), THREAD_PRIORITY_NORMAL, THREAD_AFFINITY_ALL, true);
 #endif
 
-	std::atexit(atexit_handler);
-
-	while (1)
-	{
-	 	mainThread->Run();
-	}
+	Scheduler::Resume(mainThread);
+	Scheduler::WaitForExit(mainThread);
 
-	delete mainThread;
+	Scheduler::Shutdown();
+	HardwareThreads::Shutdown();
+	TimerWheel::Shutdown();
 
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include <memory/fastmem.h>
+#include <memory/memory.h>
+#include <util.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <bitset>
+
+#define PAGE_SIZE (4*1024)
+#define WINDOW_SIZE (1ULL << 32)
+// Covers an 8-byte access at 0xFFFFFFFF
+#define GUARD_SIZE (64*1024)
+// Physical memory lives where its 64 KB page alias would identity map it. The VMM never hands out
+// the aliases, so nothing else is ever backed by this part of the memfd
+#define PHYSICAL_MEMFD_OFFSET 0xA0000000ULL
+
+namespace Fastmem
+{
+
+static uint8_t* base = nullptr;
+static int memfd = -1;
+static std::bitset<WINDOW_SIZE / PAGE_SIZE> mappedPages;
+static struct sigaction oldAction;
+
+/// @brief The parts of a faulting `mov` the handler needs to replay it
+typedef struct
+{
+	int length;
+	int size; // Access size in bytes
+	bool store;
+	int reg; // x86 register number of the value operand
+	bool highByte; // AH..BH, only possible for 8-bit accesses without a REX prefix
+} HostAccess_t;
+
+/// @brief Decodes the plain loads and stores the JIT emits against the window:
+/// 8B/89 (32 and 64-bit, 16-bit with 66), 88, 0F B6 and 0F B7, with any ModRM/SIB addressing
+static bool DecodeAccess(const uint8_t* code, HostAccess_t& out)
+{
+	const uint8_t* p = code;
+	bool opsize = false;
+	uint8_t rex = 0;
+
+	if (*p == 0x66)
+	{
+		opsize = true;
+		p++;
+	}
+	if ((*p & 0xF0) == 0x40)
+		rex = *p++;
+
+	bool rexW = rex & 8;
+	switch (*p++)
+	{
+	case 0x8B:
+		out.store = false;
+		out.size = rexW ? 8 : (opsize ? 2 : 4);
+		break;
+	case 0x89:
+		out.store = true;
+		out.size = rexW ? 8 : (opsize ? 2 : 4);
+		break;
+	case 0x88:
+		out.store = true;
+		out.size = 1;
+		break;
+	case 0x0F:
+		if (*p != 0xB6 && *p != 0xB7)
+			return false;
+		out.store = false;
+		out.size = (*p++ == 0xB6) ? 1 : 2;
+		break;
+	default:
+		return false;
+	}
+
+	uint8_t modrm = *p++;
+	uint8_t mod = modrm >> 6;
+	uint8_t rm = modrm & 7;
+	if (mod == 3)
+		return false;
+
+	out.reg = ((modrm >> 3) & 7) | ((rex & 4) ? 8 : 0);
+	out.highByte = (out.size == 1 && out.store && !rex && out.reg >= 4);
+
+	if (rm == 4)
+	{
+		uint8_t sib = *p++;
+		if (mod == 0 && (sib & 7) == 5)
+			p += 4;
+	}
+	else if (mod == 0 && rm == 5)
+		p += 4; // RIP-relative
+
+	if (mod == 1)
+		p += 1;
+	else if (mod == 2)
+		p += 4;
+
+	out.length = p - code;
+	return true;
+}
+
+static const int gregForReg[16] =
+{
+	REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+	REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+};
+
+static void FaultHandler(int, siginfo_t* info, void* ctx)
+{
+	uint8_t* addr = (uint8_t*)info->si_addr;
+	ucontext_t* uc = (ucontext_t*)ctx;
+	greg_t* gregs = uc->uc_mcontext.gregs;
+	HostAccess_t access;
+
+	if (addr < base || addr >= base + WINDOW_SIZE + GUARD_SIZE
+		|| !DecodeAccess((const uint8_t*)gregs[REG_RIP], access))
+	{
+		// Not ours, let it crash the way it would have without fastmem
+		sigaction(SIGSEGV, &oldAction, nullptr);
+		return;
+	}
+
+	uint32_t guestAddr = addr - base;
+	int highShift = access.highByte ? 8 : 0;
+	greg_t& reg = gregs[gregForReg[access.highByte ? access.reg - 4 : access.reg]];
+
+	// The window holds big-endian guest memory and the JIT byte-swaps after loading and before storing,
+	// so the register contents are in memory order here
+	if (access.store)
+	{
+		uint64_t value = (uint64_t)reg >> highShift;
+		switch (access.size)
+		{
+		case 1: Memory::Write8(guestAddr, value); break;
+		case 2: Memory::Write16(guestAddr, bswap16(value)); break;
+		case 4: Memory::Write32(guestAddr, bswap32(value)); break;
+		case 8: Memory::Write64(guestAddr, bswap64(value)); break;
+		}
+	}
+	else
+	{
+		// Loads into 8, 16 (movzx) and 32-bit registers all clear the upper bits
+		switch (access.size)
+		{
+		case 1: reg = Memory::Read8(guestAddr); break;
+		case 2: reg = bswap16(Memory::Read16(guestAddr)); break;
+		case 4: reg = bswap32(Memory::Read32(guestAddr)); break;
+		case 8: reg = bswap64(Memory::Read64(guestAddr)); break;
+		}
+	}
+
+	gregs[REG_RIP] += access.length;
+}
+
+void Initialize()
+{
+	base = (uint8_t*)mmap(nullptr, WINDOW_SIZE + GUARD_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED)
+	{
+		printf("Failed to reserve the fastmem window: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	memfd = memfd_create("waternoose-guest", 0);
+	if (memfd < 0 || ftruncate(memfd, WINDOW_SIZE) < 0)
+	{
+		printf("Failed to create guest memory backing: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = FaultHandler;
+	action.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGSEGV, &action, &oldAction);
+}
+
+bool IsEnabled()
+{
+	return base != nullptr;
+}
+
+uint8_t* GetBase()
+{
+	return base;
+}
+
+void* Map(uint32_t addr, uint32_t size)
+{
+	size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+	void* window = mmap(base + addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memfd, addr);
+	void* view = mmap((void*)(uint64_t)addr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, addr);
+	if (window == MAP_FAILED || view == MAP_FAILED)
+	{
+		printf("Failed to map guest memory at 0x%08x: %s\n", addr, strerror(errno));
+		exit(1);
+	}
+
+	for (uint64_t page = addr; page < (uint64_t)addr + size; page += PAGE_SIZE)
+		mappedPages[page / PAGE_SIZE] = true;
+
+	return view;
+}
+
+void Unmap(uint32_t addr, uint32_t size)
+{
+	UnmapAlias(addr, size);
+	fallocate(memfd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, addr, (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+}
+
+uint8_t* MapPhysicalMemory(uint32_t size)
+{
+	void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, memfd, PHYSICAL_MEMFD_OFFSET);
+	if (view == MAP_FAILED)
+	{
+		printf("Failed to map physical memory: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	return (uint8_t*)view;
+}
+
+void MapAlias(uint32_t addr, uint32_t size, uint32_t physAddr)
+{
+	size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+	if (mmap(base + addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memfd, PHYSICAL_MEMFD_OFFSET + physAddr) == MAP_FAILED)
+	{
+		printf("Failed to map physical memory at 0x%08x: %s\n", addr, strerror(errno));
+		exit(1);
+	}
+
+	for (uint64_t page = addr; page < (uint64_t)addr + size; page += PAGE_SIZE)
+		mappedPages[page / PAGE_SIZE] = true;
+}
+
+void UnmapAlias(uint32_t addr, uint32_t size)
+{
+	size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+	// Back to the reservation the window started out as, so accesses fault again
+	mmap(base + addr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+
+	for (uint64_t page = addr; page < (uint64_t)addr + size; page += PAGE_SIZE)
+		mappedPages[page / PAGE_SIZE] = false;
+}
+
+void DiscardPhysical(uint32_t physAddr, uint32_t size)
+{
+	fallocate(memfd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, PHYSICAL_MEMFD_OFFSET + physAddr, size);
+}
+
+void Protect(uint32_t addr, bool read, bool write)
+{
+	if (!mappedPages[addr / PAGE_SIZE])
+		return;
+
+	uint32_t page = addr & ~(PAGE_SIZE - 1);
+	mprotect(base + page, PAGE_SIZE, (read ? PROT_READ : 0) | (write ? PROT_WRITE : 0));
+}
+
+}
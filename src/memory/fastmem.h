@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+/// @brief Optional flat view of the guest address space: guest address `addr` lives at host `GetBase() + addr`.
+/// All guest memory is backed by one memfd. Every allocation is mapped twice, once into the 4 GB window
+/// and once wherever the kernel likes for readPages/writePages, so both views always see the same bytes.
+/// The JIT accesses the window directly. Anything that faults there (the hardcoded addresses in the
+/// slow paths, unmapped memory, accesses the page's protection or flags turn away) is decoded by a SIGSEGV handler and replayed through Memory::
+namespace Fastmem
+{
+
+/// @brief Reserves the window, creates the backing memfd and installs the fault handler
+void Initialize();
+bool IsEnabled();
+/// @brief Host address of guest address 0, or nullptr when fastmem is off
+uint8_t* GetBase();
+
+/// @brief Maps [addr, addr+size) of guest memory into the window and returns a second, table-side view of it
+void* Map(uint32_t addr, uint32_t size);
+/// @brief Takes [addr, addr+size) back out of the window and discards its contents. The caller unmaps its own view
+void Unmap(uint32_t addr, uint32_t size);
+
+/// @brief Maps all of physical memory (see memory/physical.h) once, for the page tables to point into
+uint8_t* MapPhysicalMemory(uint32_t size);
+/// @brief Maps the physical memory at `physAddr` into the window at `addr`. Every alias of it sees the same bytes
+void MapAlias(uint32_t addr, uint32_t size, uint32_t physAddr);
+/// @brief Takes [addr, addr+size) back out of the window, leaving whatever backs it alone
+void UnmapAlias(uint32_t addr, uint32_t size);
+/// @brief Drops the contents of physical memory that was freed, so it reads back as zeroes
+void DiscardPhysical(uint32_t physAddr, uint32_t size);
+/// @brief Mirrors what the page tables allow for a page into the window, so the accesses they'd turn away
+/// fault and go through Memory:: as well. That's where code gets invalidated, watched pages marked dirty
+/// and protection enforced
+void Protect(uint32_t addr, bool read, bool write);
+
+}
@@ -1,35 +1,172 @@
 #include <memory/memory.h>
+#include <memory/fastmem.h>
+#include <memory/vmm.h>
+#include <memory/physical.h>
 #include <util.h>
 #include <stddef.h>
 #include <sys/mman.h>
+#include <unistd.h>
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
 #include <fstream>
-#include <bitset>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
 #include <loader/xex.h>
 #include <cpu/CPU.h>
+#include <cpu/blockcache.h>
+#include <cpu/reservation.h>
 #include <tmmintrin.h>
 #include "memory.h"
 
 extern uint32_t mainThreadStackSize;
 
-std::vector<AllocInfo> allocInfo;
-
+// What the guest can see through: readPages and writePages hold a page's host pointer only while it can be read or
+// written without anything else having to happen first, otherwise the access goes through Fault. hostPages always has it
 uint8_t** readPages, **writePages;
+static uint8_t** hostPages;
+// All of physical memory, mapped once up front. Physical allocations point their pages into it
+static uint8_t* physicalMemory;
 #define PAGE_SIZE (4*1024)
 #define MAX_ADDRESS_SPACE 0xFFFF0000
-std::bitset<MAX_ADDRESS_SPACE / PAGE_SIZE> usedPages;
 
-void Memory::Initialize()
+#define PAGE_FLAG_CODE 0x01 // Holds decoded guest code, the first store invalidates it
+#define PAGE_FLAG_WATCHED 0x02 // Write-watched, see WatchWrites
+#define PAGE_FLAG_DIRTY 0x04 // Written since it was last reset, for watched pages
+#define PAGE_FLAG_GUARD 0x08 // PAGE_GUARD, the first access of any kind clears it
+
+// Guards pageProtect and pageFlags, and so what ApplyProtection puts in the page tables
+static std::mutex protectLock;
+static uint8_t pageProtect[MAX_ADDRESS_SPACE / PAGE_SIZE]; // PAGE_ constants, without the modifiers
+static uint8_t pageFlags[MAX_ADDRESS_SPACE / PAGE_SIZE];
+
+static bool IsReadable(uint8_t protect)
+{
+	return protect & (PAGE_READONLY | PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY);
+}
+
+static bool IsWritable(uint8_t protect)
+{
+	return protect & (PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY);
+}
+
+/// @brief Recomputes what the page tables, and the fastmem window, let through for a page. Call with protectLock held
+static void ApplyProtection(uint32_t page)
+{
+	uint8_t* host = hostPages[page];
+	uint8_t flags = pageFlags[page];
+	bool readable = host && IsReadable(pageProtect[page]) && !(flags & PAGE_FLAG_GUARD);
+	bool writable = readable && IsWritable(pageProtect[page]) && !(flags & PAGE_FLAG_CODE)
+		&& (flags & (PAGE_FLAG_WATCHED | PAGE_FLAG_DIRTY)) != PAGE_FLAG_WATCHED;
+
+	readPages[page] = readable ? host : nullptr;
+	writePages[page] = writable ? host : nullptr;
+	if (host && Fastmem::IsEnabled())
+		Fastmem::Protect(page * PAGE_SIZE, readable, writable);
+}
+
+/// @brief The slow path of an access the page tables didn't let through. Does whatever the page needed first
+/// (invalidating its code, marking it dirty, clearing its guard) and lets the access go ahead.
+/// Accesses the page's protection forbids are fatal
+/// @return false if the page isn't mapped at all, which the caller reports
+static bool Fault(uint32_t addr, bool write)
+{
+	uint32_t page = addr / PAGE_SIZE;
+	if (!hostPages[page])
+		return false;
+
+	// Takes the block cache's lock, which calls back into SetCodePage
+	if (write && (pageFlags[page] & PAGE_FLAG_CODE))
+		BlockCache::InvalidatePage(addr);
+
+	std::lock_guard<std::mutex> guard(protectLock);
+
+	if (pageFlags[page] & PAGE_FLAG_GUARD)
+	{
+		// The console raises STATUS_GUARD_PAGE_VIOLATION here. Without exceptions to deliver it as,
+		// the guard just goes away like it would after the handler ran
+		printf("Guard page at 0x%08x hit\n", page * PAGE_SIZE);
+		pageFlags[page] &= ~PAGE_FLAG_GUARD;
+	}
+
+	if (!(write ? IsWritable(pageProtect[page]) : IsReadable(pageProtect[page])))
+	{
+		printf("%s 0x%08x violates the page's protection (0x%02x)\n", write ? "Write to" : "Read from", addr, pageProtect[page]);
+		exit(1);
+	}
+
+	if (write && (pageFlags[page] & PAGE_FLAG_WATCHED))
+		pageFlags[page] |= PAGE_FLAG_DIRTY;
+
+	ApplyProtection(page);
+	return true;
+}
+
+/// @brief Everything that has to know about guest stores that get past the page tables: lwarx reservations on the line.
+/// Pages holding code or being watched aren't writable in the tables, so their first store goes through Fault
+static inline void NotifyWrite(uint32_t addr)
+{
+	Reservation::OnStore(addr);
+}
+
+/// @brief NotifyWrite for every reservation line in a range, for the stores that cover more than one
+static void NotifyWriteRange(uint32_t addr, uint32_t size)
+{
+	uint32_t lineSize = 1 << RESERVATION_LINE_SHIFT;
+	for (uint64_t line = addr & ~(lineSize - 1); line < (uint64_t)addr + size; line += lineSize)
+		Reservation::OnStore(line);
+}
+
+/// @brief Calls `fn(hostPtr, length)` on each run of the `size` bytes at `addr` that's contiguous on the host,
+/// which is every page mapped by the same AllocMemory. Stops early if `fn` returns false
+template<typename Fn>
+static void ForEachSpan(bool write, uint32_t addr, uint32_t size, const char* op, Fn fn)
+{
+	uint8_t** pages = write ? writePages : readPages;
+	while (size)
+	{
+		if (!pages[addr / PAGE_SIZE] && !Fault(addr, write))
+		{
+			printf("%s on unmapped addr 0x%08x\n", op, addr);
+			exit(1);
+		}
+
+		uint8_t* host = &pages[addr / PAGE_SIZE][addr % PAGE_SIZE];
+		uint32_t len = PAGE_SIZE - addr % PAGE_SIZE;
+		while (len < size && (uint64_t)addr + len < MAX_ADDRESS_SPACE && pages[(addr + len) / PAGE_SIZE] == host + len)
+			len += PAGE_SIZE;
+		len = std::min(len, size);
+
+		if (!fn(host, len))
+			return;
+		addr += len;
+		size -= len;
+	}
+}
+
+void Memory::Initialize(bool fastmem)
 {
-	readPages = new uint8_t*[MAX_ADDRESS_SPACE / PAGE_SIZE];
-	writePages = new uint8_t*[MAX_ADDRESS_SPACE / PAGE_SIZE];
-	usedPages.reset();
+	if (fastmem)
+		Fastmem::Initialize();
+
+	readPages = new uint8_t*[MAX_ADDRESS_SPACE / PAGE_SIZE]();
+	writePages = new uint8_t*[MAX_ADDRESS_SPACE / PAGE_SIZE]();
+	hostPages = new uint8_t*[MAX_ADDRESS_SPACE / PAGE_SIZE]();
+
+	if (fastmem)
+		physicalMemory = Fastmem::MapPhysicalMemory(PHYSICAL_MEMORY_SIZE);
+	else
+		physicalMemory = (uint8_t*)mmap(nullptr, PHYSICAL_MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (physicalMemory == MAP_FAILED)
+	{
+		printf("Failed to reserve physical memory: %s\n", strerror(errno));
+		exit(1);
+	}
 
-	for (size_t i = 0; i < 64*1024; i += 4096)
-		usedPages[i / 4096] = true;
+	VMM::Initialize();
+	Physical::Initialize();
 }
 
 void Memory::Dump()
@@ -51,9 +188,51 @@ void Memory::Dump()
 	file.close();
 }
 
+/// @brief Points the pages of [baseAddress, baseAddress+size) at the host memory at `host`, read/write to start with
+static void SetHostPages(uint32_t baseAddress, uint32_t size, uint8_t* host)
+{
+	size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+	std::lock_guard<std::mutex> guard(protectLock);
+	for (uint32_t i = 0; i < size; i += PAGE_SIZE)
+	{
+		uint32_t page = (baseAddress + i) / PAGE_SIZE;
+		hostPages[page] = host + i;
+		pageProtect[page] = PAGE_READWRITE;
+		pageFlags[page] = 0;
+		ApplyProtection(page);
+	}
+}
+
+/// @param unmapHost Whether each page has its own host mapping to get rid of, rather than pointing into physical memory
+static void ClearHostPages(uint32_t baseAddress, uint32_t size, bool unmapHost)
+{
+	for (uint64_t addr = baseAddress; addr < (uint64_t)baseAddress + size; addr += PAGE_SIZE)
+	{
+		uint32_t page = addr / PAGE_SIZE;
+		if (!hostPages[page])
+			continue;
+
+		// Drops any decoded code along with the page's code flag
+		if (pageFlags[page] & PAGE_FLAG_CODE)
+			BlockCache::InvalidatePage(addr);
+
+		std::lock_guard<std::mutex> guard(protectLock);
+		if (unmapHost)
+			munmap(hostPages[page], PAGE_SIZE);
+		hostPages[page] = nullptr;
+		pageFlags[page] = 0;
+		ApplyProtection(page);
+	}
+}
+
 void *Memory::AllocMemory(uint32_t baseAddress, uint32_t size)
 {
-	void* ret = mmap((void*)baseAddress, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	void* ret;
+	if (Fastmem::IsEnabled())
+		ret = Fastmem::Map(baseAddress, size);
+	else
+		ret = mmap((void*)baseAddress, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
 
 	if (ret == MAP_FAILED)
 	{
@@ -61,64 +240,133 @@ void *Memory::AllocMemory(uint32_t baseAddress, uint32_t size)
 		exit(1);
 	}
 
-	size = (size + PAGE_SIZE) & ~PAGE_SIZE;
+	SetHostPages(baseAddress, size, (uint8_t*)ret);
+	return ret;
+}
+
+void Memory::FreeMemory(uint32_t baseAddress, uint32_t size)
+{
+	ClearHostPages(baseAddress, size, true);
+
+	if (Fastmem::IsEnabled())
+		Fastmem::Unmap(baseAddress, size);
+}
+
+void Memory::MapPhysical(uint32_t baseAddress, uint32_t size, uint32_t physAddr)
+{
+	if (Fastmem::IsEnabled())
+		Fastmem::MapAlias(baseAddress, size, physAddr);
+
+	SetHostPages(baseAddress, size, physicalMemory + physAddr);
+}
+
+void Memory::UnmapPhysical(uint32_t baseAddress, uint32_t size)
+{
+	ClearHostPages(baseAddress, size, false);
+
+	if (Fastmem::IsEnabled())
+		Fastmem::UnmapAlias(baseAddress, size);
+}
+
+void Memory::DiscardPhysical(uint32_t physAddr, uint32_t size)
+{
+	if (Fastmem::IsEnabled())
+		Fastmem::DiscardPhysical(physAddr, size);
+	else
+		madvise(physicalMemory + physAddr, size, MADV_DONTNEED);
+}
+
+bool Memory::MapFile(uint32_t baseAddress, uint32_t size, int fd, uint64_t offset)
+{
+	uint8_t* host = Map(baseAddress, size, true);
 
-	for (int i = 0; i < size; i += PAGE_SIZE)
+	if (!Fastmem::IsEnabled() && mmap(host, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) != MAP_FAILED)
+		return true;
+
+	for (uint64_t done = 0; done < size;)
 	{
-		readPages[(baseAddress + i) / PAGE_SIZE] = ((uint8_t*)ret+i);
-		writePages[(baseAddress + i) / PAGE_SIZE] = ((uint8_t*)ret+i);
+		ssize_t n = pread(fd, host + done, size - done, offset + done);
+		if (n <= 0)
+			return false;
+		done += n;
 	}
 
-	return ret;
+	return true;
+}
+
+void Memory::SetCodePage(uint32_t addr, bool isCode)
+{
+	uint32_t page = addr / PAGE_SIZE;
+	std::lock_guard<std::mutex> guard(protectLock);
+
+	if (((pageFlags[page] & PAGE_FLAG_CODE) != 0) == isCode)
+		return;
+
+	if (isCode)
+		pageFlags[page] |= PAGE_FLAG_CODE;
+	else
+		pageFlags[page] &= ~PAGE_FLAG_CODE;
+	ApplyProtection(page);
 }
 
-uint32_t Memory::VirtAllocMemoryRange(uint32_t beginAddr, uint32_t endAddr, uint32_t size)
+void Memory::Protect(uint32_t addr, uint32_t size, uint32_t protect)
 {
-	uint32_t requiredPages = size / PAGE_SIZE;
+	std::lock_guard<std::mutex> guard(protectLock);
 
-	// Find the lowest free range that fits the size
-	uint32_t candidate = 0;
-	uint32_t freePages = 0;
-	for (uint32_t i = beginAddr; i < endAddr; i += PAGE_SIZE)
+	for (uint64_t page = addr / PAGE_SIZE; page <= ((uint64_t)addr + size - 1) / PAGE_SIZE; page++)
 	{
-		if (!candidate && !usedPages[i / PAGE_SIZE])
-		{
-			candidate = i / PAGE_SIZE;
-			freePages = 1;
-		}
-		else if (!usedPages[i / PAGE_SIZE])
-		{
-			freePages++;
-			if (freePages == requiredPages)
-				break;
-		}
+		pageProtect[page] = protect & 0xFF;
+		if (protect & PAGE_GUARD)
+			pageFlags[page] |= PAGE_FLAG_GUARD;
 		else
-		{
-			candidate = 0;
-		}
+			pageFlags[page] &= ~PAGE_FLAG_GUARD;
+		ApplyProtection(page);
 	}
+}
 
-	if (candidate == 0)
+void Memory::WatchWrites(uint32_t addr, uint32_t size)
+{
+	std::lock_guard<std::mutex> guard(protectLock);
+
+	for (uint64_t page = addr / PAGE_SIZE; page <= ((uint64_t)addr + size - 1) / PAGE_SIZE; page++)
 	{
-		printf("ERROR: Failed to allocate virtual memory in range [0x%08x -> 0x%08x]\n", beginAddr, endAddr);
-		exit(1);
+		pageFlags[page] = (pageFlags[page] | PAGE_FLAG_WATCHED) & ~PAGE_FLAG_DIRTY;
+		ApplyProtection(page);
+	}
+}
+
+void Memory::UnwatchWrites(uint32_t addr, uint32_t size)
+{
+	std::lock_guard<std::mutex> guard(protectLock);
+
+	for (uint64_t page = addr / PAGE_SIZE; page <= ((uint64_t)addr + size - 1) / PAGE_SIZE; page++)
+	{
+		pageFlags[page] &= ~(PAGE_FLAG_WATCHED | PAGE_FLAG_DIRTY);
+		ApplyProtection(page);
 	}
+}
 
-	// Mark the pages as used
-	for (int i = 0; i < requiredPages; i++)
-		usedPages.set(candidate+i, true);
-	
-	AllocInfo info;
-	info.baseAddress = candidate*PAGE_SIZE;
-	info.regionSize = requiredPages*PAGE_SIZE;
-	allocInfo.push_back(info);
-	
-	return candidate*PAGE_SIZE;
+void Memory::GetDirtyPages(uint32_t addr, uint32_t size, std::vector<uint32_t>& out, bool reset)
+{
+	std::lock_guard<std::mutex> guard(protectLock);
+
+	for (uint64_t page = addr / PAGE_SIZE; page <= ((uint64_t)addr + size - 1) / PAGE_SIZE; page++)
+	{
+		if ((pageFlags[page] & (PAGE_FLAG_WATCHED | PAGE_FLAG_DIRTY)) != (PAGE_FLAG_WATCHED | PAGE_FLAG_DIRTY))
+			continue;
+
+		out.push_back(page * PAGE_SIZE);
+		if (reset)
+		{
+			pageFlags[page] &= ~PAGE_FLAG_DIRTY;
+			ApplyProtection(page);
+		}
+	}
 }
 
 uint8_t *Memory::GetRawPtrForAddr(uint32_t addr)
 {
-	if (!readPages[addr / PAGE_SIZE])
+	if (!readPages[addr / PAGE_SIZE] && !Fault(addr, false))
 	{
 		printf("Read raw ptr from unmapped addr 0x%08x\n", addr);
 		exit(1);
@@ -127,19 +375,117 @@ uint8_t *Memory::GetRawPtrForAddr(uint32_t addr)
 	return &readPages[addr / PAGE_SIZE][addr % PAGE_SIZE];
 }
 
-bool Memory::GetAllocInfo(uint32_t addr, AllocInfo& outInfo)
+uint8_t *Memory::Map(uint32_t addr, uint32_t size, bool write)
 {
-	for (auto& info : allocInfo)
+	uint8_t** pages = write ? writePages : readPages;
+	uint8_t* ptr = nullptr;
+
+	for (uint32_t page = addr / PAGE_SIZE; page <= (addr + size - 1) / PAGE_SIZE; page++)
 	{
-		if (info.baseAddress <= addr && info.baseAddress+info.regionSize > addr)
+		if (!pages[page] && !Fault(page == addr / PAGE_SIZE ? addr : page * PAGE_SIZE, write))
+		{
+			printf("Map of 0x%08x bytes at 0x%08x covers unmapped memory\n", size, addr);
+			exit(1);
+		}
+
+		if (!ptr)
 		{
-			outInfo = info;
-			return true;
+			ptr = &pages[page][addr % PAGE_SIZE];
+			continue;
+		}
+
+		// Pages are only contiguous on the host within one AllocMemory
+		if (pages[page] != ptr + (page * PAGE_SIZE - addr))
+		{
+			printf("Map of 0x%08x bytes at 0x%08x crosses an allocation\n", size, addr);
+			exit(1);
 		}
 	}
-	
-	printf("Failed to get allocation info for region 0x%08x\n", addr);
-	return false;
+
+	if (write)
+		NotifyWriteRange(addr, size);
+
+	return ptr;
+}
+
+// The bulk operations hand each span to libc, whose memcpy/memset/memchr/memcmp are already vectorized
+
+void Memory::Copy(uint32_t dst, uint32_t src, uint32_t size)
+{
+	ForEachSpan(false, src, size, "Copy", [&](uint8_t* host, uint32_t len)
+	{
+		CopyFromHost(dst, host, len);
+		dst += len;
+		return true;
+	});
+}
+
+void Memory::Fill(uint32_t dst, uint8_t value, uint32_t size)
+{
+	if (!size)
+		return;
+
+	NotifyWriteRange(dst, size);
+	ForEachSpan(true, dst, size, "Fill", [&](uint8_t* host, uint32_t len)
+	{
+		memset(host, value, len);
+		return true;
+	});
+}
+
+int Memory::Compare(uint32_t a, uint32_t b, uint32_t size)
+{
+	int result = 0;
+	ForEachSpan(false, a, size, "Compare", [&](uint8_t* hostA, uint32_t len)
+	{
+		ForEachSpan(false, b, len, "Compare", [&](uint8_t* hostB, uint32_t lenB)
+		{
+			result = memcmp(hostA, hostB, lenB);
+			hostA += lenB;
+			return result == 0;
+		});
+		b += len;
+		return result == 0;
+	});
+	return result;
+}
+
+uint32_t Memory::StrLen(uint32_t addr, uint32_t max)
+{
+	uint32_t length = 0;
+	ForEachSpan(false, addr, std::min<uint64_t>(max, MAX_ADDRESS_SPACE - (uint64_t)addr), "StrLen", [&](uint8_t* host, uint32_t len)
+	{
+		uint8_t* nul = (uint8_t*)memchr(host, 0, len);
+		length += nul ? nul - host : len;
+		return !nul;
+	});
+	return length;
+}
+
+void Memory::CopyFromHost(uint32_t dst, const void* src, uint32_t size)
+{
+	if (!size)
+		return;
+
+	NotifyWriteRange(dst, size);
+	const uint8_t* from = (const uint8_t*)src;
+	ForEachSpan(true, dst, size, "CopyFromHost", [&](uint8_t* host, uint32_t len)
+	{
+		memcpy(host, from, len);
+		from += len;
+		return true;
+	});
+}
+
+void Memory::CopyToHost(void* dst, uint32_t src, uint32_t size)
+{
+	uint8_t* to = (uint8_t*)dst;
+	ForEachSpan(false, src, size, "CopyToHost", [&](uint8_t* host, uint32_t len)
+	{
+		memcpy(to, host, len);
+		to += len;
+		return true;
+	});
 }
 
 uint8_t Memory::Read8(uint32_t addr, bool slow)
@@ -148,7 +494,7 @@ uint8_t Memory::Read8(uint32_t addr, bool slow)
 	{
 		if (!readPages[addr / PAGE_SIZE])
 		{
-			return Read8(addr, true);
+			return Fault(addr, false) ? Read8(addr) : Read8(addr, true);
 		}
 
 		return readPages[addr / PAGE_SIZE][addr % PAGE_SIZE];
@@ -172,7 +518,7 @@ uint16_t Memory::Read16(uint32_t addr, bool slow)
 	{
 		if (!readPages[addr / PAGE_SIZE])
 		{
-			return Read16(addr, true);
+			return Fault(addr, false) ? Read16(addr) : Read16(addr, true);
 		}
 
 		return bswap16(*(uint16_t*)&readPages[addr / PAGE_SIZE][addr % PAGE_SIZE]);
@@ -207,7 +553,7 @@ uint32_t Memory::Read32(uint32_t addr, bool slow)
 	{
 		if (!readPages[addr / PAGE_SIZE])
 		{
-			return Read32(addr, true);
+			return Fault(addr, false) ? Read32(addr) : Read32(addr, true);
 		}
 
 		return bswap32(*(uint32_t*)&readPages[addr / PAGE_SIZE][addr % PAGE_SIZE]);
@@ -234,7 +580,7 @@ uint32_t Memory::Read32(uint32_t addr, bool slow)
 
 uint64_t Memory::Read64(uint32_t addr)
 {
-	if (!readPages[addr / PAGE_SIZE])
+	if (!readPages[addr / PAGE_SIZE] && !Fault(addr, false))
 	{
 		printf("Read64 from unmapped addr 0x%08x\n", addr);
 		exit(1);
@@ -255,7 +601,7 @@ unsigned __int128 swap(unsigned __int128 n)
 
 __uint128_t Memory::Read128(uint32_t addr)
 {
-	if (!readPages[addr / PAGE_SIZE])
+	if (!readPages[addr / PAGE_SIZE] && !Fault(addr, false))
 	{
 		printf("Read128 from unmapped addr 0x%08x\n", addr);
 		exit(1);
@@ -265,58 +611,80 @@ __uint128_t Memory::Read128(uint32_t addr)
 	return swap(t);
 }
 
+bool Memory::CompareExchange32(uint32_t addr, uint32_t expected, uint32_t desired)
+{
+	if (!writePages[addr / PAGE_SIZE] && !Fault(addr, true))
+	{
+		printf("CompareExchange32 on unmapped addr 0x%08x\n", addr);
+		exit(1);
+	}
+
+	std::atomic_ref<uint32_t> word(*(uint32_t*)&writePages[addr / PAGE_SIZE][addr % PAGE_SIZE]);
+	uint32_t swapped = bswap32(expected);
+	if (!word.compare_exchange_strong(swapped, bswap32(desired)))
+		return false;
+
+	NotifyWrite(addr);
+	return true;
+}
+
 void Memory::Write8(uint32_t addr, uint8_t data)
 {
-	if (!writePages[addr / PAGE_SIZE])
+	if (!writePages[addr / PAGE_SIZE] && !Fault(addr, true))
 	{
 		printf("Write8 to unmapped addr 0x%08x\n", addr);
 		exit(1);
 	}
 
+	NotifyWrite(addr);
 	writePages[addr / PAGE_SIZE][addr % PAGE_SIZE] = data;
 }
 
 void Memory::Write16(uint32_t addr, uint16_t data)
 {
-	if (!writePages[addr / PAGE_SIZE])
+	if (!writePages[addr / PAGE_SIZE] && !Fault(addr, true))
 	{
 		printf("Write16 to unmapped addr 0x%08x\n", addr);
 		exit(1);
 	}
 
+	NotifyWrite(addr);
 	*(uint16_t*)&writePages[addr / PAGE_SIZE][addr % PAGE_SIZE] = bswap16(data);
 }
 
 void Memory::Write32(uint32_t addr, uint32_t data)
 {
-	if (!writePages[addr / PAGE_SIZE])
+	if (!writePages[addr / PAGE_SIZE] && !Fault(addr, true))
 	{
 		printf("Write32 to unmapped addr 0x%08x\n", addr);
 		exit(1);
 	}
 
+	NotifyWrite(addr);
 	*(uint32_t*)&writePages[addr / PAGE_SIZE][addr % PAGE_SIZE] = bswap32(data);
 }
 
 void Memory::Write64(uint32_t addr, uint64_t data)
 {
-	if (!writePages[addr / PAGE_SIZE])
+	if (!writePages[addr / PAGE_SIZE] && !Fault(addr, true))
 	{
 		printf("Write64 to unmapped addr 0x%08x\n", addr);
 		exit(1);
 	}
 
+	NotifyWrite(addr);
 	*(uint64_t*)&writePages[addr / PAGE_SIZE][addr % PAGE_SIZE] = bswap64(data);
 }
 
 void Memory::Write128(uint32_t addr, __uint128_t data)
 {
-	if (!writePages[addr / PAGE_SIZE])
+	if (!writePages[addr / PAGE_SIZE] && !Fault(addr, true))
 	{
 		printf("Write64 to unmapped addr 0x%08x\n", addr);
 		exit(1);
 	}
 
+	NotifyWrite(addr);
 	data = swap(data);
 	*(__uint128_t*)&writePages[addr / PAGE_SIZE][addr % PAGE_SIZE] = data;
 }
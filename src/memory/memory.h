@@ -1,35 +1,55 @@
 #pragma once
 
 #include <stdint.h>
-
-struct AllocInfo
-{
-	uint32_t baseAddress;
-	uint32_t regionSize;
-};
+#include <vector>
 
 namespace Memory
 {
 
-void Initialize();
+/// @param fastmem Also map guest memory into one flat host window for the JIT (see memory/fastmem.h)
+void Initialize(bool fastmem = false);
 void Dump();
 
-/// @brief Map a chunk of memory into the address space, while also allocing memory to back it
+/// @brief Map a chunk of memory into the address space, while also allocing memory to back it.
+/// This only backs pages, use the VMM (see memory/vmm.h) to find room for and keep track of allocations
 /// @param baseAddress The start of the address range to map
 /// @param size The size, in bytes, of the allocation
 /// @return A pointer to the newly allocated chunk of memory
 void* AllocMemory(uint32_t baseAddress, uint32_t size);
+/// @brief Unmaps pages AllocMemory mapped, and drops any code decoded from them
+void FreeMemory(uint32_t baseAddress, uint32_t size);
+/// @brief Backs [baseAddress, baseAddress+size) with the physical memory at `physAddr` instead, which is already
+/// mapped on the host, so it costs no syscalls. Use Physical:: (see memory/physical.h) to allocate physical memory
+void MapPhysical(uint32_t baseAddress, uint32_t size, uint32_t physAddr);
+/// @brief Unmaps pages MapPhysical mapped, and drops any code decoded from them. The physical memory keeps its contents
+void UnmapPhysical(uint32_t baseAddress, uint32_t size);
+/// @brief Drops the contents of freed physical memory, so it's zeroed the next time it's handed out
+void DiscardPhysical(uint32_t physAddr, uint32_t size);
+/// @brief Fills the committed pages of [baseAddress, baseAddress+size), which have to be from one AllocMemory, with
+/// the file `fd` from `offset` on. Without fastmem the file is mapped over them copy-on-write, so pages are only read
+/// in when they're touched. Fastmem's views have to share the memfd's pages, so there it's read into them instead.
+/// All of it has to be page aligned
+/// @return false if the file couldn't be mapped or read, which may leave some of the pages filled in
+bool MapFile(uint32_t baseAddress, uint32_t size, int fd, uint64_t offset);
 
-/// @brief Used this function to acquire a base address from a range
-/// For example, the stack is from `0x70000000 ... 0x7F000000`, so you'd do `VirtAllocMemoryRange(0x70000000, 0x7F000000, stack_size)`
-/// Used `AllocMemory` to actually commit the memory, while also mapping it into memory at the appropriate address
-/// @param beginAddr The start of the range to alloc from
-/// @param endAddr The end of the range to alloc from
-/// @param size The size, in bytes, of the allocation
-uint32_t VirtAllocMemoryRange(uint32_t beginAddr, uint32_t endAddr, uint32_t size);
+/// @brief Flags the page containing `addr` as holding decoded guest code. Writes to a flagged page invalidate the block cache
+void SetCodePage(uint32_t addr, bool isCode);
+/// @brief Sets the protection (PAGE_ constants, PAGE_GUARD included) of the pages covering [addr, addr+size).
+/// Accesses it forbids are fatal, the first access to a guard page just clears the guard
+void Protect(uint32_t addr, uint32_t size, uint32_t protect);
+
+/// @brief Starts tracking stores to the pages covering [addr, addr+size), all of them clean to begin with.
+/// Only the first store to a clean page takes the slow path, after that it's writable again until it's reset
+void WatchWrites(uint32_t addr, uint32_t size);
+void UnwatchWrites(uint32_t addr, uint32_t size);
+/// @brief Appends the base of every watched page in [addr, addr+size) stored to since it was last reset to `out`.
+/// With `reset` they're clean again afterwards
+void GetDirtyPages(uint32_t addr, uint32_t size, std::vector<uint32_t>& out, bool reset);
 
 uint8_t* GetRawPtrForAddr(uint32_t addr);
-bool GetAllocInfo(uint32_t addr, AllocInfo& info);
+/// @brief A host pointer to all `size` bytes at `addr`, looked up once, for reading or writing a whole guest struct in place.
+/// With `write` it counts as a store to the whole range, like Write32 does for its four bytes
+uint8_t* Map(uint32_t addr, uint32_t size, bool write);
 
 uint8_t Read8(uint32_t addr, bool slow = false);
 /// @brief Reads a 16-bit value from the memory mapped to `addr`. Leave slow as default, it's used internally
@@ -44,4 +64,21 @@ void Write32(uint32_t addr, uint32_t data);
 void Write64(uint32_t addr, uint64_t data);
 void Write128(uint32_t addr, __uint128_t data);
 
+/// @brief Atomically replaces the 32-bit value at `addr` with `desired` if it's still `expected`, for stwcx.
+/// Like the writes, a successful exchange invalidates decoded code and other reservations on the line
+bool CompareExchange32(uint32_t addr, uint32_t expected, uint32_t desired);
+
+// Bulk operations on guest memory. They work a page table span at a time, so ranges can cross pages and allocations.
+// Stores through them invalidate decoded code and reservations like the single writes do
+
+/// @brief Copies `size` bytes from `src` to `dst`. The ranges mustn't overlap
+void Copy(uint32_t dst, uint32_t src, uint32_t size);
+void Fill(uint32_t dst, uint8_t value, uint32_t size);
+/// @return memcmp's result for the two ranges
+int Compare(uint32_t a, uint32_t b, uint32_t size);
+/// @brief The length of the NUL terminated string at `addr`, or `max` if it's longer
+uint32_t StrLen(uint32_t addr, uint32_t max = UINT32_MAX);
+void CopyFromHost(uint32_t dst, const void* src, uint32_t size);
+void CopyToHost(void* dst, uint32_t src, uint32_t size);
+
 }
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include <memory/physical.h>
+#include <memory/vmm.h>
+#include <memory/memory.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <set>
+#include <mutex>
+#include <algorithm>
+
+// Blocks are 4 KB << order, up to one block of all of physical memory
+#define FRAME_SIZE 0x1000ULL
+#define MAX_ORDER 17
+
+namespace Physical
+{
+
+/// @brief One alias of physical memory. The allocation at physical address `p` lives at `base + p`
+typedef struct
+{
+	uint32_t base;
+	uint32_t pageSize;
+	uint32_t limit; // Physical memory from here up can't be mapped in this alias, it'd run past the address space
+	std::map<uint32_t, uint32_t> allocations; // Physical address to size
+} Heap_t;
+
+// Guards everything below
+static std::mutex lock;
+static Heap_t heaps[] =
+{
+	{0xA0000000, 64*1024, PHYSICAL_MEMORY_SIZE, {}},
+	{0xC0000000, 16*1024*1024, PHYSICAL_MEMORY_SIZE, {}},
+	{0xE0000000, 4*1024, 0x1FFF0000, {}},
+};
+/// @brief Free blocks of each order, by physical address. A block's buddy is never free alongside it, they'd have merged
+static std::set<uint32_t> freeBlocks[MAX_ORDER + 1];
+
+static uint64_t BlockSize(int order)
+{
+	return FRAME_SIZE << order;
+}
+
+/// @return The smallest order whose blocks hold `size` bytes
+static int OrderFor(uint64_t size)
+{
+	int order = 0;
+	while (BlockSize(order) < size)
+		order++;
+	return order;
+}
+
+static void InsertBlock(uint64_t addr, int order)
+{
+	while (order < MAX_ORDER)
+	{
+		auto buddy = freeBlocks[order].find(addr ^ BlockSize(order));
+		if (buddy == freeBlocks[order].end())
+			break;
+
+		addr = std::min<uint64_t>(addr, *buddy);
+		freeBlocks[order].erase(buddy);
+		order++;
+	}
+
+	freeBlocks[order].insert(addr);
+}
+
+/// @brief Frees [addr, addr+size), in the biggest aligned blocks it splits into
+static void FreeRange(uint64_t addr, uint64_t size)
+{
+	while (size)
+	{
+		int order = MAX_ORDER;
+		while ((addr % BlockSize(order)) || BlockSize(order) > size)
+			order--;
+
+		InsertBlock(addr, order);
+		addr += BlockSize(order);
+		size -= BlockSize(order);
+	}
+}
+
+/// @brief Finds `size` bytes aligned to `alignment` inside [minAddr, maxAddr), in the smallest free block that has them.
+/// Whatever's left of the block goes straight back
+/// @return The physical address, or -1 if nothing fits
+static uint64_t TakeRange(uint64_t size, uint64_t alignment, uint64_t minAddr, uint64_t maxAddr)
+{
+	for (int order = OrderFor(std::max(size, alignment)); order <= MAX_ORDER; order++)
+	{
+		for (auto it = freeBlocks[order].lower_bound(minAddr & ~(BlockSize(order) - 1)); it != freeBlocks[order].end() && *it < maxAddr; ++it)
+		{
+			uint64_t block = *it;
+			uint64_t start = std::max(block, (minAddr + alignment - 1) & ~(alignment - 1));
+			if (start + size > std::min(block + BlockSize(order), maxAddr))
+				continue;
+
+			freeBlocks[order].erase(it);
+			FreeRange(block, start - block);
+			FreeRange(start + size, block + BlockSize(order) - (start + size));
+			return start;
+		}
+	}
+
+	return (uint64_t)-1;
+}
+
+static Heap_t* HeapFor(uint32_t addr)
+{
+	for (auto& heap : heaps)
+		if (addr >= heap.base && addr - heap.base < PHYSICAL_MEMORY_SIZE)
+			return &heap;
+	return nullptr;
+}
+
+void Initialize()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	for (auto& blocks : freeBlocks)
+		blocks.clear();
+	for (auto& heap : heaps)
+		heap.allocations.clear();
+	FreeRange(0, PHYSICAL_MEMORY_SIZE);
+}
+
+uint32_t Allocate(uint32_t size, uint32_t pageSize, uint32_t minAddr, uint32_t maxAddr, uint32_t alignment, uint32_t protect)
+{
+	Heap_t* heap = nullptr;
+	for (auto& candidate : heaps)
+		if (candidate.pageSize == pageSize)
+			heap = &candidate;
+	if (!heap || !size)
+		return 0;
+
+	// Alignments that aren't powers of two are rounded up to one, buddy blocks only come in those
+	uint64_t length = ((uint64_t)size + pageSize - 1) & ~(uint64_t)(pageSize - 1);
+	uint64_t align = BlockSize(OrderFor(std::max(alignment, pageSize)));
+	uint64_t limit = maxAddr ? std::min<uint64_t>((uint64_t)maxAddr + 1, heap->limit) : heap->limit;
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	uint64_t physAddr = TakeRange(length, align, minAddr, limit);
+	if (physAddr == (uint64_t)-1)
+		return 0;
+
+	uint32_t addr = heap->base + physAddr;
+	if (!VMM::ReservePhysical(addr, length, physAddr, protect))
+	{
+		printf("ERROR: Physical memory at 0x%08x is mapped twice\n", addr);
+		exit(1);
+	}
+	VMM::Commit(addr, length, protect);
+
+	heap->allocations[physAddr] = length;
+	return addr;
+}
+
+bool Free(uint32_t addr)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	Heap_t* heap = HeapFor(addr);
+	if (!heap)
+		return false;
+
+	auto it = heap->allocations.find(addr - heap->base);
+	if (it == heap->allocations.end())
+		return false;
+
+	VMM::Release(addr);
+	Memory::DiscardPhysical(it->first, it->second);
+	FreeRange(it->first, it->second);
+	heap->allocations.erase(it);
+	return true;
+}
+
+uint32_t AllocateKernel(uint32_t size)
+{
+	uint32_t addr = Allocate(size, 4*1024, 0, 0, 0, PAGE_READWRITE);
+	if (!addr)
+	{
+		printf("ERROR: Out of physical memory allocating 0x%08x bytes\n", size);
+		exit(1);
+	}
+
+	return addr;
+}
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// The console's 512 MB of RAM
+#define PHYSICAL_MEMORY_SIZE 0x20000000
+
+/// @brief The guest's physical memory, and the three ranges that alias all of it: 64 KB pages at 0xA0000000,
+/// 16 MB pages at 0xC0000000 and 4 KB pages at 0xE0000000. Each alias is its own heap, handing out its page size,
+/// but they share one buddy allocator over the physical frames, so an allocation in one can't overlap one in another.
+/// Physical memory is mapped on the host once up front and allocations only point the page tables into it
+namespace Physical
+{
+
+void Initialize();
+
+/// @brief Allocates `size` bytes of physical memory between the physical addresses `minAddr` and `maxAddr` (inclusive,
+/// 0 for no limit) and maps it in the alias for `pageSize`, which both the size and alignment get rounded up to
+/// @param protect PAGE_ constants, to commit it with
+/// @return The allocation's address in the alias, or 0 if there's no room
+uint32_t Allocate(uint32_t size, uint32_t pageSize, uint32_t minAddr, uint32_t maxAddr, uint32_t alignment, uint32_t protect);
+/// @brief Frees the allocation based at `addr`, in any of the aliases
+bool Free(uint32_t addr);
+
+/// @brief Allocates `size` bytes of read/write 4 KB page memory anywhere, for the kernel's own use. Running out is fatal
+uint32_t AllocateKernel(uint32_t size);
+
+}
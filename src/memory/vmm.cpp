@@ -0,0 +1,401 @@
+#include <memory/vmm.h>
+#include <memory/memory.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <mutex>
+#include <algorithm>
+
+// The first 64 KB is never handed out, the hardcoded slow path addresses live there.
+// Everything from the physical memory aliases up only holds allocations Physical:: makes
+#define ADDRESS_SPACE_START 0x10000ULL
+#define ADDRESS_SPACE_END 0xA0000000ULL
+
+namespace VMM
+{
+
+/// @brief Pages of an allocation that are all reserved, or all committed with the same protection
+typedef struct
+{
+	uint32_t size;
+	uint32_t state;
+	uint32_t protect;
+} PageRun_t;
+
+typedef struct
+{
+	uint32_t base;
+	uint32_t size;
+	uint32_t protect; // What it was reserved with
+	bool physical; // Backed by physical memory at physAddr rather than pages of its own
+	uint32_t physAddr;
+	std::map<uint32_t, PageRun_t> runs; // Keyed by base. They cover the whole allocation, and neighbours always differ
+} Allocation_t;
+
+// Guards everything below
+static std::mutex lock;
+/// @brief Keyed by base address
+static std::map<uint32_t, Allocation_t> allocations;
+/// @brief Base address to size, coalesced so no two touch
+static std::map<uint64_t, uint64_t> freeRanges;
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static uint64_t AlignDown(uint64_t value, uint64_t alignment)
+{
+	return value & ~(alignment - 1);
+}
+
+static std::map<uint32_t, Allocation_t>::iterator FindAllocation(uint64_t addr)
+{
+	auto it = allocations.upper_bound(addr);
+	if (it == allocations.begin())
+		return allocations.end();
+	--it;
+	return addr < (uint64_t)it->first + it->second.size ? it : allocations.end();
+}
+
+/// @return The free range [base, base+size) lies in, or freeRanges.end()
+static std::map<uint64_t, uint64_t>::iterator FindFree(uint64_t base, uint64_t size)
+{
+	auto it = freeRanges.upper_bound(base);
+	if (it == freeRanges.begin())
+		return freeRanges.end();
+	--it;
+	return base + size <= it->first + it->second ? it : freeRanges.end();
+}
+
+static void TakeFree(std::map<uint64_t, uint64_t>::iterator range, uint64_t base, uint64_t size)
+{
+	uint64_t rangeBase = range->first, rangeEnd = range->first + range->second;
+	freeRanges.erase(range);
+	if (base > rangeBase)
+		freeRanges[rangeBase] = base - rangeBase;
+	if (base + size < rangeEnd)
+		freeRanges[base + size] = rangeEnd - (base + size);
+}
+
+static void GiveFree(uint64_t base, uint64_t size)
+{
+	auto next = freeRanges.lower_bound(base);
+	if (next != freeRanges.end() && next->first == base + size)
+	{
+		size += next->second;
+		next = freeRanges.erase(next);
+	}
+	if (next != freeRanges.begin())
+	{
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == base)
+		{
+			prev->second += size;
+			return;
+		}
+	}
+	freeRanges[base] = size;
+}
+
+/// @brief Makes sure a run starts at `addr`, if it's inside the allocation
+static void SplitAt(Allocation_t& allocation, uint32_t base, uint64_t addr)
+{
+	if (addr >= (uint64_t)base + allocation.size)
+		return;
+
+	auto it = std::prev(allocation.runs.upper_bound(addr));
+	if (it->first == addr)
+		return;
+
+	PageRun_t tail = it->second;
+	tail.size = it->first + it->second.size - addr;
+	it->second.size = addr - it->first;
+	allocation.runs[addr] = tail;
+}
+
+static void Coalesce(Allocation_t& allocation)
+{
+	for (auto it = allocation.runs.begin(); it != allocation.runs.end();)
+	{
+		auto next = std::next(it);
+		if (next != allocation.runs.end() && next->second.state == it->second.state && next->second.protect == it->second.protect)
+		{
+			it->second.size += next->second.size;
+			allocation.runs.erase(next);
+		}
+		else
+			it = next;
+	}
+}
+
+/// @brief Finds the allocation all of [start, end) is in and splits its runs at both ends
+static Allocation_t* Carve(uint64_t start, uint64_t end)
+{
+	auto it = FindAllocation(start);
+	if (it == allocations.end() || end > (uint64_t)it->first + it->second.size)
+		return nullptr;
+
+	SplitAt(it->second, it->first, start);
+	SplitAt(it->second, it->first, end);
+	return &it->second;
+}
+
+void Initialize()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	allocations.clear();
+	freeRanges.clear();
+	freeRanges[ADDRESS_SPACE_START] = ADDRESS_SPACE_END - ADDRESS_SPACE_START;
+}
+
+static Allocation_t& Insert(uint64_t base, uint64_t size, uint32_t protect)
+{
+	Allocation_t& allocation = allocations[base];
+	allocation.base = base;
+	allocation.size = size;
+	allocation.protect = protect;
+	allocation.physical = false;
+	allocation.physAddr = 0;
+	allocation.runs[base] = {(uint32_t)size, MEM_RESERVE, 0};
+	return allocation;
+}
+
+/// @brief Backs or unbacks one run of an allocation
+static void MapRun(const Allocation_t& allocation, uint32_t addr, uint32_t size, bool map)
+{
+	if (allocation.physical)
+	{
+		if (map)
+			Memory::MapPhysical(addr, size, allocation.physAddr + (addr - allocation.base));
+		else
+			Memory::UnmapPhysical(addr, size);
+	}
+	else
+	{
+		if (map)
+			Memory::AllocMemory(addr, size);
+		else
+			Memory::FreeMemory(addr, size);
+	}
+}
+
+uint32_t Reserve(uint32_t begin, uint32_t end, uint32_t size, uint32_t alignment, bool topDown, uint32_t protect)
+{
+	uint64_t length = AlignUp(size, VMM_PAGE_SIZE);
+	alignment = std::max<uint32_t>(alignment, VMM_PAGE_SIZE);
+	if (!length)
+		return 0;
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	// Only the free ranges that overlap the window are looked at
+	uint64_t found = 0;
+	if (!topDown)
+	{
+		auto it = freeRanges.upper_bound(begin);
+		if (it != freeRanges.begin())
+			--it;
+		for (; it != freeRanges.end() && it->first < end; ++it)
+		{
+			uint64_t lo = AlignUp(std::max<uint64_t>(it->first, begin), alignment);
+			uint64_t hi = std::min<uint64_t>(it->first + it->second, end);
+			if (lo + length <= hi)
+			{
+				found = lo;
+				break;
+			}
+		}
+	}
+	else
+	{
+		for (auto it = freeRanges.lower_bound(end); it != freeRanges.begin();)
+		{
+			--it;
+			uint64_t hi = std::min<uint64_t>(it->first + it->second, end);
+			uint64_t lo = std::max<uint64_t>(it->first, begin);
+			if (hi <= begin)
+				break;
+			if (hi >= length && AlignDown(hi - length, alignment) >= lo)
+			{
+				found = AlignDown(hi - length, alignment);
+				break;
+			}
+		}
+	}
+
+	if (!found)
+		return 0;
+
+	TakeFree(FindFree(found, length), found, length);
+	Insert(found, length, protect);
+	return found;
+}
+
+bool ReserveAt(uint32_t base, uint32_t size, uint32_t protect)
+{
+	uint64_t start = AlignDown(base, VMM_PAGE_SIZE);
+	uint64_t length = AlignUp((uint64_t)base + size, VMM_PAGE_SIZE) - start;
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto range = FindFree(start, length);
+	if (!length || range == freeRanges.end())
+		return false;
+
+	TakeFree(range, start, length);
+	Insert(start, length, protect);
+	return true;
+}
+
+bool ReservePhysical(uint32_t base, uint32_t size, uint32_t physAddr, uint32_t protect)
+{
+	uint64_t end = AlignUp((uint64_t)base + size, VMM_PAGE_SIZE);
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	// The aliases aren't in the free ranges, all that matters is not landing on another allocation
+	auto next = allocations.lower_bound(base);
+	if (base < ADDRESS_SPACE_END || (base % VMM_PAGE_SIZE) || FindAllocation(base) != allocations.end()
+		|| (next != allocations.end() && next->first < end))
+		return false;
+
+	Allocation_t& allocation = Insert(base, end - base, protect);
+	allocation.physical = true;
+	allocation.physAddr = physAddr;
+	return true;
+}
+
+bool Commit(uint32_t addr, uint32_t size, uint32_t protect)
+{
+	uint64_t start = AlignDown(addr, VMM_PAGE_SIZE);
+	uint64_t end = AlignUp((uint64_t)addr + size, VMM_PAGE_SIZE);
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	Allocation_t* allocation = Carve(start, end);
+	if (!allocation)
+		return false;
+
+	for (auto it = allocation->runs.find(start); it != allocation->runs.end() && it->first < end; ++it)
+	{
+		if (it->second.state != MEM_COMMIT)
+			MapRun(*allocation, it->first, it->second.size, true);
+		Memory::Protect(it->first, it->second.size, protect);
+		it->second.state = MEM_COMMIT;
+		it->second.protect = protect;
+	}
+
+	Coalesce(*allocation);
+	return true;
+}
+
+bool Decommit(uint32_t addr, uint32_t size)
+{
+	uint64_t start = AlignDown(addr, VMM_PAGE_SIZE);
+	uint64_t end = AlignUp((uint64_t)addr + size, VMM_PAGE_SIZE);
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	Allocation_t* allocation = Carve(start, end);
+	if (!allocation)
+		return false;
+
+	for (auto it = allocation->runs.find(start); it != allocation->runs.end() && it->first < end; ++it)
+	{
+		if (it->second.state == MEM_COMMIT)
+			MapRun(*allocation, it->first, it->second.size, false);
+		it->second.state = MEM_RESERVE;
+		it->second.protect = 0;
+	}
+
+	Coalesce(*allocation);
+	return true;
+}
+
+bool Release(uint32_t base)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto it = allocations.find(base);
+	if (it == allocations.end())
+		return false;
+
+	for (auto& run : it->second.runs)
+		if (run.second.state == MEM_COMMIT)
+			MapRun(it->second, run.first, run.second.size, false);
+
+	if (!it->second.physical)
+		GiveFree(base, it->second.size);
+	allocations.erase(it);
+	return true;
+}
+
+bool Query(uint32_t addr, VirtualRegion_t& out)
+{
+	uint32_t page = AlignDown(addr, VMM_PAGE_SIZE);
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto allocation = FindAllocation(page);
+	if (allocation != allocations.end())
+	{
+		auto run = std::prev(allocation->second.runs.upper_bound(page));
+		out.baseAddress = page;
+		out.regionSize = run->first + run->second.size - page;
+		out.allocationBase = allocation->first;
+		out.allocationProtect = allocation->second.protect;
+		out.state = run->second.state;
+		out.protect = run->second.protect;
+		out.type = allocation->second.physical ? MEM_PHYSICAL : MEM_PRIVATE;
+		return true;
+	}
+
+	auto range = FindFree(page, VMM_PAGE_SIZE);
+	if (range == freeRanges.end())
+		return false;
+
+	out.baseAddress = page;
+	out.regionSize = range->first + range->second - page;
+	out.allocationBase = 0;
+	out.allocationProtect = 0;
+	out.state = MEM_FREE;
+	out.protect = PAGE_NOACCESS;
+	out.type = 0;
+	return true;
+}
+
+uint32_t AllocationSize(uint32_t addr)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto allocation = FindAllocation(addr);
+	return allocation != allocations.end() ? allocation->second.size : 0;
+}
+
+uint32_t Allocate(uint32_t begin, uint32_t end, uint32_t size)
+{
+	uint32_t base = Reserve(begin, end, size, VMM_PAGE_SIZE, false, PAGE_READWRITE);
+	if (!base)
+	{
+		printf("ERROR: Failed to allocate virtual memory in range [0x%08x -> 0x%08x]\n", begin, end);
+		exit(1);
+	}
+
+	Commit(base, size, PAGE_READWRITE);
+	return base;
+}
+
+void AllocateAt(uint32_t base, uint32_t size)
+{
+	if (!ReserveAt(base, size, PAGE_READWRITE))
+	{
+		printf("ERROR: Virtual memory at [0x%08x -> 0x%08x] is already in use\n", base, base + size);
+		exit(1);
+	}
+
+	Commit(base, size, PAGE_READWRITE);
+}
+
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+
+// Allocation types, as NtAllocateVirtualMemory takes them
+#define MEM_COMMIT 0x1000
+#define MEM_RESERVE 0x2000
+#define MEM_DECOMMIT 0x4000
+#define MEM_RELEASE 0x8000
+#define MEM_FREE 0x10000
+#define MEM_PRIVATE 0x20000
+#define MEM_TOP_DOWN 0x100000
+#define MEM_PHYSICAL 0x400000
+#define MEM_LARGE_PAGES 0x20000000
+#define MEM_16MB_PAGES 0x80000000
+
+#define PAGE_NOACCESS 0x01
+#define PAGE_READONLY 0x02
+#define PAGE_READWRITE 0x04
+#define PAGE_WRITECOPY 0x08
+#define PAGE_EXECUTE 0x10
+#define PAGE_EXECUTE_READ 0x20
+#define PAGE_EXECUTE_READWRITE 0x40
+#define PAGE_EXECUTE_WRITECOPY 0x80
+#define PAGE_GUARD 0x100
+#define PAGE_NOCACHE 0x200
+#define PAGE_WRITECOMBINE 0x400
+
+#define VMM_PAGE_SIZE 0x1000
+#define VMM_LARGE_PAGE_SIZE 0x10000
+
+/// @brief One run of pages with the same state and protection, inside an allocation or between them.
+/// The fields are MEMORY_BASIC_INFORMATION's
+typedef struct
+{
+	uint32_t baseAddress;
+	uint32_t regionSize;
+	uint32_t allocationBase; // 0 for free memory
+	uint32_t allocationProtect;
+	uint32_t state; // MEM_COMMIT, MEM_RESERVE or MEM_FREE
+	uint32_t protect; // 0 unless committed
+	uint32_t type; // MEM_PRIVATE, MEM_PHYSICAL, or 0 for free memory
+} VirtualRegion_t;
+
+/// @brief The guest's virtual address space. Allocations are kept in a balanced tree keyed by base address, each holding
+/// a tree of its reserved and committed page runs, and free space in another tree of coalesced ranges. Lookups are
+/// O(log n) in the number of allocations, and finding room only walks the free ranges inside the requested window.
+/// Committing backs pages with Memory::AllocMemory, decommitting and releasing unmap them again
+namespace VMM
+{
+
+void Initialize();
+
+/// @brief Reserves `size` bytes (rounded up to pages) at the first, or with `topDown` the last, `alignment` aligned
+/// spot in [begin, end) that's free
+/// @return The base of the reservation, or 0 if there's no room
+uint32_t Reserve(uint32_t begin, uint32_t end, uint32_t size, uint32_t alignment, bool topDown, uint32_t protect);
+/// @brief Reserves exactly [base, base+size), if all of it is free
+bool ReserveAt(uint32_t base, uint32_t size, uint32_t protect);
+/// @brief Reserves [base, base+size) in one of the physical memory aliases, for Physical:: (see memory/physical.h).
+/// Committing it maps the physical memory at `physAddr` rather than allocating pages
+bool ReservePhysical(uint32_t base, uint32_t size, uint32_t physAddr, uint32_t protect);
+/// @brief Commits the pages of [addr, addr+size), which have to lie within one reservation.
+/// Pages that are already committed just take on the new protection, which Memory enforces
+bool Commit(uint32_t addr, uint32_t size, uint32_t protect);
+/// @brief Decommits the pages of [addr, addr+size), which have to lie within one reservation
+bool Decommit(uint32_t addr, uint32_t size);
+/// @brief Frees the whole allocation based at `base`
+bool Release(uint32_t base);
+
+/// @brief Describes the region `addr` falls in
+/// @return false if `addr` is outside the guest's address space
+bool Query(uint32_t addr, VirtualRegion_t& out);
+/// @return The size of the allocation containing `addr`, or 0 if it isn't allocated
+uint32_t AllocationSize(uint32_t addr);
+
+/// @brief Reserves and commits `size` bytes of read/write memory somewhere in [begin, end), for the kernel's own use.
+/// Running out of room is fatal
+uint32_t Allocate(uint32_t begin, uint32_t end, uint32_t size);
+/// @brief Reserves and commits [base, base+size), for images that have to load at their base address. Fatal if it's taken
+void AllocateAt(uint32_t base, uint32_t size);
+
+}
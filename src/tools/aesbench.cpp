@@ -0,0 +1,95 @@
+#include <crypto/aes.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// FIPS-197 appendix C.1, and the same block again under CBC to check the chaining
+static const uint8_t testKey[AES_KEY_SIZE] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+static const uint8_t testPlain[AES_BLOCK_SIZE] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+static const uint8_t testCipher[AES_BLOCK_SIZE] = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+
+static bool SelfTest(const AesBackend_t* aes)
+{
+	AesKey_t key;
+	uint8_t iv[AES_BLOCK_SIZE] = {0};
+	uint8_t out[AES_BLOCK_SIZE];
+	aes->keySetupDec(&key, testKey);
+	aes->cbcDecrypt(&key, iv, testCipher, out, 1);
+	return !memcmp(out, testPlain, AES_BLOCK_SIZE) && !memcmp(iv, testCipher, AES_BLOCK_SIZE);
+}
+
+/// @return Throughput in MB/s, best of `runs`
+static double Run(const AesBackend_t* aes, const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int runs)
+{
+	AesKey_t key;
+	aes->keySetupDec(&key, testKey);
+
+	double best = 0;
+	for (int i = 0; i < runs; i++)
+	{
+		uint8_t iv[AES_BLOCK_SIZE] = {0};
+		auto start = std::chrono::steady_clock::now();
+		aes->cbcDecrypt(&key, iv, in.data(), out.data(), in.size() / AES_BLOCK_SIZE);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::max(best, in.size() / elapsed.count() / (1024 * 1024));
+	}
+
+	return best;
+}
+
+/// @brief Measures how fast each AES backend decrypts CBC, the way the loader decrypts XEX payloads
+int main(int argc, char** argv)
+{
+	size_t size = 64;
+	int runs = 5;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			size = strtoul(argv[++i], nullptr, 0);
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			runs = atoi(argv[++i]);
+		else
+		{
+			printf("Usage: %s [-s <MB>] [-n <runs>]\n", argv[0]);
+			printf("\t-s\tHow much to decrypt per run, in MB (default 64)\n");
+			printf("\t-n\tHow many runs to take the best of (default 5)\n");
+			return 0;
+		}
+	}
+
+	std::vector<uint8_t> in(size * 1024 * 1024), out(in.size()), reference(in.size());
+	srand(0);
+	for (auto& byte : in)
+		byte = rand();
+
+	std::vector<const AesBackend_t*> backends = {&aesPortable};
+	if (aes_ni_supported())
+		backends.push_back(&aesNi);
+	else
+		printf("This host has no AES-NI\n");
+
+	for (auto aes : backends)
+	{
+		if (!SelfTest(aes))
+		{
+			printf("ERROR: %s fails the FIPS-197 test vector\n", aes->name);
+			return 1;
+		}
+
+		double speed = Run(aes, in, out, runs);
+		if (aes == &aesPortable)
+			reference = out;
+		else if (out != reference)
+		{
+			printf("ERROR: %s disagrees with %s\n", aes->name, aesPortable.name);
+			return 1;
+		}
+
+		printf("%-10s%10.1f MB/s%s\n", aes->name, speed, aes == aes_backend() ? " (used by the loader)" : "");
+	}
+
+	return 0;
+}
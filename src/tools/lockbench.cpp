@@ -0,0 +1,110 @@
+#include <cpu/reservation.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// The lock word and the data it guards share a cache line, like most guest spin locks
+static uint32_t line[32] __attribute__((aligned(128)));
+#define LOCK_ADDR 0x1000
+#define COUNTER_ADDR 0x1004
+
+static std::atomic<bool> stop;
+
+/// @brief lwarx: reserve the line, then load, the same order CPUThread::lwarx uses
+static uint32_t LoadReserved(uint32_t addr, uint32_t* word, uint32_t& version)
+{
+	version = Reservation::Acquire(addr);
+	return std::atomic_ref<uint32_t>(*word).load(std::memory_order_acquire);
+}
+
+/// @brief stwcx.: the version check, then the compare-exchange and store notification of Memory::CompareExchange32
+static bool StoreConditional(uint32_t addr, uint32_t* word, uint32_t version, uint32_t expected, uint32_t value)
+{
+	if (!Reservation::StillHeld(addr, version))
+		return false;
+	if (!std::atomic_ref<uint32_t>(*word).compare_exchange_strong(expected, value))
+		return false;
+
+	Reservation::OnStore(addr);
+	return true;
+}
+
+/// @brief A plain guest store
+static void Store(uint32_t addr, uint32_t* word, uint32_t value)
+{
+	Reservation::OnStore(addr);
+	std::atomic_ref<uint32_t>(*word).store(value, std::memory_order_release);
+}
+
+static void Worker(uint64_t& acquisitions)
+{
+	uint32_t* lock = &line[0];
+	uint32_t* counter = &line[1];
+
+	while (!stop.load(std::memory_order_relaxed))
+	{
+		// The usual Xbox 360 spin lock: lwarx until it's free, stwcx. to take it, plain store to release it
+		uint32_t version;
+		if (LoadReserved(LOCK_ADDR, lock, version) != 0 || !StoreConditional(LOCK_ADDR, lock, version, 0, 1))
+			continue;
+
+		Store(COUNTER_ADDR, counter, *counter + 1);
+		Store(LOCK_ADDR, lock, 0);
+		acquisitions++;
+	}
+}
+
+/// @brief Measures lwarx/stwcx. spin lock throughput when several host threads fight over one lock
+int main(int argc, char** argv)
+{
+	int threads = 6;
+	double seconds = 2;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else
+		{
+			printf("Usage: %s [-t <threads>] [-d <seconds>]\n", argv[0]);
+			printf("\t-t\tHow many host threads contend for the lock (default 6, one per hardware thread)\n");
+			printf("\t-d\tHow long to run for (default 2)\n");
+			return 0;
+		}
+	}
+
+	std::vector<uint64_t> acquisitions(threads * 16); // Spaced out so the threads' counts don't share cache lines
+	std::vector<std::thread> pool;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < threads; i++)
+		pool.emplace_back(Worker, std::ref(acquisitions[i * 16]));
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	stop = true;
+	for (auto& thread : pool)
+		thread.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	uint64_t total = 0;
+	for (int i = 0; i < threads; i++)
+	{
+		printf("Thread %d: %lu acquisitions\n", i, acquisitions[i * 16]);
+		total += acquisitions[i * 16];
+	}
+
+	printf("%d threads: %.0f acquisitions/s\n", threads, total / elapsed.count());
+
+	// Every increment happened under the lock, so none may be lost
+	if (line[1] != (uint32_t)total)
+	{
+		printf("ERROR: The counter is %u, but the lock was taken %lu times\n", line[1], total);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include <cpu/trace.h>
+#include <cpu/disasm.h>
+#include <cstdio>
+#include <cstring>
+
+/// @brief Turns a binary trace written with `--trace-file` back into the text the interpreter prints with `--trace`,
+/// each line prefixed with the hardware thread that ran it
+int main(int argc, char** argv)
+{
+	const char* path = nullptr;
+	bool showRegs = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-r"))
+			showRegs = true;
+		else
+			path = argv[i];
+	}
+
+	if (!path)
+	{
+		printf("Usage: %s [-r] <trace file>\n", argv[0]);
+		printf("\t-r\tAlso print the value of the register each instruction wrote\n");
+		return 0;
+	}
+
+	FILE* f = fopen(path, "rb");
+	if (!f)
+	{
+		printf("Failed to open file %s\n", path);
+		return 1;
+	}
+
+	TraceFileHeader_t hdr;
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != TRACE_MAGIC)
+	{
+		printf("ERROR: \"%s\" is not a trace file\n", path);
+		return 1;
+	}
+
+	if (hdr.version != TRACE_VERSION || hdr.recordSize != sizeof(TraceRecord_t))
+	{
+		printf("ERROR: Unsupported trace version %d (record size %d)\n", hdr.version, hdr.recordSize);
+		return 1;
+	}
+
+	Disasm::Initialize();
+
+	TraceRecord_t records[4096];
+	size_t count;
+	char buf[128];
+	while ((count = fread(records, sizeof(TraceRecord_t), 4096, f)) > 0)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			TraceRecord_t& rec = records[i];
+			Disasm::Disassemble(rec.instr, rec.pc, buf, sizeof(buf));
+			if (showRegs && rec.gpr != TRACE_NO_GPR)
+				printf("[%d] 0x%08x (0x%08x): %s\t; r%d = 0x%08lx\n", rec.thread, rec.instr, rec.pc, buf, rec.gpr, rec.value);
+			else
+				printf("[%d] 0x%08x (0x%08x): %s\n", rec.thread, rec.instr, rec.pc, buf);
+		}
+	}
+
+	fclose(f);
+	return 0;
+}
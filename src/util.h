@@ -1,7 +1,34 @@
 #pragma once
 
 #include <stdint.h>
+#include <type_traits>
 
 #define bswap64 __builtin_bswap64
 #define bswap32 __builtin_bswap32
-#define bswap16 __builtin_bswap16
\ No newline at end of file
+#define bswap16 __builtin_bswap16
+
+template<typename T>
+inline T bswap(T value)
+{
+	static_assert(std::is_integral_v<T> || std::is_enum_v<T>);
+	if constexpr (sizeof(T) == 1) return value;
+	else if constexpr (sizeof(T) == 2) return (T)bswap16((uint16_t)value);
+	else if constexpr (sizeof(T) == 4) return (T)bswap32((uint32_t)value);
+	else return (T)bswap64((uint64_t)value);
+}
+
+/// @brief A big-endian `T` as it sits in guest memory, for laying out guest structs.
+/// Converts to and from a host `T`, swapping on the way
+template<typename T>
+class be
+{
+public:
+	be() = default;
+	be(T value) : raw(bswap(value)) {}
+	operator T() const {return bswap(raw);}
+	be& operator=(T value) {raw = bswap(value); return *this;}
+private:
+	T raw;
+};
+
+static_assert(sizeof(be<uint64_t>) == 8 && alignof(be<uint64_t>) == 8);
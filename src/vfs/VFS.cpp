@@ -53,6 +53,11 @@ void VFS::SetRootDirectory(std::string rootDir)
 		std::filesystem::create_directories(rootPath);
 }
 
+const std::string& VFS::GetRootDirectory()
+{
+	return rootPath;
+}
+
 struct MountPoint
 {
 	std::string mp, path;
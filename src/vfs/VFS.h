@@ -18,6 +18,8 @@ namespace VFS
 /// @brief This will set the directory from which all subdirectories will be created
 /// @param rootDir The directory where all console files will be stored, such as save data
 void SetRootDirectory(std::string rootDir);
+/// @brief The directory set with SetRootDirectory, as a host path
+const std::string& GetRootDirectory();
 
 /// @brief This will create a directory named `mntPath` under the root directory, and then associate it with `devicePath`. 
 /// Example: `MountDirectory('/SystemRoot', 'SystemRoot0');`: This will create the folder 'SystemRoot0' under the root dir. 